@@ -0,0 +1,111 @@
+// Host-Benchmark: Kosten der Log-Aufrufe im PUBLISH-Pfad pro Nachricht.
+// Vergleicht den bisherigen direkten logMessage()-Aufruf (Argumente werden immer ausgewertet,
+// gefiltert wird erst in der Funktion) mit MQTT_LOG (Prüfung vor der Auswertung, oberhalb von
+// BROKER_LOG_COMPILE_LEVEL gar nicht einkompiliert). Die Zeilen entsprechen publish() mit
+// 10 Abonnenten; formatiert wird wie im Broker per vsnprintf, nur ohne Serial-Ausgabe.
+//
+// Bauen und starten (aus dem Repository-Wurzelverzeichnis), einmal mit allen Levels und
+// einmal mit nur Fehlern/Warnungen einkompiliert:
+//   g++ -O2 -std=c++17 -Isrc extras/bench/log_gate_bench.cpp -o log_gate_bench && ./log_gate_bench
+//   g++ -O2 -std=c++17 -Isrc -DBROKER_LOG_COMPILE_LEVEL=2 extras/bench/log_gate_bench.cpp -o log_gate_bench && ./log_gate_bench
+
+#include "MQTTLog.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct BenchLogger
+{
+    DebugLevel debugLevel = DEBUG_INFO;
+    size_t formatted = 0;
+
+    bool logEnabled(DebugLevel level) const { return level <= debugLevel; }
+
+    // Wie ESPAsyncMQTTBroker::logMessage(): liegt im Broker in einer eigenen Übersetzungseinheit
+    __attribute__((noinline)) void logMessage(DebugLevel level, const char *format, ...)
+    {
+        if (debugLevel == DEBUG_NONE || level > debugLevel)
+            return;
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        formatted += vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        std::string message = buffer; // wie String message = buffer
+    }
+};
+
+struct BenchSubscriber
+{
+    std::string clientId;
+    int qos;
+};
+
+static const char *topic = "home/livingroom/sensor/temperature";
+static const char *publisherId = "esp32-sensor-livingroom";
+
+// Bisher: jeder Aufruf wertet seine Argumente aus und springt in die Vararg-Funktion
+static void publishLegacy(BenchLogger &log, const std::vector<BenchSubscriber> &subs, uint16_t packetId)
+{
+    log.logMessage(DEBUG_INFO, "📤 Broker is publishing on topic '%s' (Length: %u, QoS: %d, Retained: %s)", topic, 42u, 1, "No");
+    log.logMessage(DEBUG_INFO, "   - Excluded client: %s", std::string(publisherId).c_str());
+    for (const auto &s : subs)
+    {
+        log.logMessage(DEBUG_DEBUG, "Storing outgoing QoS %d message for client '%s' (packet ID %u)", s.qos, s.clientId.c_str(), packetId);
+        log.logMessage(DEBUG_DEBUG, "  - Sent PUBLISH to %s (QoS %d), Success: %s", s.clientId.c_str(), s.qos, "Yes");
+    }
+    log.logMessage(DEBUG_INFO, "📊 Message sent to %d of %d subscribed clients", (int)subs.size(), (int)subs.size());
+}
+
+static void publishGated(BenchLogger &log, const std::vector<BenchSubscriber> &subs, uint16_t packetId)
+{
+    BenchLogger *self = &log;
+    MQTT_LOG_TO(self, DEBUG_INFO, "📤 Broker is publishing on topic '%s' (Length: %u, QoS: %d, Retained: %s)", topic, 42u, 1, "No");
+    MQTT_LOG_TO(self, DEBUG_INFO, "   - Excluded client: %s", std::string(publisherId).c_str());
+    for (const auto &s : subs)
+    {
+        MQTT_LOG_TO(self, DEBUG_DEBUG, "Storing outgoing QoS %d message for client '%s' (packet ID %u)", s.qos, s.clientId.c_str(), packetId);
+        MQTT_LOG_TO(self, DEBUG_DEBUG, "  - Sent PUBLISH to %s (QoS %d), Success: %s", s.clientId.c_str(), s.qos, "Yes");
+    }
+    MQTT_LOG_TO(self, DEBUG_INFO, "📊 Message sent to %d of %d subscribed clients", (int)subs.size(), (int)subs.size());
+}
+
+template <typename Fn>
+static double measure(Fn fn, int iterations)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        fn((uint16_t)i);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+}
+
+int main()
+{
+    const int iterations = 500000;
+    std::vector<BenchSubscriber> subs;
+    for (int i = 0; i < 10; i++)
+        subs.push_back({"dashboard-client-" + std::to_string(i), i % 3});
+
+    printf("BROKER_LOG_COMPILE_LEVEL=%d, 10 Abonnenten\n", BROKER_LOG_COMPILE_LEVEL);
+    size_t sink = 0;
+    const DebugLevel levels[] = {DEBUG_INFO, DEBUG_WARNING};
+    const char *names[] = {"DEBUG_INFO", "DEBUG_WARNING"};
+    for (int l = 0; l < 2; l++)
+    {
+        BenchLogger log;
+        log.debugLevel = levels[l];
+        double legacyNs = measure([&](uint16_t id)
+                                  { publishLegacy(log, subs, id); }, iterations);
+        double gatedNs = measure([&](uint16_t id)
+                                 { publishGated(log, subs, id); }, iterations);
+        printf("runtime %-13s: logMessage %8.1f ns/publish, MQTT_LOG %8.1f ns/publish (%.1f ns gespart)\n",
+               names[l], legacyNs, gatedNs, legacyNs - gatedNs);
+        sink += log.formatted;
+    }
+    printf("(sink=%zu)\n", sink);
+    return 0;
+}
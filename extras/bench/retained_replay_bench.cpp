@@ -0,0 +1,117 @@
+// Host-Benchmark: Replay von Retained Messages an einen neu abonnierenden Client.
+// Vergleicht das bisherige Kodieren pro Replay (Puffer anlegen, Remaining Length kodieren,
+// Topic und Payload kopieren) mit dem Schreiben der bei publish() vorkodierten Frames.
+// Das "Schreiben" ist in beiden Fällen ein memcpy in einen Sendepuffer (wie AsyncClient::add()).
+//
+// Bauen und starten (aus dem Repository-Wurzelverzeichnis):
+//   g++ -O2 -std=c++17 -Isrc extras/bench/retained_replay_bench.cpp -o retained_replay_bench
+//   ./retained_replay_bench [retainedTopics] [payloadBytes]
+
+#include "MQTTFrame.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct StoredMessage
+{
+    std::string topic;
+    std::vector<uint8_t> payload;
+    uint8_t qos;
+    MQTTFramePtr frame;
+};
+
+// Sendepuffer des simulierten Clients
+static std::vector<uint8_t> sendBuffer;
+static size_t sendUsed = 0;
+
+static void writeBytes(const uint8_t *data, size_t len)
+{
+    if (sendUsed + len > sendBuffer.size())
+        sendUsed = 0;
+    memcpy(sendBuffer.data() + sendUsed, data, len);
+    sendUsed += len;
+}
+
+// Bisheriger Weg aus sendRetainedMessages(): pro Replay komplett neu kodieren
+static void replayEncode(const StoredMessage &msg)
+{
+    size_t topicLength = msg.topic.length();
+    size_t remainingLengthField = 2 + topicLength + msg.payload.size();
+    size_t totalPacketLength = 1 + mqttRemainingLengthSize(remainingLengthField) + remainingLengthField;
+
+    MQTTPoolBuffer packet = mqttPoolBuffer(totalPacketLength);
+    uint8_t *ptr = packet.get();
+    *ptr++ = (3 << 4) | (msg.qos << 1) | 0x01;
+    ptr = mqttEncodeRemainingLength(ptr, remainingLengthField);
+    *ptr++ = topicLength >> 8;
+    *ptr++ = topicLength & 0xFF;
+    memcpy(ptr, msg.topic.data(), topicLength);
+    ptr += topicLength;
+    memcpy(ptr, msg.payload.data(), msg.payload.size());
+
+    MQTTFramePtr frame = mqttNewFrame();
+    frame->data = std::move(packet);
+    frame->length = totalPacketLength;
+    writeBytes(frame->data.get(), frame->length);
+}
+
+// Neuer Weg: gespeicherten Frame schreiben
+static void replayStored(const StoredMessage &msg)
+{
+    writeBytes(msg.frame->data.get(), msg.frame->length);
+}
+
+int main(int argc, char **argv)
+{
+    const int topicCount = argc > 1 ? atoi(argv[1]) : 500;
+    const size_t payloadBytes = argc > 2 ? (size_t)atoi(argv[2]) : 48;
+    const int rounds = 2000; // ein Round = ein Client abonniert '#' und bekommt alle Retained Messages
+
+    std::vector<StoredMessage> messages(topicCount);
+    for (int i = 0; i < topicCount; i++)
+    {
+        StoredMessage &m = messages[i];
+        m.topic = "home/room" + std::to_string(i % 24) + "/device" + std::to_string(i) + "/state";
+        m.payload.assign(payloadBytes, (uint8_t)('a' + i % 26));
+        m.qos = 0;
+        m.frame = mqttBuildPublishFrame(m.topic.data(), m.topic.length(), m.payload.data(), m.payload.size(), 0, true);
+    }
+    sendBuffer.resize(1 << 20);
+
+    // Gegenprobe: beide Wege erzeugen dieselben Bytes
+    for (const auto &m : messages)
+    {
+        sendUsed = 0;
+        replayEncode(m);
+        std::vector<uint8_t> encoded(sendBuffer.begin(), sendBuffer.begin() + sendUsed);
+        sendUsed = 0;
+        replayStored(m);
+        if (encoded.size() != sendUsed || memcmp(encoded.data(), sendBuffer.data(), sendUsed) != 0)
+        {
+            printf("Abweichung bei '%s'\n", m.topic.c_str());
+            return 1;
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (const auto &m : messages)
+            replayEncode(m);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (const auto &m : messages)
+            replayStored(m);
+    auto t2 = std::chrono::steady_clock::now();
+
+    double encodeUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+    double storedUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / rounds;
+    printf("retained topics=%d payload=%zu bytes\n", topicCount, payloadBytes);
+    printf("encode per replay : %10.1f us/subscribe\n", encodeUs);
+    printf("pre-encoded frame : %10.1f us/subscribe (x%.1f)\n", storedUs, encodeUs / storedUs);
+    printf("(sink=%zu)\n", sendUsed);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Host-Benchmark: Routing eines PUBLISH über den Topic-Baum (MQTTTopicTree)
+// im Vergleich zum früheren linearen Scan Clients x Subscriptions x topicMatches().
+//
+// Bauen und starten (aus dem Repository-Wurzelverzeichnis):
+//   g++ -O2 -std=c++17 -Isrc extras/bench/topic_routing_bench.cpp -o topic_routing_bench
+//   ./topic_routing_bench [clients] [subsProClient]
+
+#include "MQTTTopicTree.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+struct BenchClient
+{
+    std::vector<std::string> filters;
+    uint32_t mark = 0;
+};
+
+// Algorithmus des früheren ESPAsyncMQTTBroker::topicMatches() (ohne Arduino-String)
+static bool scanTopicMatches(const char *f, const char *t)
+{
+    while (*f && *t)
+    {
+        const char *f_end = strchr(f, '/');
+        const char *t_end = strchr(t, '/');
+        size_t f_len = f_end ? (size_t)(f_end - f) : strlen(f);
+        if (f_len == 1 && *f == '#')
+            return true;
+        if (f_len == 1 && *f == '+')
+        {
+            f = f_end ? f_end + 1 : f + f_len;
+            t = t_end ? t_end + 1 : t + strlen(t);
+            continue;
+        }
+        size_t t_len = t_end ? (size_t)(t_end - t) : strlen(t);
+        if (f_len != t_len || strncmp(f, t, f_len) != 0)
+            return false;
+        f = f_end ? f_end + 1 : f + f_len;
+        t = t_end ? t_end + 1 : t + t_len;
+    }
+    if (*f && strcmp(f, "/#") == 0)
+        return true;
+    return *f == *t;
+}
+
+int main(int argc, char **argv)
+{
+    const int clientCount = argc > 1 ? atoi(argv[1]) : 60;
+    const int subsPerClient = argc > 2 ? atoi(argv[2]) : 15;
+    const int rooms = 12;
+    const int sensors = 8;
+    const int iterations = 20000;
+
+    std::mt19937 rng(42);
+    std::vector<BenchClient> clients(clientCount);
+    MQTTTopicTree<BenchClient *> tree;
+
+    // Typische Heimautomations-Filter: exakte Topics, '+' in der Mitte, '#' am Ende
+    for (int c = 0; c < clientCount; c++)
+    {
+        for (int s = 0; s < subsPerClient; s++)
+        {
+            int room = rng() % rooms;
+            int sensor = rng() % sensors;
+            std::string f;
+            switch (rng() % 4)
+            {
+            case 0:
+                f = "home/room" + std::to_string(room) + "/sensor" + std::to_string(sensor) + "/state";
+                break;
+            case 1:
+                f = "home/+/sensor" + std::to_string(sensor) + "/state";
+                break;
+            case 2:
+                f = "home/room" + std::to_string(room) + "/#";
+                break;
+            default:
+                f = "devices/dev" + std::to_string(c) + "/cmd/" + std::to_string(s);
+                break;
+            }
+            clients[c].filters.push_back(f);
+            tree.insert(f.c_str(), f.length(), &clients[c]);
+        }
+    }
+
+    std::vector<std::string> topics;
+    for (int i = 0; i < 256; i++)
+    {
+        topics.push_back("home/room" + std::to_string(rng() % rooms) + "/sensor" + std::to_string(rng() % sensors) + "/state");
+    }
+
+    // Gegenprobe: beide Verfahren liefern dieselbe Anzahl Empfänger
+    uint32_t mark = 0;
+    for (const auto &t : topics)
+    {
+        size_t scanHits = 0;
+        for (auto &c : clients)
+            for (auto &f : c.filters)
+                if (scanTopicMatches(f.c_str(), t.c_str()))
+                {
+                    scanHits++;
+                    break;
+                }
+        size_t treeHits = 0;
+        mark++;
+        tree.forEachMatch(t.c_str(), t.length(), [&](BenchClient *c)
+                          { if (c->mark != mark) { c->mark = mark; treeHits++; } });
+        if (scanHits != treeHits)
+        {
+            printf("Abweichung bei '%s': scan=%zu tree=%zu\n", t.c_str(), scanHits, treeHits);
+            return 1;
+        }
+    }
+
+    size_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        const std::string &t = topics[i & 255];
+        for (auto &c : clients)
+            for (auto &f : c.filters)
+                if (scanTopicMatches(f.c_str(), t.c_str()))
+                {
+                    sink++;
+                    break;
+                }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<BenchClient *> targets;
+    for (int i = 0; i < iterations; i++)
+    {
+        const std::string &t = topics[i & 255];
+        targets.clear();
+        mark++;
+        tree.forEachMatch(t.c_str(), t.length(), [&](BenchClient *c)
+                          { if (c->mark != mark) { c->mark = mark; targets.push_back(c); } });
+        sink += targets.size();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double scanNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+    double treeNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / iterations;
+    printf("clients=%d subs/client=%d filters=%zu\n", clientCount, subsPerClient, tree.size());
+    printf("linear scan : %10.1f ns/publish\n", scanNs);
+    printf("topic tree  : %10.1f ns/publish (x%.1f)\n", treeNs, scanNs / treeNs);
+    printf("(sink=%zu)\n", sink);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "Arduino.h"
+#include "esp_timer.h"
+
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+// Wie im ESP32-Arduino-Core: millis()/micros() leiten sich von esp_timer_get_time() ab
+uint32_t millis()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+void delay(uint32_t ms)
+{
+    // Mit virtueller Uhr (SimNet) nur die Zeit weiterstellen
+    if (espTimerHostVirtualClock())
+        espTimerHostSetTime(esp_timer_get_time() + (int64_t)ms * 1000);
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+}
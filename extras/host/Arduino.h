@@ -0,0 +1,289 @@
+// Host-Ersatz für Arduino.h (Linux): String, millis()/micros()/delay(), Serial, IPAddress.
+// Nur der Umfang, den die Bibliothek und einfache Sketches brauchen; String basiert auf std::string.
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define PROGMEM
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+class String
+{
+public:
+    String() {}
+    String(const char *s) : str(s ? s : "") {}
+    String(const char *s, size_t len) : str(s, len) {}
+    String(const __FlashStringHelper *s) : str(reinterpret_cast<const char *>(s)) {}
+    String(const std::string &s) : str(s) {}
+    explicit String(char c) : str(1, c) {}
+    explicit String(unsigned char v, unsigned char base = 10) : str(toBase(v, base)) {}
+    explicit String(int v, unsigned char base = 10) : str(base == 10 ? std::to_string(v) : toBase((unsigned long)v, base)) {}
+    explicit String(unsigned int v, unsigned char base = 10) : str(toBase(v, base)) {}
+    explicit String(long v, unsigned char base = 10) : str(base == 10 ? std::to_string(v) : toBase((unsigned long)v, base)) {}
+    explicit String(unsigned long v, unsigned char base = 10) : str(toBase(v, base)) {}
+    explicit String(long long v) : str(std::to_string(v)) {}
+    explicit String(unsigned long long v) : str(std::to_string(v)) {}
+    explicit String(float v, unsigned int decimals = 2) : String((double)v, decimals) {}
+    explicit String(double v, unsigned int decimals = 2)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        str = buf;
+    }
+
+    const char *c_str() const { return str.c_str(); }
+    unsigned int length() const { return (unsigned int)str.size(); }
+    bool isEmpty() const { return str.empty(); }
+    bool reserve(unsigned int size)
+    {
+        str.reserve(size);
+        return true;
+    }
+    void clear() { str.clear(); }
+
+    bool concat(const String &s)
+    {
+        str += s.str;
+        return true;
+    }
+    bool concat(const char *s)
+    {
+        if (s)
+            str += s;
+        return s != nullptr;
+    }
+    bool concat(const char *s, unsigned int len)
+    {
+        if (s)
+            str.append(s, len);
+        return s != nullptr;
+    }
+    bool concat(char c)
+    {
+        str += c;
+        return true;
+    }
+
+    String &operator=(const char *s)
+    {
+        str = s ? s : "";
+        return *this;
+    }
+    String &operator+=(const String &s)
+    {
+        str += s.str;
+        return *this;
+    }
+    String &operator+=(const char *s)
+    {
+        concat(s);
+        return *this;
+    }
+    String &operator+=(const __FlashStringHelper *s)
+    {
+        concat(reinterpret_cast<const char *>(s));
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        str += c;
+        return *this;
+    }
+    String &operator+=(int v)
+    {
+        str += std::to_string(v);
+        return *this;
+    }
+    String &operator+=(unsigned int v)
+    {
+        str += std::to_string(v);
+        return *this;
+    }
+    String &operator+=(long v)
+    {
+        str += std::to_string(v);
+        return *this;
+    }
+    String &operator+=(unsigned long v)
+    {
+        str += std::to_string(v);
+        return *this;
+    }
+
+    friend String operator+(const String &a, const String &b) { return String(a.str + b.str); }
+    friend String operator+(const String &a, const char *b) { return String(a.str + (b ? b : "")); }
+    friend String operator+(const char *a, const String &b) { return String((a ? a : "") + b.str); }
+    friend String operator+(const String &a, char c) { return String(a.str + c); }
+
+    bool operator==(const String &s) const { return str == s.str; }
+    bool operator==(const char *s) const { return str == (s ? s : ""); }
+    bool operator!=(const String &s) const { return str != s.str; }
+    bool operator!=(const char *s) const { return !(*this == s); }
+    bool operator<(const String &s) const { return str < s.str; }
+    bool operator>(const String &s) const { return str > s.str; }
+    bool operator<=(const String &s) const { return str <= s.str; }
+    bool operator>=(const String &s) const { return str >= s.str; }
+    bool equals(const String &s) const { return str == s.str; }
+    bool equalsIgnoreCase(const String &s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    int compareTo(const String &s) const { return str.compare(s.str); }
+
+    char charAt(unsigned int index) const { return index < str.size() ? str[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return str[index]; }
+    void setCharAt(unsigned int index, char c)
+    {
+        if (index < str.size())
+            str[index] = c;
+    }
+
+    bool startsWith(const String &prefix) const { return str.compare(0, prefix.str.size(), prefix.str) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return str.size() >= suffix.str.size() && str.compare(str.size() - suffix.str.size(), suffix.str.size(), suffix.str) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return pos(str.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return pos(str.find(s.str, from)); }
+    int lastIndexOf(char c) const { return pos(str.rfind(c)); }
+    int lastIndexOf(const String &s) const { return pos(str.rfind(s.str)); }
+
+    String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= str.size())
+            return String();
+        return String(str.substr(from, to - from));
+    }
+
+    void replace(const String &find, const String &replacement)
+    {
+        if (find.str.empty())
+            return;
+        size_t p = 0;
+        while ((p = str.find(find.str, p)) != std::string::npos)
+        {
+            str.replace(p, find.str.size(), replacement.str);
+            p += replacement.str.size();
+        }
+    }
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1)
+    {
+        if (index < str.size())
+            str.erase(index, count);
+    }
+    void toLowerCase()
+    {
+        for (char &c : str)
+            c = (char)tolower((unsigned char)c);
+    }
+    void toUpperCase()
+    {
+        for (char &c : str)
+            c = (char)toupper((unsigned char)c);
+    }
+    void trim()
+    {
+        size_t begin = 0;
+        while (begin < str.size() && isspace((unsigned char)str[begin]))
+            begin++;
+        size_t end = str.size();
+        while (end > begin && isspace((unsigned char)str[end - 1]))
+            end--;
+        str = str.substr(begin, end - begin);
+    }
+
+    long toInt() const { return strtol(str.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(str.c_str(), nullptr); }
+    double toDouble() const { return strtod(str.c_str(), nullptr); }
+
+private:
+    static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+
+    static std::string toBase(unsigned long v, unsigned char base)
+    {
+        if (base < 2 || base > 36)
+            base = 10;
+        char buf[8 * sizeof(v) + 1];
+        char *p = buf + sizeof(buf);
+        *--p = 0;
+        do
+        {
+            unsigned digit = v % base;
+            *--p = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+            v /= base;
+        } while (v);
+        return p;
+    }
+
+    std::string str;
+};
+
+class IPAddress
+{
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+
+    uint8_t operator[](int index) const { return bytes[index & 3]; }
+    uint8_t &operator[](int index) { return bytes[index & 3]; }
+    bool operator==(const IPAddress &other) const { return memcmp(bytes, other.bytes, 4) == 0; }
+
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return String(buf);
+    }
+
+private:
+    uint8_t bytes[4] = {0, 0, 0, 0};
+};
+
+/// Serial schreibt auf stdout
+class HardwareSerial
+{
+public:
+    void begin(unsigned long) {}
+    size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { return fputc(c, stdout) != EOF; }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t println() { return print("\n"); }
+    template <typename T>
+    size_t println(const T &v)
+    {
+        size_t n = print(v);
+        return n + println();
+    }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format);
+        int n = vprintf(format, args);
+        va_end(args);
+        return n > 0 ? (size_t)n : 0;
+    }
+    void flush() { fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+#endif // HOST_ARDUINO_H
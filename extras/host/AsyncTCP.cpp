@@ -0,0 +1,600 @@
+#include "AsyncTCP.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unordered_set>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int epollFd = -1;
+static std::unordered_set<AsyncHostSocket *> sockets; ///< lebende Objekte (Events für gelöschte ignorieren)
+static std::vector<AsyncClient *> clientList;         ///< für ACK-/Poll-Nachbearbeitung
+static std::vector<AsyncClient *> graveyard;          ///< geschlossene Server-Clients, am Ende des Durchlaufs freigeben
+static std::vector<AsyncServer *> serverList;         ///< für asyncTcpHostFindServer()
+static bool virtualNetwork = false;
+
+static int hostEpoll()
+{
+    if (epollFd < 0)
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+    return epollFd;
+}
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static IPAddress toIPAddress(const sockaddr_in &sa)
+{
+    uint32_t a = ntohl(sa.sin_addr.s_addr);
+    return IPAddress(a >> 24, (a >> 16) & 0xFF, (a >> 8) & 0xFF, a & 0xFF);
+}
+
+static sockaddr_in toSockaddr(IPAddress ip, uint16_t port)
+{
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3]);
+    return sa;
+}
+
+// ---------------- AsyncClient ----------------
+
+AsyncClient::AsyncClient()
+{
+    sockets.insert(this);
+    clientList.push_back(this);
+}
+
+AsyncClient::AsyncClient(int socketFd) : AsyncClient()
+{
+    // Loopback-Messungen sollen nicht von Nagle/Delayed-ACK abhängen; der Broker schreibt ganze Frames
+    noDelay = true;
+    attach(socketFd);
+    state = Connected;
+}
+
+AsyncClient::AsyncClient(AsyncHostLink *link, IPAddress remote, uint16_t remotePort) : AsyncClient()
+{
+    this->link = link;
+    noDelay = true;
+    remoteAddr = remote;
+    remotePortNumber = remotePort;
+    lastPoll = millis();
+    state = Connected;
+}
+
+AsyncClient::~AsyncClient()
+{
+    closeSocket();
+    sockets.erase(this);
+    clientList.erase(std::find(clientList.begin(), clientList.end(), this));
+}
+
+void AsyncClient::attach(int socketFd)
+{
+    fd = socketFd;
+    setNonBlocking(fd);
+    setNoDelay(noDelay);
+    readAddresses();
+
+    lastPoll = millis();
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = static_cast<AsyncHostSocket *>(this);
+    epoll_ctl(hostEpoll(), EPOLL_CTL_ADD, fd, &ev);
+}
+
+void AsyncClient::readAddresses()
+{
+    sockaddr_in sa = {};
+    socklen_t len = sizeof(sa);
+    if (getpeername(fd, (sockaddr *)&sa, &len) == 0)
+    {
+        remoteAddr = toIPAddress(sa);
+        remotePortNumber = ntohs(sa.sin_port);
+    }
+    len = sizeof(sa);
+    if (getsockname(fd, (sockaddr *)&sa, &len) == 0)
+    {
+        localAddr = toIPAddress(sa);
+        localPortNumber = ntohs(sa.sin_port);
+    }
+}
+
+bool AsyncClient::connect(IPAddress ip, uint16_t port)
+{
+    if (state != Closed)
+        return false;
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s < 0)
+        return false;
+    sockaddr_in sa = toSockaddr(ip, port);
+    if (::connect(s, (sockaddr *)&sa, sizeof(sa)) < 0 && errno != EINPROGRESS)
+    {
+        ::close(s);
+        return false;
+    }
+    attach(s);
+    state = Connecting;
+    wantWrite = true; // Verbindungsaufbau meldet sich über EPOLLOUT
+    updateInterest();
+    return true;
+}
+
+bool AsyncClient::connect(const char *host, uint16_t port)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result)
+        return false;
+    IPAddress ip = toIPAddress(*(sockaddr_in *)result->ai_addr);
+    freeaddrinfo(result);
+    return connect(ip, port);
+}
+
+void AsyncClient::closeSocket()
+{
+    if (fd >= 0)
+    {
+        epoll_ctl(hostEpoll(), EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void AsyncClient::close(bool now)
+{
+    if (state == Closed)
+        return;
+    if (!now && state == Connected)
+        flush(); // Rest noch an den Kernel geben (z. B. CONNACK vor dem Schließen)
+    closeSocket();
+    state = Closed;
+    if (link)
+    {
+        AsyncHostLink *l = link;
+        link = nullptr;
+        l->closed(this);
+    }
+    txBuffer.clear();
+    unacked = 0;
+    pendingError = 0;
+    bool release = hostServerOwned; // vor dem Callback lesen, der Client könnte darin gelöscht werden
+    if (release)
+        graveyard.push_back(this);
+    if (disconnectCb)
+        disconnectCb(disconnectArg, this);
+}
+
+int8_t AsyncClient::abort()
+{
+    close(true);
+    return -13; // ERR_ABRT
+}
+
+size_t AsyncClient::space() const
+{
+    if (state != Connected)
+        return 0;
+    size_t used = txBuffer.size() + unacked;
+    return used < sendBuffer ? sendBuffer - used : 0;
+}
+
+size_t AsyncClient::add(const char *data, size_t size, uint8_t apiflags)
+{
+    (void)apiflags; // immer kopieren
+    size_t room = space();
+    if (!data || size == 0 || room == 0)
+        return 0;
+    size_t n = size < room ? size : room;
+    txBuffer.append(data, n);
+    return n;
+}
+
+bool AsyncClient::send()
+{
+    if (state != Connected)
+        return false;
+    flush();
+    return pendingError == 0;
+}
+
+size_t AsyncClient::write(const char *data, size_t size, uint8_t apiflags)
+{
+    size_t n = add(data, size, apiflags);
+    if (n && !(apiflags & ASYNC_WRITE_FLAG_MORE))
+        send();
+    return n;
+}
+
+void AsyncClient::setNoDelay(bool nodelay)
+{
+    noDelay = nodelay;
+    if (fd >= 0)
+    {
+        int flag = nodelay ? 1 : 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+}
+
+void AsyncClient::flush()
+{
+    while (!txBuffer.empty() && pendingError == 0)
+    {
+        if (link)
+        {
+            size_t n = link->transmit(this, txBuffer.data(), txBuffer.size());
+            if (n == 0)
+                break;
+            txBuffer.erase(0, n);
+            unacked += n;
+            lastSend = millis();
+            continue;
+        }
+        ssize_t n = ::send(fd, txBuffer.data(), txBuffer.size(), MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            txBuffer.erase(0, n);
+            unacked += n;
+            lastSend = millis();
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            // Wie bei lwIP wird der Fehler asynchron gemeldet, nicht aus write() heraus
+            pendingError = (errno == ECONNRESET || errno == EPIPE) ? ERR_RST : ERR_CONN;
+        }
+    }
+    if (txBuffer.empty())
+        std::string().swap(txBuffer); // Kapazität freigeben: der Puffer gehört nicht zum Broker-Speicherbedarf
+    bool want = !txBuffer.empty() && pendingError == 0;
+    if (want != wantWrite)
+    {
+        wantWrite = want;
+        updateInterest();
+    }
+}
+
+void AsyncClient::updateInterest()
+{
+    if (fd < 0)
+        return;
+    epoll_event ev = {};
+    ev.events = EPOLLIN | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = static_cast<AsyncHostSocket *>(this);
+    epoll_ctl(hostEpoll(), EPOLL_CTL_MOD, fd, &ev);
+}
+
+void AsyncClient::fail(int8_t error)
+{
+    if (errorCb)
+        errorCb(errorArg, this, error);
+    close(true);
+}
+
+void AsyncClient::handleEvents(uint32_t events)
+{
+    if (state == Connecting)
+    {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0)
+        {
+            fail(ERR_CONN);
+            return;
+        }
+        if (!(events & EPOLLOUT))
+            return;
+        state = Connected;
+        readAddresses(); // Gegenstelle erst jetzt bekannt
+        wantWrite = false;
+        updateInterest();
+        if (connectCb)
+            connectCb(connectArg, this);
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    {
+        char buf[ASYNC_TCP_HOST_RX_CHUNK];
+        // Pro Durchlauf höchstens ein Empfangsfenster lesen: ein schneller Sender hungert die
+        // anderen Clients nicht aus, und ACKs/Sendewarteschlangen kommen dazwischen zum Zug
+        size_t received = 0;
+        while (received < ASYNC_TCP_HOST_RX_WINDOW && state == Connected)
+        {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n > 0)
+            {
+                received += n;
+                if (dataCb)
+                    dataCb(dataArg, this, buf, (size_t)n);
+                continue;
+            }
+            if (n == 0)
+            {
+                close(true); // Gegenstelle hat geschlossen
+                return;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                fail(errno == ECONNRESET ? ERR_RST : ERR_CONN);
+            break;
+        }
+    }
+
+    if (state == Connected && (events & EPOLLOUT))
+        flush();
+}
+
+void AsyncClient::hostDispatchDeferred(uint32_t now)
+{
+    if (state != Connected)
+        return;
+    if (pendingError)
+    {
+        fail(pendingError);
+        return;
+    }
+    if (link)
+    {
+        // ACKs schickt der Link; ein kurzer Schreibvorgang wird hier fortgesetzt
+        if (!txBuffer.empty())
+            flush();
+    }
+    else if (unacked > 0)
+    {
+        // Vom Kernel übernommene Bytes gelten als bestätigt
+        size_t len = unacked;
+        unacked = 0;
+        if (ackCb)
+            ackCb(ackArg, this, len, now - lastSend);
+        if (state != Connected)
+            return;
+    }
+    if (now - lastPoll >= ASYNC_TCP_HOST_POLL_MS)
+    {
+        lastPoll = now;
+        if (pollCb)
+            pollCb(pollArg, this);
+    }
+}
+
+void AsyncClient::hostLinkReceive(const char *data, size_t len)
+{
+    if (state == Connected && dataCb)
+        dataCb(dataArg, this, (void *)data, len);
+}
+
+void AsyncClient::hostLinkAck(size_t len, uint32_t rtt)
+{
+    if (state != Connected)
+        return;
+    unacked = len < unacked ? unacked - len : 0;
+    if (ackCb)
+        ackCb(ackArg, this, len, rtt);
+}
+
+void AsyncClient::hostLinkError(int8_t error)
+{
+    if (state == Connected && pendingError == 0)
+        pendingError = error;
+}
+
+void AsyncClient::onConnect(AcConnectHandler cb, void *arg)
+{
+    connectCb = cb;
+    connectArg = arg;
+}
+
+void AsyncClient::onDisconnect(AcConnectHandler cb, void *arg)
+{
+    disconnectCb = cb;
+    disconnectArg = arg;
+}
+
+void AsyncClient::onAck(AcAckHandler cb, void *arg)
+{
+    ackCb = cb;
+    ackArg = arg;
+}
+
+void AsyncClient::onError(AcErrorHandler cb, void *arg)
+{
+    errorCb = cb;
+    errorArg = arg;
+}
+
+void AsyncClient::onData(AcDataHandler cb, void *arg)
+{
+    dataCb = cb;
+    dataArg = arg;
+}
+
+void AsyncClient::onPoll(AcConnectHandler cb, void *arg)
+{
+    pollCb = cb;
+    pollArg = arg;
+}
+
+const char *AsyncClient::errorToString(int8_t error)
+{
+    switch (error)
+    {
+    case 0:
+        return "OK";
+    case ERR_CONN:
+        return "Not connected";
+    case ERR_RST:
+        return "Connection reset";
+    case ERR_CLSD:
+        return "Connection closed";
+    default:
+        return "Unknown error";
+    }
+}
+
+// ---------------- AsyncServer ----------------
+
+AsyncServer::AsyncServer(uint16_t port) : AsyncServer(IPAddress(0, 0, 0, 0), port)
+{
+}
+
+AsyncServer::AsyncServer(IPAddress addr, uint16_t port) : addr(addr), port(port)
+{
+    sockets.insert(this);
+    serverList.push_back(this);
+}
+
+AsyncServer::~AsyncServer()
+{
+    end();
+    sockets.erase(this);
+    serverList.erase(std::find(serverList.begin(), serverList.end(), this));
+}
+
+void AsyncServer::onClient(AcConnectHandler cb, void *arg)
+{
+    connectCb = cb;
+    connectArg = arg;
+}
+
+void AsyncServer::begin()
+{
+    if (fd >= 0)
+        return;
+    if (virtualNetwork)
+    {
+        virtualListen = true;
+        return;
+    }
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s < 0)
+    {
+        perror("AsyncServer: socket");
+        return;
+    }
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in sa = toSockaddr(addr, port);
+    if (bind(s, (sockaddr *)&sa, sizeof(sa)) < 0 || listen(s, SOMAXCONN) < 0)
+    {
+        perror("AsyncServer: bind/listen");
+        ::close(s);
+        return;
+    }
+    fd = s;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = static_cast<AsyncHostSocket *>(this);
+    epoll_ctl(hostEpoll(), EPOLL_CTL_ADD, fd, &ev);
+}
+
+void AsyncServer::end()
+{
+    virtualListen = false;
+    if (fd >= 0)
+    {
+        epoll_ctl(hostEpoll(), EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void AsyncServer::handleEvents(uint32_t)
+{
+    while (fd >= 0)
+    {
+        int c = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (c < 0)
+            break;
+        hostAccept(new AsyncClient(c));
+    }
+}
+
+void AsyncServer::hostAccept(AsyncClient *client)
+{
+    client->hostServerOwned = true;
+    client->setNoDelay(noDelay || client->getNoDelay());
+    if (connectCb && status())
+        connectCb(connectArg, client);
+    else
+        client->close(true);
+}
+
+// ---------------- Event-Schleife ----------------
+
+void asyncTcpHostDispatch(int timeoutMs)
+{
+    // Ausstehende ACKs/Fehler nicht durch Warten verzögern
+    for (AsyncClient *client : clientList)
+    {
+        if (client->hostHasDeferred())
+        {
+            timeoutMs = 0;
+            break;
+        }
+    }
+
+    epoll_event events[64];
+    int n = epoll_wait(hostEpoll(), events, 64, timeoutMs);
+    for (int i = 0; i < n; i++)
+    {
+        AsyncHostSocket *socket = static_cast<AsyncHostSocket *>(events[i].data.ptr);
+        if (sockets.count(socket))
+            socket->handleEvents(events[i].events);
+    }
+
+    asyncTcpHostRunDeferred();
+}
+
+void asyncTcpHostRunDeferred()
+{
+    uint32_t now = millis();
+    std::vector<AsyncClient *> snapshot(clientList);
+    for (AsyncClient *client : snapshot)
+    {
+        if (sockets.count(client))
+            client->hostDispatchDeferred(now);
+    }
+
+    for (AsyncClient *client : graveyard)
+        delete client;
+    graveyard.clear();
+}
+
+void asyncTcpHostSetVirtual(bool enabled)
+{
+    virtualNetwork = enabled;
+}
+
+AsyncServer *asyncTcpHostFindServer(uint16_t port)
+{
+    for (AsyncServer *server : serverList)
+    {
+        if (server->hostPort() == port && server->status())
+            return server;
+    }
+    return nullptr;
+}
@@ -0,0 +1,211 @@
+// Host-Ersatz für AsyncTCP (Linux, epoll).
+//
+// Gleiche Schnittstelle wie AsyncClient/AsyncServer auf dem ESP32, die Callbacks laufen aber
+// in hostLoopRunOnce() (HostLoop.h) im Thread des Aufrufers. Nachgebildet wird das Verhalten,
+// auf das sich der Broker verlässt:
+//  - add() kopiert in einen Sendepuffer begrenzter Größe, space() liefert den freien Platz
+//    (wie tcp_sndbuf(), Standard 5744 Bytes wie CONFIG_TCP_SND_BUF_DEFAULT);
+//  - Platz wird erst mit onAck() wieder frei, und onAck() kommt nie synchron aus write()/send();
+//  - onData() liefert höchstens ASYNC_TCP_HOST_RX_CHUNK Bytes je Aufruf (etwa ein TCP-Segment),
+//    je Durchlauf und Client höchstens ASYNC_TCP_HOST_RX_WINDOW Bytes (Empfangsfenster);
+//  - close() ruft onDisconnect() synchron auf, Sende- und Lesefehler erst im nächsten Durchlauf;
+//  - onPoll() etwa alle 500 ms.
+// Vom Server angenommene Clients gibt der Shim nach onDisconnect() selbst frei.
+//
+// Statt eines Sockets kann ein AsyncClient an einem AsyncHostLink hängen (Netzsimulation,
+// SimNet.h); mit asyncTcpHostSetVirtual(true) lauschen Server dann nur noch auf solche Verbindungen.
+#ifndef HOST_ASYNC_TCP_H
+#define HOST_ASYNC_TCP_H
+
+#include "Arduino.h"
+
+#include <functional>
+#include <string>
+
+#ifndef ASYNC_TCP_HOST_SNDBUF
+#define ASYNC_TCP_HOST_SNDBUF 5744
+#endif
+#ifndef ASYNC_TCP_HOST_RX_CHUNK
+#define ASYNC_TCP_HOST_RX_CHUNK 1436
+#endif
+#ifndef ASYNC_TCP_HOST_RX_WINDOW
+#define ASYNC_TCP_HOST_RX_WINDOW 5744 // Bytes je Client und Durchlauf (wie CONFIG_TCP_WND_DEFAULT)
+#endif
+#ifndef ASYNC_TCP_HOST_POLL_MS
+#define ASYNC_TCP_HOST_POLL_MS 500
+#endif
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+// lwIP-Fehlercodes für onError()
+#define ERR_CONN -11
+#define ERR_RST -14
+#define ERR_CLSD -15
+
+class AsyncClient;
+
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void *, AsyncClient *, int8_t error)> AcErrorHandler;
+typedef std::function<void(void *, AsyncClient *, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, uint32_t time)> AcTimeoutHandler;
+
+/// Ersatz für den Socket eines AsyncClient (z. B. SimNet)
+class AsyncHostLink
+{
+public:
+    virtual ~AsyncHostLink() {}
+    /// Bytes aus dem Sendepuffer übernehmen; weniger als len = kurzer Schreibvorgang, Rest folgt später
+    virtual size_t transmit(AsyncClient *client, const char *data, size_t len) = 0;
+    /// Der Client wurde geschlossen und darf danach nicht mehr verwendet werden
+    virtual void closed(AsyncClient *client) = 0;
+};
+
+/// Gemeinsame Basis der im epoll registrierten Objekte (intern)
+class AsyncHostSocket
+{
+public:
+    virtual ~AsyncHostSocket() {}
+    virtual void handleEvents(uint32_t events) = 0;
+
+protected:
+    int fd = -1;
+};
+
+class AsyncClient : public AsyncHostSocket
+{
+public:
+    AsyncClient();
+    explicit AsyncClient(int socketFd); ///< bereits verbundener Socket (vom Server)
+    AsyncClient(AsyncHostLink *link, IPAddress remote, uint16_t remotePort); ///< verbunden über einen Link
+    ~AsyncClient();
+
+    bool connect(IPAddress ip, uint16_t port);
+    bool connect(const char *host, uint16_t port);
+    void close(bool now = false);
+    void stop() { close(false); }
+    int8_t abort();
+
+    bool connected() const { return state == Connected; }
+    bool connecting() const { return state == Connecting; }
+    bool disconnected() const { return state == Closed; }
+    bool freeable() const { return state == Closed; }
+
+    size_t add(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    bool send();
+    bool canSend() const { return space() > 0; }
+    size_t space() const;
+    size_t write(const char *data) { return write(data, strlen(data)); }
+    size_t write(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
+    void setNoDelay(bool nodelay);
+    bool getNoDelay() const { return noDelay; }
+    void setRxTimeout(uint32_t) {}
+    void setAckTimeout(uint32_t) {}
+
+    IPAddress remoteIP() const { return remoteAddr; }
+    uint16_t remotePort() const { return remotePortNumber; }
+    IPAddress localIP() const { return localAddr; }
+    uint16_t localPort() const { return localPortNumber; }
+
+    void onConnect(AcConnectHandler cb, void *arg = nullptr);
+    void onDisconnect(AcConnectHandler cb, void *arg = nullptr);
+    void onAck(AcAckHandler cb, void *arg = nullptr);
+    void onError(AcErrorHandler cb, void *arg = nullptr);
+    void onData(AcDataHandler cb, void *arg = nullptr);
+    void onTimeout(AcTimeoutHandler, void * = nullptr) {}
+    void onPoll(AcConnectHandler cb, void *arg = nullptr);
+
+    static const char *errorToString(int8_t error);
+
+    void handleEvents(uint32_t events) override;
+
+    // --- intern, für die Event-Schleife ---
+    void hostDispatchDeferred(uint32_t now); ///< ACKs, Fehler und Poll nachholen
+    bool hostHasDeferred() const { return state == Connected && ((unacked > 0 && !link) || pendingError != 0); }
+    bool hostServerOwned = false;            ///< vom Server angelegt: nach onDisconnect freigeben
+
+    // --- intern, für AsyncHostLink ---
+    void hostSetSendBuffer(size_t size) { sendBuffer = size; } ///< Größe für space()
+    void hostLinkReceive(const char *data, size_t len);        ///< Daten der Gegenstelle zustellen (onData)
+    void hostLinkAck(size_t len, uint32_t rtt);                ///< übertragene Bytes bestätigen (onAck)
+    void hostLinkError(int8_t error);                          ///< Abbruch, im nächsten Durchlauf onError + Schließen
+    void hostLinkClosed() { close(true); }                     ///< Gegenstelle hat geschlossen
+
+private:
+    enum State
+    {
+        Closed,
+        Connecting,
+        Connected
+    };
+
+    void attach(int socketFd);
+    void readAddresses();
+    void flush();
+    void updateInterest();
+    void fail(int8_t error);
+    void closeSocket();
+
+    State state = Closed;
+    bool noDelay = false;
+    bool wantWrite = false;
+    AsyncHostLink *link = nullptr;
+    size_t sendBuffer = ASYNC_TCP_HOST_SNDBUF;
+    std::string txBuffer;    ///< angenommen, aber noch nicht an den Kernel übergeben
+    size_t unacked = 0;      ///< an den Kernel übergeben, onAck() steht noch aus
+    int8_t pendingError = 0; ///< Fehler, der im nächsten Durchlauf zum Schließen führt
+    uint32_t lastPoll = 0;
+    uint32_t lastSend = 0;
+
+    IPAddress remoteAddr, localAddr;
+    uint16_t remotePortNumber = 0, localPortNumber = 0;
+
+    AcConnectHandler connectCb, disconnectCb, pollCb;
+    AcAckHandler ackCb;
+    AcErrorHandler errorCb;
+    AcDataHandler dataCb;
+    void *connectArg = nullptr, *disconnectArg = nullptr, *pollArg = nullptr, *ackArg = nullptr, *errorArg = nullptr, *dataArg = nullptr;
+};
+
+class AsyncServer : public AsyncHostSocket
+{
+public:
+    explicit AsyncServer(uint16_t port);
+    AsyncServer(IPAddress addr, uint16_t port);
+    ~AsyncServer();
+
+    void onClient(AcConnectHandler cb, void *arg);
+    void begin();
+    void end();
+    void setNoDelay(bool nodelay) { noDelay = nodelay; }
+    bool getNoDelay() const { return noDelay; }
+    uint8_t status() const { return fd >= 0 || virtualListen ? 1 : 0; }
+
+    void handleEvents(uint32_t events) override;
+    void hostAccept(AsyncClient *client); ///< neuen Client übergeben (intern, auch für SimNet)
+    uint16_t hostPort() const { return port; }
+
+private:
+    IPAddress addr;
+    uint16_t port;
+    bool noDelay = false;
+    bool virtualListen = false; ///< lauscht nur auf simulierte Verbindungen
+    AcConnectHandler connectCb;
+    void *connectArg = nullptr;
+};
+
+/// epoll abfragen (höchstens timeoutMs warten) und alle AsyncTCP-Callbacks ausführen
+void asyncTcpHostDispatch(int timeoutMs);
+
+/// Nur die nachgeholten Callbacks (ACKs, Fehler, Poll) ausführen und geschlossene Server-Clients freigeben
+void asyncTcpHostRunDeferred();
+
+/// true: AsyncServer::begin() öffnet keinen Socket, Verbindungen kommen nur über hostAccept()
+void asyncTcpHostSetVirtual(bool enabled);
+
+/// Lauschenden Server für einen Port suchen (nullptr, wenn keiner)
+AsyncServer *asyncTcpHostFindServer(uint16_t port);
+
+#endif // HOST_ASYNC_TCP_H
@@ -0,0 +1,106 @@
+#include "HostHeap.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+struct BlockHeader
+{
+    uint32_t offset;  ///< Abstand vom Beginn der malloc-Allokation zum Nutzbereich
+    uint32_t counted; ///< 1 = in den Statistiken enthalten
+    size_t size;      ///< angeforderte Bytes
+};
+
+static_assert(sizeof(BlockHeader) == 16, "Kopf muss 16 Bytes haben (Ausrichtung)");
+
+HostHeapStats stats = {0, 0, 0, 0};
+int uncountedDepth = 0;
+
+void *allocate(size_t size, size_t align)
+{
+    size_t offset = align > sizeof(BlockHeader) ? align : sizeof(BlockHeader);
+    char *raw;
+    if (align > sizeof(BlockHeader))
+        raw = (char *)aligned_alloc(align, (offset + size + align - 1) / align * align);
+    else
+        raw = (char *)malloc(offset + size);
+    if (!raw)
+        throw std::bad_alloc();
+
+    BlockHeader *header = (BlockHeader *)(raw + offset - sizeof(BlockHeader));
+    header->offset = (uint32_t)offset;
+    header->counted = uncountedDepth == 0;
+    header->size = size;
+    if (header->counted)
+    {
+        stats.liveBytes += size;
+        stats.liveBlocks++;
+        stats.allocations++;
+        if (stats.liveBytes > stats.peakBytes)
+            stats.peakBytes = stats.liveBytes;
+    }
+    return raw + offset;
+}
+
+void release(void *p)
+{
+    if (!p)
+        return;
+    BlockHeader *header = (BlockHeader *)((char *)p - sizeof(BlockHeader));
+    if (header->counted)
+    {
+        stats.liveBytes -= header->size;
+        stats.liveBlocks--;
+    }
+    free((char *)p - header->offset);
+}
+} // namespace
+
+const HostHeapStats &hostHeapStats()
+{
+    return stats;
+}
+
+void hostHeapResetPeak()
+{
+    stats.peakBytes = stats.liveBytes;
+}
+
+HostHeapUncounted::HostHeapUncounted()
+{
+    uncountedDepth++;
+}
+
+HostHeapUncounted::~HostHeapUncounted()
+{
+    uncountedDepth--;
+}
+
+void *operator new(size_t size) { return allocate(size, 0); }
+void *operator new[](size_t size) { return allocate(size, 0); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return allocate(size, 0);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+void *operator new(size_t size, std::align_val_t align) { return allocate(size, (size_t)align); }
+void *operator new[](size_t size, std::align_val_t align) { return allocate(size, (size_t)align); }
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { release(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { release(p); }
+void operator delete(void *p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { release(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { release(p); }
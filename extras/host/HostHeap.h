@@ -0,0 +1,32 @@
+// Heap-Zählung für Host-Benchmarks: ersetzt das globale operator new/delete.
+// Nur in Programme linken, die es auswerten (HostHeap.cpp), nicht in mqtt_broker_host.
+//
+// Jeder Block trägt einen kleinen Kopf mit angeforderter Größe und der Angabe, ob er gezählt
+// wird. Blöcke, die innerhalb eines HostHeapUncounted-Bereichs angelegt werden (z. B. vom
+// Lastgenerator selbst), bleiben auch bei der Freigabe außen vor.
+//
+// Gezählt werden die angeforderten Bytes ohne Verwaltungsaufwand des Allokators.
+#ifndef HOST_HEAP_H
+#define HOST_HEAP_H
+
+#include <cstddef>
+
+struct HostHeapStats
+{
+    size_t liveBytes;   ///< belegte Bytes gezählter Blöcke
+    size_t liveBlocks;  ///< belegte gezählte Blöcke
+    size_t peakBytes;   ///< Höchststand von liveBytes seit Start bzw. hostHeapResetPeak()
+    size_t allocations; ///< Anzahl gezählter Allokationen insgesamt
+};
+
+const HostHeapStats &hostHeapStats();
+void hostHeapResetPeak();
+
+/// Allokationen in diesem Bereich nicht zählen (verschachtelbar)
+struct HostHeapUncounted
+{
+    HostHeapUncounted();
+    ~HostHeapUncounted();
+};
+
+#endif // HOST_HEAP_H
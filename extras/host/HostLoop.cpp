@@ -0,0 +1,14 @@
+#include "HostLoop.h"
+#include "AsyncTCP.h"
+#include "esp_timer.h"
+
+void hostLoopRunOnce(int maxWaitMs)
+{
+    int64_t timerDelayUs = espTimerHostNextDelayUs();
+    int waitMs = maxWaitMs;
+    if (timerDelayUs >= 0 && (timerDelayUs + 999) / 1000 < waitMs)
+        waitMs = (int)((timerDelayUs + 999) / 1000);
+
+    asyncTcpHostDispatch(waitMs);
+    espTimerHostDispatch();
+}
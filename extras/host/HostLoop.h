@@ -0,0 +1,9 @@
+// Event-Schleife des Host-Builds: ersetzt die AsyncTCP- und esp_timer-Tasks des ESP32.
+#ifndef HOST_LOOP_H
+#define HOST_LOOP_H
+
+/// Einen Durchlauf ausführen: auf Sockets warten (höchstens maxWaitMs bzw. bis zum nächsten
+/// fälligen esp_timer), dann alle AsyncTCP-Callbacks und fälligen Timer ausführen.
+void hostLoopRunOnce(int maxWaitMs);
+
+#endif // HOST_LOOP_H
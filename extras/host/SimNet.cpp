@@ -0,0 +1,321 @@
+#include "SimNet.h"
+#include "esp_timer.h"
+
+#include <algorithm>
+
+// ---------------- SimPeer ----------------
+
+void SimPeer::send(const std::string &data)
+{
+    if (open && !data.empty())
+        net.enqueue(this, true, data.data(), data.size());
+}
+
+void SimPeer::close()
+{
+    if (!open)
+        return;
+    open = false;
+    // FIN nach den bereits gesendeten Segmenten
+    int64_t t = std::max(net.now() + net.latency(), lastToBroker);
+    lastToBroker = t;
+    net.at(t, [this]
+           {
+        if (client)
+            client->hostLinkClosed(); });
+}
+
+void SimPeer::reset()
+{
+    if (open)
+        net.abort(this);
+}
+
+void SimPeer::setStalled(bool value)
+{
+    if (stalled == value)
+        return;
+    stalled = value;
+    if (stalled)
+        return;
+    if (!held.empty())
+    {
+        std::string data;
+        data.swap(held);
+        net.deliverToPeer(this, data);
+    }
+    if (finPending)
+    {
+        finPending = false;
+        net.finish(this);
+    }
+}
+
+// ---------------- SimNet ----------------
+
+SimNet::SimNet(uint64_t seed, const SimNetConfig &config) : cfg(config), rngState(seed ? seed : 0x9E3779B97F4A7C15ULL)
+{
+    if (cfg.latencyMaxUs < cfg.latencyMinUs)
+        cfg.latencyMaxUs = cfg.latencyMinUs;
+    if (cfg.segmentSize == 0)
+        cfg.segmentSize = 1;
+    if (cfg.loopIntervalUs == 0)
+        cfg.loopIntervalUs = 1;
+    espTimerHostUseVirtualClock(cfg.startUs);
+    asyncTcpHostSetVirtual(true);
+}
+
+SimNet::~SimNet()
+{
+    // Nach closeAll() ist nichts mehr offen; übrig gebliebene Clients ohne Callbacks freigeben,
+    // der Broker existiert zu diesem Zeitpunkt womöglich nicht mehr
+    for (auto &entry : byClient)
+    {
+        entry.second->client = nullptr;
+        delete entry.first;
+    }
+    byClient.clear();
+    asyncTcpHostRunDeferred();
+    asyncTcpHostSetVirtual(false);
+}
+
+int64_t SimNet::now() const
+{
+    return esp_timer_get_time();
+}
+
+uint64_t SimNet::random()
+{
+    // xorshift64: klein, schnell und auf allen Plattformen gleich
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+uint32_t SimNet::latency()
+{
+    return cfg.latencyMinUs + (uint32_t)below((uint64_t)cfg.latencyMaxUs - cfg.latencyMinUs + 1);
+}
+
+void SimNet::at(int64_t timeUs, std::function<void()> fn)
+{
+    queue.push(Event{timeUs, nextSeq++, std::move(fn)});
+}
+
+SimPeer *SimNet::connect(uint16_t port, IPAddress remote)
+{
+    if (!asyncTcpHostFindServer(port))
+        return nullptr;
+    uint32_t id = (uint32_t)peers.size() + 1;
+    peers.emplace_back(new SimPeer(*this, id));
+    SimPeer *peer = peers.back().get();
+
+    // Der Server nimmt die Verbindung nach einer Einweg-Latenz an, vor den ersten Daten
+    int64_t t = now() + latency();
+    peer->lastToBroker = t;
+    at(t, [this, peer, port, remote, id]
+       {
+        AsyncServer *server = asyncTcpHostFindServer(port);
+        if (!peer->open || !server)
+        {
+            abort(peer, true);
+            return;
+        }
+        AsyncClient *client = new AsyncClient(this, remote, (uint16_t)(40000 + id));
+        client->hostSetSendBuffer(cfg.sendBuffer);
+        peer->client = client;
+        byClient[client] = peer;
+        server->hostAccept(client); });
+    return peer;
+}
+
+size_t SimNet::transmit(AsyncClient *client, const char *data, size_t len)
+{
+    auto it = byClient.find(client);
+    if (it == byClient.end() || !it->second->open)
+        return len; // Gegenstelle weg: Daten gehen verloren, der Fehler folgt
+    size_t n = len;
+    if (len > 1 && unit() < cfg.shortWriteProbability)
+    {
+        n = 1 + (size_t)below(len - 1);
+        shortWriteCount++;
+    }
+    enqueue(it->second, false, data, n);
+    return n;
+}
+
+void SimNet::closed(AsyncClient *client)
+{
+    auto it = byClient.find(client);
+    if (it == byClient.end())
+        return;
+    SimPeer *peer = it->second;
+    byClient.erase(it);
+    peer->client = nullptr;
+    if (!peer->open)
+        return;
+    // FIN nach den bereits übertragenen Segmenten
+    int64_t t = std::max(now() + latency(), peer->lastToPeer);
+    peer->lastToPeer = t;
+    at(t, [this, peer]
+       { finish(peer); });
+}
+
+void SimNet::enqueue(SimPeer *peer, bool toBroker, const char *data, size_t len)
+{
+    std::deque<SimPeer::Segment> &q = toBroker ? peer->toBroker : peer->toPeer;
+    int64_t &last = toBroker ? peer->lastToBroker : peer->lastToPeer;
+    size_t offset = 0;
+    while (offset < len)
+    {
+        size_t n = std::min(cfg.segmentSize, len - offset);
+        if (n > 1 && unit() < cfg.splitProbability)
+            n = 1 + (size_t)below(n - 1);
+        if (!q.empty() && q.back().data.size() + n <= cfg.segmentSize && unit() < cfg.coalesceProbability)
+        {
+            q.back().data.append(data + offset, n);
+        }
+        else
+        {
+            int64_t arrival = std::max(now() + latency(), last);
+            last = arrival;
+            q.push_back(SimPeer::Segment{arrival, std::string(data + offset, n)});
+            at(arrival, [this, peer, toBroker]
+               { deliver(peer, toBroker); });
+        }
+        offset += n;
+    }
+}
+
+void SimNet::deliver(SimPeer *peer, bool toBroker)
+{
+    std::deque<SimPeer::Segment> &q = toBroker ? peer->toBroker : peer->toPeer;
+    if (q.empty() || q.front().arrival > now())
+        return;
+    std::string data;
+    data.swap(q.front().data);
+    q.pop_front();
+    mix(peer, toBroker, data);
+
+    if (unit() < cfg.resetProbability)
+    {
+        abort(peer, true);
+        return;
+    }
+    if (!toBroker)
+        deliverToPeer(peer, data);
+    else if (peer->client)
+        peer->client->hostLinkReceive(data.data(), data.size());
+}
+
+void SimNet::deliverToPeer(SimPeer *peer, const std::string &data)
+{
+    if (!peer->open)
+        return;
+    if (peer->stalled)
+    {
+        peer->held += data; // Empfangsfenster zu: keine ACKs
+        return;
+    }
+    peer->inbox += data;
+    size_t len = data.size();
+    int64_t sent = now();
+    after(latency(), [this, peer, len, sent]
+          {
+        if (peer->client)
+            peer->client->hostLinkAck(len, (uint32_t)((now() - sent) / 1000)); });
+    if (peer->onData)
+        peer->onData(peer);
+}
+
+void SimNet::finish(SimPeer *peer)
+{
+    if (!peer->open)
+        return;
+    if (peer->stalled)
+    {
+        peer->finPending = true;
+        return;
+    }
+    peer->open = false;
+    if (peer->onClose)
+        peer->onClose(peer);
+}
+
+void SimNet::abort(SimPeer *peer, bool notify)
+{
+    bool wasOpen = peer->open;
+    peer->open = false;
+    peer->toBroker.clear();
+    peer->toPeer.clear();
+    peer->held.clear();
+    peer->finPending = false;
+    resetCount++;
+    if (peer->client)
+        peer->client->hostLinkError(ERR_RST);
+    if (notify && wasOpen && peer->onClose)
+        peer->onClose(peer);
+}
+
+void SimNet::mix(SimPeer *peer, bool toBroker, const std::string &data)
+{
+    // FNV-1a über Zeit, Verbindung, Richtung und Inhalt
+    auto add = [this](const void *p, size_t n)
+    {
+        const uint8_t *b = (const uint8_t *)p;
+        for (size_t i = 0; i < n; i++)
+            digestValue = (digestValue ^ b[i]) * 1099511628211ULL;
+    };
+    int64_t t = now();
+    uint32_t id = peer->peerId;
+    uint8_t dir = toBroker ? 1 : 0;
+    add(&t, sizeof(t));
+    add(&id, sizeof(id));
+    add(&dir, 1);
+    add(data.data(), data.size());
+}
+
+void SimNet::runUntil(int64_t untilUs, const std::function<void()> &loop)
+{
+    for (;;)
+    {
+        int64_t t = now();
+        int64_t next = t + cfg.loopIntervalUs;
+        if (!queue.empty() && queue.top().time < next)
+            next = queue.top().time;
+        int64_t timerDelay = espTimerHostNextDelayUs();
+        if (timerDelay >= 0 && t + timerDelay < next)
+            next = t + timerDelay;
+        if (next > untilUs)
+            break;
+        espTimerHostSetTime(next);
+
+        while (!queue.empty() && queue.top().time <= now())
+        {
+            Event e = std::move(const_cast<Event &>(queue.top()));
+            queue.pop();
+            eventCount++;
+            e.fn();
+        }
+        asyncTcpHostRunDeferred();
+        espTimerHostDispatch();
+        if (loop)
+            loop();
+    }
+    espTimerHostSetTime(untilUs);
+}
+
+void SimNet::closeAll(const std::function<void()> &loop)
+{
+    for (auto &peer : peers)
+    {
+        peer->setStalled(false);
+        peer->close();
+    }
+    // Bis der Broker alle Verbindungen abgebaut hat (höchstens 60 s virtuelle Zeit)
+    int64_t deadline = now() + 60000000;
+    while (!byClient.empty() && now() < deadline)
+        runFor(10000, loop);
+    asyncTcpHostRunDeferred();
+}
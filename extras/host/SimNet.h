@@ -0,0 +1,162 @@
+// Deterministische Netz- und Zeitsimulation für den Host-Build.
+//
+// SimNet ersetzt Sockets und Uhr: Verbindungen zum Broker sind AsyncClients an einem
+// AsyncHostLink, millis()/esp_timer laufen auf einer virtuellen Uhr, und ein Scheduler führt
+// Segmentzustellung, ACKs, esp_timer und loop() in fester Reihenfolge aus. Aller Zufall
+// (Latenz, Segmentgrenzen, kurze Schreibvorgänge, Abbrüche) kommt aus dem Seed: gleicher Seed
+// und gleiche Eingaben ergeben denselben Ablauf (siehe digest()), unabhängig von der Rechnerlast.
+//
+// Gestört werden kann:
+//  - Latenz je Segment (gleichverteilt, die Reihenfolge je Richtung bleibt erhalten),
+//  - Segmentierung: Daten werden an zufälligen Stellen geteilt bzw. mit noch nicht zugestellten
+//    Segmenten zusammengefasst,
+//  - kurze Schreibvorgänge: der Link übernimmt nur einen Teil, der Rest bleibt im Sendepuffer,
+//  - space(): Größe des Sendepuffers, Gegenstellen, die zeitweise nicht lesen (setStalled()),
+//  - Verbindungsabbrüche (Reset) mit einer Wahrscheinlichkeit je Segment.
+//
+// Verwendung (eine SimNet je Prozess, vor broker.begin() anlegen):
+//   SimNet net(seed, config);
+//   broker.begin();
+//   SimPeer *peer = net.connect(1883);  // Gegenstelle eines neuen Broker-Clients
+//   peer->send(connectPacket);
+//   net.runFor(5000000, [&] { broker.loop(); });
+//   net.closeAll([&] { broker.loop(); }); // vor dem Abbau des Brokers
+#ifndef HOST_SIM_NET_H
+#define HOST_SIM_NET_H
+
+#include "AsyncTCP.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SimNetConfig
+{
+    uint32_t latencyMinUs = 1000;  ///< Einweg-Latenz je Segment
+    uint32_t latencyMaxUs = 5000;
+    size_t segmentSize = 1436;     ///< größtes Segment (MSS)
+    double splitProbability = 0;   ///< Segment an zufälliger Stelle teilen
+    double coalesceProbability = 0; ///< mit dem letzten noch nicht zugestellten Segment zusammenfassen
+    double shortWriteProbability = 0; ///< transmit() übernimmt nur einen zufälligen Teil
+    double resetProbability = 0;   ///< Verbindungsabbruch je zugestelltem Segment
+    size_t sendBuffer = ASYNC_TCP_HOST_SNDBUF; ///< space() der Broker-Clients
+    uint32_t loopIntervalUs = 1000; ///< höchster Abstand zwischen zwei loop()-Aufrufen
+    int64_t startUs = 0;           ///< Startwert der virtuellen Uhr
+};
+
+class SimNet;
+
+/// Gegenstelle einer simulierten Verbindung (Sicht des MQTT-Clients)
+class SimPeer
+{
+public:
+    /// Bytes an den Broker senden
+    void send(const std::string &data);
+    /// Geordnet schließen: der Broker sieht das Ende nach den bereits gesendeten Daten
+    void close();
+    /// Verbindung abbrechen (Broker: onError(ERR_RST))
+    void reset();
+    /// true: liest nicht mehr (keine ACKs, der Sendepuffer des Brokers läuft voll)
+    void setStalled(bool stalled);
+
+    bool connected() const { return open; }
+    uint32_t id() const { return peerId; }
+
+    std::string inbox;                      ///< empfangene Bytes; der Aufrufer entnimmt sie
+    std::function<void(SimPeer *)> onData;  ///< nach jedem Empfang
+    std::function<void(SimPeer *)> onClose; ///< vom Broker geschlossen oder zufällig abgebrochen
+
+private:
+    friend class SimNet;
+
+    struct Segment
+    {
+        int64_t arrival;
+        std::string data;
+    };
+
+    SimPeer(SimNet &net, uint32_t id) : net(net), peerId(id) {}
+
+    SimNet &net;
+    uint32_t peerId;
+    AsyncClient *client = nullptr; ///< Broker-Seite, nullptr nach dem Schließen
+    bool open = true;
+    bool stalled = false;
+    bool finPending = false;        ///< Broker hat geschlossen, während die Gegenstelle nicht las
+    std::deque<Segment> toBroker, toPeer;
+    int64_t lastToBroker = 0, lastToPeer = 0; ///< Ankunft des letzten Segments je Richtung
+    std::string held;               ///< während setStalled(true) angekommene Bytes
+};
+
+class SimNet : public AsyncHostLink
+{
+public:
+    SimNet(uint64_t seed, const SimNetConfig &config = SimNetConfig());
+    ~SimNet();
+
+    /// Neue Verbindung zum Server auf port; nullptr, wenn keiner lauscht
+    SimPeer *connect(uint16_t port, IPAddress remote = IPAddress(10, 0, 0, 2));
+
+    /// Aufgabe zur virtuellen Zeit timeUs bzw. nach delayUs ausführen
+    void at(int64_t timeUs, std::function<void()> fn);
+    void after(int64_t delayUs, std::function<void()> fn) { at(now() + delayUs, std::move(fn)); }
+
+    /// Simulation bis zur virtuellen Zeit untilUs ausführen; loop läuft nach jedem Schritt
+    /// (höchstens loopIntervalUs auseinander), typischerweise broker.loop()
+    void runUntil(int64_t untilUs, const std::function<void()> &loop = nullptr);
+    void runFor(int64_t durationUs, const std::function<void()> &loop = nullptr) { runUntil(now() + durationUs, loop); }
+
+    /// Alle offenen Verbindungen schließen und die Simulation laufen lassen, bis der Broker sie abgebaut hat
+    void closeAll(const std::function<void()> &loop = nullptr);
+
+    int64_t now() const;
+    uint64_t random();              ///< nächste Zufallszahl aus dem Seed
+    uint64_t below(uint64_t n) { return n ? random() % n : 0; }
+    double unit() { return (random() >> 11) * (1.0 / 9007199254740992.0); }
+
+    /// Prüfsumme über alle Zustellungen (Zeit, Verbindung, Richtung, Bytes): gleicher Seed, gleicher Wert
+    uint64_t digest() const { return digestValue; }
+    uint64_t events() const { return eventCount; }
+    uint64_t resets() const { return resetCount; }
+    uint64_t shortWrites() const { return shortWriteCount; }
+
+    const SimNetConfig &config() const { return cfg; }
+
+    // AsyncHostLink
+    size_t transmit(AsyncClient *client, const char *data, size_t len) override;
+    void closed(AsyncClient *client) override;
+
+private:
+    friend class SimPeer;
+
+    struct Event
+    {
+        int64_t time;
+        uint64_t seq; ///< gleiche Zeit: Reihenfolge des Einplanens
+        std::function<void()> fn;
+        bool operator>(const Event &other) const { return time != other.time ? time > other.time : seq > other.seq; }
+    };
+
+    uint32_t latency();
+    void enqueue(SimPeer *peer, bool toBroker, const char *data, size_t len);
+    void deliver(SimPeer *peer, bool toBroker);
+    void deliverToPeer(SimPeer *peer, const std::string &data);
+    void finish(SimPeer *peer);
+    void abort(SimPeer *peer, bool notify = false);
+    void mix(SimPeer *peer, bool toBroker, const std::string &data);
+
+    SimNetConfig cfg;
+    uint64_t rngState;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue;
+    uint64_t nextSeq = 0;
+    std::vector<std::unique_ptr<SimPeer>> peers;
+    std::unordered_map<AsyncClient *, SimPeer *> byClient;
+    uint64_t digestValue = 1469598103934665603ULL;
+    uint64_t eventCount = 0, resetCount = 0, shortWriteCount = 0;
+};
+
+#endif // HOST_SIM_NET_H
@@ -0,0 +1,169 @@
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t due = 0;    ///< nächste Fälligkeit in µs (esp_timer_get_time())
+    int64_t period = 0; ///< 0 = einmalig
+    bool active = false;
+    bool deleted = false;
+};
+
+static std::vector<esp_timer *> timers;
+static bool dispatching = false;
+static bool virtualClock = false;
+static int64_t virtualNow = 0;
+
+int64_t esp_timer_get_time()
+{
+    if (virtualClock)
+        return virtualNow;
+    // Funktionslokal, damit auch Aufrufe aus statischen Konstruktoren eine gültige Basis haben
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    if (!args || !args->callback || !out_handle)
+        return ESP_ERR_INVALID_ARG;
+    esp_timer *timer = new esp_timer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->name = args->name;
+    timers.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (!timer || timer->deleted)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->due = esp_timer_get_time() + (int64_t)timeout_us;
+    timer->period = (int64_t)period_us;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (period_us == 0)
+        return ESP_ERR_INVALID_ARG;
+    return start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer || timer->deleted)
+        return ESP_ERR_INVALID_ARG;
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (!timer || timer->deleted)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->deleted = true;
+    // Während der Ausführung nur markieren, espTimerHostDispatch() räumt danach auf
+    if (!dispatching)
+    {
+        timers.erase(std::find(timers.begin(), timers.end(), timer));
+        delete timer;
+    }
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer && timer->active;
+}
+
+void espTimerHostDispatch()
+{
+    int64_t now = esp_timer_get_time();
+    dispatching = true;
+    // Per Index: Callbacks dürfen neue Timer anlegen (push_back)
+    for (size_t i = 0; i < timers.size(); i++)
+    {
+        esp_timer *timer = timers[i];
+        if (!timer->active || timer->deleted || timer->due > now)
+            continue;
+        if (timer->period > 0)
+        {
+            // Verpasste Perioden nicht nachholen (wie skip_unhandled_events)
+            timer->due += timer->period;
+            if (timer->due <= now)
+                timer->due = now + timer->period;
+        }
+        else
+        {
+            timer->active = false;
+        }
+        timer->callback(timer->arg);
+    }
+    dispatching = false;
+
+    for (auto it = timers.begin(); it != timers.end();)
+    {
+        if ((*it)->deleted)
+        {
+            delete *it;
+            it = timers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+int64_t espTimerHostNextDelayUs()
+{
+    int64_t next = -1;
+    int64_t now = esp_timer_get_time();
+    for (const esp_timer *timer : timers)
+    {
+        if (!timer->active || timer->deleted)
+            continue;
+        int64_t delay = timer->due > now ? timer->due - now : 0;
+        if (next < 0 || delay < next)
+            next = delay;
+    }
+    return next;
+}
+
+void espTimerHostUseVirtualClock(int64_t nowUs)
+{
+    virtualNow = nowUs;
+    virtualClock = true;
+}
+
+bool espTimerHostVirtualClock()
+{
+    return virtualClock;
+}
+
+void espTimerHostSetTime(int64_t nowUs)
+{
+    if (nowUs > virtualNow)
+        virtualNow = nowUs;
+}
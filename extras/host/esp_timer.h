@@ -0,0 +1,59 @@
+// Host-Ersatz für esp_timer (Linux).
+// Die Callbacks laufen nicht in einer eigenen Task, sondern in hostLoopRunOnce() (HostLoop.h),
+// also im selben Thread wie die AsyncTCP-Callbacks und loop().
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <cstdint>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum
+{
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+bool esp_timer_is_active(esp_timer_handle_t timer);
+
+/// Mikrosekunden seit Programmstart (monoton)
+int64_t esp_timer_get_time();
+
+// --- Nur Host: Anbindung an die Event-Schleife ---
+
+/// Fällige Timer ausführen
+void espTimerHostDispatch();
+
+/// Mikrosekunden bis zum nächsten fälligen Timer, -1 wenn keiner aktiv ist
+int64_t espTimerHostNextDelayUs();
+
+/// Auf eine virtuelle Uhr umschalten (Simulation, SimNet.h): esp_timer_get_time() und damit
+/// millis()/micros() liefern ab jetzt nowUs und ändern sich nur noch über espTimerHostSetTime()
+void espTimerHostUseVirtualClock(int64_t nowUs);
+bool espTimerHostVirtualClock();
+
+/// Virtuelle Uhr stellen (nur vorwärts, kleinere Werte werden ignoriert)
+void espTimerHostSetTime(int64_t nowUs);
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,305 @@
+// Speicherbedarf des Brokers je Objekt (Host-Build).
+//
+// Misst über die Heap-Zählung (HostHeap.h) die zusätzlich belegten Bytes und Heap-Blöcke je
+//  - Verbindung (CONNECT, Clean Session, Keep-Alive 60: MQTTClient, Client-Info, Timer-Eintrag),
+//  - Abonnement mit eigenem Filter bzw. mit einem von allen geteilten Filter,
+//  - Retained Topic (32 Bytes Payload),
+//  - unbestätigter ausgehender QoS-1-Nachricht (32 Bytes Payload, ein Abonnent, inkl. Frame),
+//  - eingehender QoS-2-Nachricht, die auf PUBREL wartet (höchstens MQTT_MAX_INCOMING_QOS2),
+// jeweils für mehrere Anzahlen mit einem frischen Broker je Anzahl. "Allok./St." zählt zusätzlich
+// alle Allokationen während des Vorgangs, also auch sofort wieder freigegebene.
+//
+// Bauen und starten (aus extras/host):
+//   make mqtt_footprint
+//   ./mqtt_footprint [10 100 1000]
+//
+// Gezählt werden die angeforderten Bytes ohne Verwaltungsaufwand des Allokators. Auf dem ESP32
+// kommen je Allokation etwa 8-16 Bytes Heap-Overhead hinzu, dafür sind Zeiger dort nur 4 statt
+// 8 Bytes groß; die Allokationszahlen sind direkt übertragbar. Die Clients hängen an Socket-Paaren,
+// Objekte des AsyncTCP-Shims und der Gegenstellen zählen nicht mit. "Broker (leer)" enthält das
+// Broker-Objekt selbst (sizeof) und alles, was setConfig() anlegt. Der Slab-Pool läuft in der
+// Standardkonfiguration (MQTT_POOL_MAX_BYTES); ist er eingeschaltet, zählt seine Arena bei der
+// ersten Verbindung und wird beim Abbau nicht freigegeben.
+
+#include "HostHeap.h"
+#include "HostLoop.h"
+#include "ESPAsyncMQTTBroker.h"
+
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+struct ESPAsyncMQTTBrokerTestAccess
+{
+    static void processPacket(ESPAsyncMQTTBroker &broker, MQTTClient *client, const std::string &packet)
+    {
+        broker.processPacket(client, (uint8_t *)packet.data(), packet.size());
+    }
+    static MQTTClient *attach(ESPAsyncMQTTBroker &broker, AsyncClient *asyncClient)
+    {
+        broker.onClient(asyncClient);
+        return broker.clients[asyncClient].get();
+    }
+};
+
+using Access = ESPAsyncMQTTBrokerTestAccess;
+
+// ---------------- Pakete ----------------
+
+static std::string str(const std::string &s)
+{
+    return std::string(1, (char)(s.size() >> 8)) + (char)(s.size() & 0xFF) + s;
+}
+
+static std::string packet(uint8_t header, const std::string &body)
+{
+    std::string out(1, (char)header);
+    size_t len = body.size();
+    do
+    {
+        uint8_t b = len % 128;
+        len /= 128;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+    return out + body;
+}
+
+static std::string packetId(uint16_t id)
+{
+    return std::string(1, (char)(id >> 8)) + (char)(id & 0xFF);
+}
+
+static std::string connectPacket(const std::string &clientId)
+{
+    // MQTT 3.1.1, Clean Session, Keep-Alive 60
+    return packet(0x10, str("MQTT") + '\x04' + '\x02' + '\x00' + '\x3C' + str(clientId));
+}
+
+static std::string subscribePacket(uint16_t id, const std::string &filter, uint8_t qos)
+{
+    return packet(0x82, packetId(id) + str(filter) + (char)qos);
+}
+
+static const size_t PayloadSize = 32;
+
+// ---------------- Clients ----------------
+
+/// Broker-Client an einem Socket-Paar; die Gegenstelle liest nur mit und bestätigt nichts
+struct Peer
+{
+    AsyncClient *asyncClient = nullptr;
+    MQTTClient *client = nullptr;
+    int fd = -1;
+};
+
+class Harness
+{
+public:
+    explicit Harness(uint16_t maxInflight) : owner(new ESPAsyncMQTTBroker()), broker(*owner)
+    {
+        ESPAsyncMQTTBrokerConfig config;
+        config.maxInflightMessages = maxInflight;
+        config.log = false;
+        broker.setDebugLevel(DEBUG_NONE);
+        broker.setConfig(config);
+    }
+
+    ~Harness()
+    {
+        HostHeapUncounted scope;
+        for (Peer &p : peers)
+            p.asyncClient->close(true);
+        drain();
+        for (Peer &p : peers)
+            ::close(p.fd);
+    }
+
+    /// Neuen Client anlegen und verbinden; nur die Allokationen des Brokers zählen
+    Peer &connect(const std::string &clientId)
+    {
+        std::string connect;
+        {
+            HostHeapUncounted scope;
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+            {
+                perror("socketpair");
+                exit(1);
+            }
+            peers.push_back(Peer());
+            peers.back().fd = fds[1];
+            peers.back().asyncClient = new AsyncClient(fds[0]);
+            peers.back().asyncClient->hostServerOwned = true; // wie ein vom Server angenommener Client freigeben
+            connect = connectPacket(clientId);
+        }
+        Peer &p = peers.back();
+        p.client = Access::attach(broker, p.asyncClient);
+        Access::processPacket(broker, p.client, connect);
+        return p;
+    }
+
+    void process(Peer &p, const std::string &packet) { Access::processPacket(broker, p.client, packet); }
+
+    /// Antworten abholen und ACKs zustellen, bis die Sendewarteschlangen leer sind
+    void drain()
+    {
+        char buf[4096];
+        for (int i = 0; i < 4; i++)
+        {
+            hostLoopRunOnce(0);
+            for (Peer &p : peers)
+            {
+                while (recv(p.fd, buf, sizeof(buf), 0) > 0)
+                {
+                }
+            }
+        }
+        broker.loop();
+    }
+
+    std::unique_ptr<ESPAsyncMQTTBroker> owner; // auf dem Heap, damit das Objekt selbst mitzählt
+    ESPAsyncMQTTBroker &broker;
+    std::vector<Peer> peers;
+};
+
+// ---------------- Messung ----------------
+
+struct Sample
+{
+    size_t bytes;
+    size_t blocks;
+    size_t allocations;
+};
+
+static Sample sample()
+{
+    const HostHeapStats &stats = hostHeapStats();
+    return {stats.liveBytes, stats.liveBlocks, stats.allocations};
+}
+
+static void report(const char *item, size_t count, Sample before)
+{
+    Sample after = sample();
+    size_t bytes = after.bytes - before.bytes;
+    size_t blocks = after.blocks - before.blocks;
+    size_t allocations = after.allocations - before.allocations;
+    printf("  %-30s %6zu %10zu %10.1f %10.2f %10.2f\n", item, count, bytes, count ? (double)bytes / count : 0.0,
+           count ? (double)blocks / count : 0.0, count ? (double)allocations / count : 0.0);
+}
+
+static void measure(size_t n)
+{
+    printf("\nN = %zu\n", n);
+    printf("  %-30s %6s %10s %10s %10s %10s\n", "Objekt", "Anzahl", "Bytes", "Bytes/St.", "Blöcke/St.", "Allok./St.");
+
+    std::vector<std::string> clientIds, retainedTopics, inflightTopics;
+    std::vector<std::string> subscribe, subscribeShared, qos2Publish;
+    std::string payload(PayloadSize, 'p');
+    {
+        HostHeapUncounted scope;
+        for (size_t i = 0; i < n; i++)
+        {
+            clientIds.push_back("footprint-" + std::to_string(i));
+            subscribe.push_back(subscribePacket(1, "fp/" + std::to_string(i) + "/+/state", 1));
+            subscribeShared.push_back(subscribePacket(2, "fp/shared/#", 1));
+            retainedTopics.push_back("retained/" + std::to_string(i / 100) + "/" + std::to_string(i % 100));
+            inflightTopics.push_back("inflight/" + std::to_string(i % 10));
+        }
+        for (uint16_t id = 1; id <= MQTT_MAX_INCOMING_QOS2; id++)
+            qos2Publish.push_back(packet(0x34, str("qos2/" + std::to_string(id)) + packetId(id) + payload));
+    }
+
+    Sample start = sample();
+    {
+        Harness h(16);
+        report("Broker (leer)", 1, start);
+
+        Sample before = sample();
+        for (size_t i = 0; i < n; i++)
+            h.connect(clientIds[i]);
+        h.drain();
+        report("Verbindung", n, before);
+
+        before = sample();
+        for (size_t i = 0; i < n; i++)
+            h.process(h.peers[i], subscribe[i]);
+        h.drain();
+        report("Abonnement (eigener Filter)", n, before);
+
+        before = sample();
+        for (size_t i = 0; i < n; i++)
+            h.process(h.peers[i], subscribeShared[i]);
+        h.drain();
+        report("Abonnement (geteilter Filter)", n, before);
+
+        before = sample();
+        for (size_t i = 0; i < n; i++)
+            h.broker.publish(retainedTopics[i].c_str(), payload.c_str(), true);
+        h.drain();
+        report("Retained Topic", n, before);
+
+        size_t qos2 = std::min(n, (size_t)MQTT_MAX_INCOMING_QOS2);
+        before = sample();
+        for (size_t i = 0; i < qos2; i++)
+            h.process(h.peers[0], qos2Publish[i]);
+        h.drain();
+        report("QoS 2 eingehend (vor PUBREL)", qos2, before);
+    }
+
+    {
+        // Eigener Broker: das Fenster der Packet-IDs belegt je Client n/8 Bytes
+        Harness h((uint16_t)std::min(n, (size_t)65535));
+        Peer &subscriber = h.connect("footprint-inflight");
+        h.process(subscriber, subscribePacket(1, "inflight/#", 1));
+        h.drain();
+
+        Sample before = sample();
+        for (size_t i = 0; i < n; i++)
+        {
+            h.broker.publish(inflightTopics[i].c_str(), payload.c_str(), false, 1);
+            h.drain(); // Sendewarteschlange leeren, sonst lehnt die Überlastgrenze QoS 1 ab
+        }
+        report("QoS 1 ausgehend (ohne PUBACK)", subscriber.client->outgoingMessages.size(), before);
+    }
+
+    Sample end = sample();
+    if (end.bytes != start.bytes)
+        printf("  Achtung: %zd Bytes nach dem Abbau nicht freigegeben\n", (ssize_t)(end.bytes - start.bytes));
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> scales;
+    for (int i = 1; i < argc; i++)
+    {
+        long n = atol(argv[i]);
+        if (n <= 0)
+        {
+            fprintf(stderr, "Aufruf: %s [Anzahl ...]   (Standard: 10 100 1000)\n", argv[0]);
+            return 2;
+        }
+        scales.push_back((size_t)n);
+    }
+    if (scales.empty())
+        scales = {10, 100, 1000};
+
+    // Zwei Dateideskriptoren je Client
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    printf("Speicherbedarf des Brokers (Host, %zu-Bit-Zeiger, angeforderte Bytes ohne Allokator-Overhead)\n", sizeof(void *) * 8);
+    printf("sizeof: ESPAsyncMQTTBroker %zu, MQTTClient %zu, Subscription %zu, RetainedMessage %zu, OutgoingQoSMessage %zu, OutboundFrame %zu\n",
+           sizeof(ESPAsyncMQTTBroker), sizeof(MQTTClient), sizeof(Subscription), sizeof(RetainedMessage), sizeof(OutgoingQoSMessage), sizeof(OutboundFrame));
+    printf("Slab-Pool: %zu Bytes (poolMaxBytes)\n", (size_t)ESPAsyncMQTTBrokerConfig().poolMaxBytes);
+
+    for (size_t n : scales)
+        measure(n);
+    return 0;
+}
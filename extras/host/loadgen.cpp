@@ -0,0 +1,635 @@
+// Lastgenerator: Broker und N Clients in einem Prozess, verbunden über Loopback (Host-Build).
+//
+// Misst Durchsatz (msgs/s), Latenz vom Senden des PUBLISH bis zur Zustellung beim Abonnenten
+// (p50/p99/p999), die Heap-Spitze des Brokers und optional die Dauer des Retained-Replays
+// für spät abonnierende Clients. Ergebnis als JSON auf stdout.
+//
+// Bauen und starten (aus extras/host):
+//   make mqtt_loadgen
+//   ./mqtt_loadgen --subscribers=50 --publishers=10 --topics=100 --wildcards=0.2
+//                  --qos=70:20:10 --payload=64 --messages=20000 [--rate=0] [--retained=0.1 --late=5] [--pool=262144]
+//                  [--window=16 --pending=64]
+//
+// Topics: load/<i/10>/<i%10>. Wildcard-Abonnements sind abwechselnd load/<g>/# und load/+/<d>.
+// Der Payload beginnt mit dem Sendezeitpunkt (16 Hex-Zeichen, ns) und ist damit auch mit
+// dem Source-Präfix des Brokers und dem strlen()-Pfad bei QoS 2 auswertbar.
+//
+// Heap: alle Allokationen außerhalb des Lastgenerator-Codes zählen (Broker inkl. AsyncTCP-Shim).
+// --pool setzt poolMaxBytes (0 = Slab-Pool aus, wie MQTT_POOL_MAX_BYTES). Der Standard hier ist
+// 256 KiB, weil MQTTClient mit 64-Bit-Zeigern fast doppelt so groß ist wie auf dem ESP32. "pool" im Ergebnis zeigt
+// Trefferquote und Belegung; reicht der Pool für die Spitzenlast nicht, steigen die misses.
+// --window/--pending setzen maxInflightMessages und maxPendingMessages. Mit --rate=0 laufen die
+// Sendewarteschlangen der Abonnenten über die High-Watermark: QoS 0 wird dann nach qos0Policy
+// verworfen, QoS 1/2 wartet in der Pending-Warteschlange und geht erst verloren, wenn auch diese
+// voll ist ("dropped"). Mit --qos=0:100:0 --pending=100000 oder einer --rate unterhalb der
+// Zustellrate bleibt "dropped" bei 0.
+
+#include "HostHeap.h"
+#include "HostLoop.h"
+#include "ESPAsyncMQTTBroker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Zugriff auf den Server des Brokers (friend in ESPAsyncMQTTBroker.h)
+struct ESPAsyncMQTTBrokerTestAccess
+{
+    static bool listening(ESPAsyncMQTTBroker &broker) { return broker.server && broker.server->status(); }
+};
+
+// ---------------- Hilfsfunktionen ----------------
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Random
+{
+    uint64_t state;
+    explicit Random(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    uint32_t below(uint32_t n) { return (uint32_t)(next() % n); }
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+static void putString(std::string &out, const std::string &s)
+{
+    out += (char)(s.size() >> 8);
+    out += (char)(s.size() & 0xFF);
+    out += s;
+}
+
+static void putPacket(std::string &out, uint8_t header, const std::string &body)
+{
+    out += (char)header;
+    size_t len = body.size();
+    do
+    {
+        uint8_t b = len % 128;
+        len /= 128;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+    out += body;
+}
+
+static std::string topicName(uint32_t i)
+{
+    return "load/" + std::to_string(i / 10) + "/" + std::to_string(i % 10);
+}
+
+// ---------------- Konfiguration und Ergebnis ----------------
+
+struct Options
+{
+    uint32_t subscribers = 50;
+    uint32_t publishers = 10;
+    uint32_t topics = 100;
+    uint32_t subsPerClient = 5;
+    double wildcards = 0.2;
+    uint32_t qosWeight[3] = {70, 20, 10};
+    uint32_t payload = 64;
+    uint32_t messages = 20000;
+    uint32_t rate = 0; ///< Nachrichten/s über alle Publisher, 0 = so schnell wie möglich
+    uint32_t window = 16;
+    uint32_t pending = ESPAsyncMQTTBrokerConfig().maxPendingMessages;
+    double retained = 0;
+    uint32_t late = 0;
+    uint32_t timeout = 60;
+    uint64_t seed = 1;
+    uint16_t port = 18830;
+    int debug = DEBUG_ERROR;
+    size_t pool = 256 * 1024;
+};
+
+struct Stats
+{
+    std::vector<uint64_t> latencies; ///< ns
+    uint64_t delivered = 0;
+    uint64_t published = 0;
+    uint64_t acked = 0;
+    uint64_t lastDeliveryNs = 0;
+};
+
+static Stats stats;
+
+// ---------------- Last-Client ----------------
+
+class LoadClient
+{
+public:
+    enum Role
+    {
+        Subscriber,
+        Publisher,
+        Late
+    };
+
+    LoadClient(Role role, const std::string &id) : role(role), id(id)
+    {
+        client.setNoDelay(true);
+        client.onConnect([](void *arg, AsyncClient *)
+                         {
+            HostHeapUncounted scope;
+            ((LoadClient *)arg)->handleConnect(); }, this);
+        client.onData([](void *arg, AsyncClient *, void *data, size_t len)
+                      {
+            HostHeapUncounted scope;
+            ((LoadClient *)arg)->handleData((const char *)data, len); }, this);
+        client.onAck([](void *arg, AsyncClient *, size_t, uint32_t)
+                     {
+            HostHeapUncounted scope;
+            ((LoadClient *)arg)->flush(); }, this);
+        client.onDisconnect([](void *arg, AsyncClient *)
+                            { ((LoadClient *)arg)->closed = true; }, this);
+    }
+
+    bool start(uint16_t port) { return client.connect(IPAddress(127, 0, 0, 1), port); }
+
+    void subscribe(const std::vector<std::string> &filters)
+    {
+        std::string body;
+        body += (char)0;
+        body += (char)1;
+        for (const std::string &f : filters)
+        {
+            putString(body, f);
+            body += (char)2; // höchste QoS, die Zustellung erfolgt mit der QoS des Publishers
+        }
+        putPacket(out, 0x82, body);
+        subscribeNs = nowNs();
+        flush();
+    }
+
+    /// Ein PUBLISH senden, wenn Fenster und Sendepuffer es zulassen
+    bool publish(const std::string &topic, uint8_t qos, bool retain, uint32_t payloadSize)
+    {
+        if (qos > 0 && inflight >= windowSize)
+            return false;
+        // Der Broker verwirft bei MQTT 3.1.1 neue QoS-2-Nachrichten ohne PUBREC, solange seine
+        // Tabelle offener eingehender QoS-2-Nachrichten voll ist
+        if (qos == 2 && inflightQoS2 >= MQTT_MAX_INCOMING_QOS2)
+            return false;
+        if (!out.empty() || client.space() < topic.size() + payloadSize + 16)
+            return false;
+
+        char stamp[17];
+        snprintf(stamp, sizeof(stamp), "%016llx", (unsigned long long)nowNs());
+        std::string body;
+        putString(body, topic);
+        if (qos > 0)
+        {
+            nextId = nextId == 0xFFFF ? 1 : nextId + 1;
+            body += (char)(nextId >> 8);
+            body += (char)(nextId & 0xFF);
+            inflight++;
+            if (qos == 2)
+                inflightQoS2++;
+        }
+        body += stamp;
+        if (payloadSize > 16)
+            body.append(payloadSize - 16, 'x');
+        putPacket(out, 0x30 | (qos << 1) | (retain ? 1 : 0), body);
+        flush();
+        return true;
+    }
+
+    void flush()
+    {
+        if (out.empty() || !client.connected())
+            return;
+        size_t n = client.add(out.data(), out.size());
+        if (n)
+        {
+            out.erase(0, n);
+            client.send();
+        }
+    }
+
+    Role role;
+    std::string id;
+    AsyncClient client;
+    bool ready = false; ///< CONNACK (Publisher) bzw. SUBACK (Abonnent) erhalten
+    bool closed = false;
+    uint32_t inflight = 0;
+    uint32_t inflightQoS2 = 0;
+    uint32_t windowSize = 16;
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    uint64_t subscribeNs = 0;
+    uint64_t lastReceiveNs = 0;
+
+private:
+    void handleConnect()
+    {
+        std::string body;
+        putString(body, "MQTT");
+        body += (char)4;    // MQTT 3.1.1
+        body += (char)0x02; // Clean Session
+        body += (char)0;
+        body += (char)60; // Keep-Alive 60 s
+        putString(body, id);
+        putPacket(out, 0x10, body);
+        flush();
+    }
+
+    void handleData(const char *data, size_t len)
+    {
+        in.append(data, len);
+        size_t pos = 0;
+        while (in.size() - pos >= 2)
+        {
+            size_t value = 0, multiplier = 1, idx = pos + 1;
+            bool complete = false;
+            while (idx < in.size() && idx - pos <= 4)
+            {
+                uint8_t b = in[idx++];
+                value += (b & 0x7F) * multiplier;
+                multiplier *= 128;
+                if (!(b & 0x80))
+                {
+                    complete = true;
+                    break;
+                }
+            }
+            if (!complete || in.size() - idx < value)
+                break;
+            handlePacket((uint8_t)in[pos], (const uint8_t *)in.data() + idx, value);
+            pos = idx + value;
+        }
+        in.erase(0, pos);
+    }
+
+    void sendAck(uint8_t header, const uint8_t *id)
+    {
+        std::string body(1, (char)id[0]);
+        body += (char)id[1];
+        putPacket(out, header, body);
+    }
+
+    void handlePacket(uint8_t header, const uint8_t *body, size_t len)
+    {
+        switch (header >> 4)
+        {
+        case MQTT_CONNACK:
+            if (role == Publisher)
+                ready = true;
+            break;
+        case MQTT_SUBACK:
+            ready = true;
+            break;
+        case MQTT_PUBLISH:
+        {
+            uint8_t qos = (header >> 1) & 0x03;
+            size_t topicLen = ((size_t)body[0] << 8) | body[1];
+            size_t offset = 2 + topicLen + (qos ? 2 : 0);
+            if (qos == 1)
+                sendAck(0x40, body + 2 + topicLen);
+            else if (qos == 2)
+                sendAck(0x50, body + 2 + topicLen);
+            lastReceiveNs = nowNs();
+            received++;
+            if (role == Late)
+                break;
+            // Source-Präfix "source:[id];" des Brokers überspringen
+            std::string payload((const char *)body + offset, len - offset);
+            size_t start = 0;
+            if (payload.compare(0, 8, "source:[") == 0)
+            {
+                size_t end = payload.find("];");
+                start = end == std::string::npos ? payload.size() : end + 2;
+            }
+            if (payload.size() - start >= 16)
+            {
+                uint64_t sentNs = strtoull(payload.substr(start, 16).c_str(), nullptr, 16);
+                stats.latencies.push_back(lastReceiveNs - sentNs);
+            }
+            stats.delivered++;
+            stats.lastDeliveryNs = lastReceiveNs;
+            break;
+        }
+        case MQTT_PUBREL:
+            sendAck(0x70, body);
+            break;
+        case MQTT_PUBCOMP:
+            if (inflightQoS2)
+                inflightQoS2--;
+            // fallthrough
+        case MQTT_PUBACK:
+            if (inflight)
+                inflight--;
+            stats.acked++;
+            break;
+        case MQTT_PUBREC:
+            sendAck(0x62, body);
+            break;
+        default:
+            break;
+        }
+        flush();
+    }
+
+    std::string in;
+    std::string out; ///< noch nicht vom Sendepuffer angenommen
+    uint16_t nextId = 0;
+};
+
+// ---------------- Ablauf ----------------
+
+static bool parseOption(const char *arg, Options &o)
+{
+    const char *eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || !eq)
+        return false;
+    std::string key(arg + 2, eq - arg - 2);
+    const char *v = eq + 1;
+    if (key == "subscribers")
+        o.subscribers = atoi(v);
+    else if (key == "publishers")
+        o.publishers = atoi(v);
+    else if (key == "topics")
+        o.topics = std::max(1, atoi(v));
+    else if (key == "subs")
+        o.subsPerClient = std::max(1, atoi(v));
+    else if (key == "wildcards")
+        o.wildcards = atof(v);
+    else if (key == "qos")
+        return sscanf(v, "%u:%u:%u", &o.qosWeight[0], &o.qosWeight[1], &o.qosWeight[2]) == 3 &&
+               o.qosWeight[0] + o.qosWeight[1] + o.qosWeight[2] > 0;
+    else if (key == "payload")
+        o.payload = std::max(16, atoi(v));
+    else if (key == "messages")
+        o.messages = atoi(v);
+    else if (key == "rate")
+        o.rate = atoi(v);
+    else if (key == "window")
+        o.window = std::max(1, atoi(v));
+    else if (key == "pending")
+        o.pending = std::max(0, atoi(v));
+    else if (key == "retained")
+        o.retained = atof(v);
+    else if (key == "late")
+        o.late = atoi(v);
+    else if (key == "timeout")
+        o.timeout = atoi(v);
+    else if (key == "seed")
+        o.seed = strtoull(v, nullptr, 10);
+    else if (key == "port")
+        o.port = (uint16_t)atoi(v);
+    else if (key == "debug")
+        o.debug = atoi(v);
+    else if (key == "pool")
+        o.pool = (size_t)atol(v);
+    else
+        return false;
+    return true;
+}
+
+static double percentileUs(std::vector<uint64_t> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k] / 1000.0;
+}
+
+/// Schleife laufen lassen, bis done() erfüllt ist; false bei Zeitüberschreitung
+template <typename Done, typename Tick>
+static bool runUntil(ESPAsyncMQTTBroker &broker, uint64_t deadlineNs, Done done, Tick tick)
+{
+    while (!done())
+    {
+        if (nowNs() > deadlineNs)
+            return false;
+        hostLoopRunOnce(1);
+        broker.loop();
+        HostHeapUncounted scope;
+        tick();
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!parseOption(argv[i], o))
+        {
+            fprintf(stderr, "Unbekannte Option: %s (Format --name=wert, siehe Kopf von loadgen.cpp)\n", argv[i]);
+            return 1;
+        }
+    }
+
+    size_t heapStart = hostHeapStats().liveBytes;
+    ESPAsyncMQTTBroker broker(o.port);
+    broker.setDebugLevel((DebugLevel)o.debug);
+    ESPAsyncMQTTBrokerConfig config;
+    config.maxInflightMessages = o.window;
+    config.maxPendingMessages = o.pending;
+    config.poolMaxBytes = o.pool;
+    broker.setConfig(config);
+    broker.begin();
+    if (!ESPAsyncMQTTBrokerTestAccess::listening(broker))
+    {
+        fprintf(stderr, "Port %u nicht verfügbar (--port=...)\n", o.port);
+        return 1;
+    }
+
+    std::vector<LoadClient *> subscribers, publishers, lateClients;
+    Random rng(o.seed);
+    uint64_t deadline = nowNs() + (uint64_t)o.timeout * 1000000000ULL;
+    bool ok = true;
+
+    // Verbinden und abonnieren
+    {
+        HostHeapUncounted scope;
+        stats.latencies.reserve((size_t)o.messages * 4);
+        for (uint32_t i = 0; i < o.subscribers; i++)
+        {
+            subscribers.push_back(new LoadClient(LoadClient::Subscriber, "sub" + std::to_string(i)));
+            subscribers.back()->start(o.port);
+        }
+        for (uint32_t i = 0; i < o.publishers; i++)
+        {
+            publishers.push_back(new LoadClient(LoadClient::Publisher, "pub" + std::to_string(i)));
+            publishers.back()->windowSize = o.window;
+            publishers.back()->start(o.port);
+        }
+    }
+    std::vector<bool> subscribed(o.subscribers, false);
+    ok = runUntil(broker, deadline, [&]
+                  {
+        for (auto *c : subscribers)
+            if (!c->ready)
+                return false;
+        for (auto *c : publishers)
+            if (!c->ready)
+                return false;
+        return true; },
+                  [&]
+                  {
+        // Abonnieren, sobald die Verbindung steht (CONNECT ist dann bereits im Sendepuffer)
+        for (uint32_t i = 0; i < subscribers.size(); i++)
+        {
+            LoadClient *c = subscribers[i];
+            if (subscribed[i] || !c->client.connected())
+                continue;
+            subscribed[i] = true;
+            std::vector<std::string> filters;
+            for (uint32_t s = 0; s < o.subsPerClient; s++)
+            {
+                uint32_t t = rng.below(o.topics);
+                if (rng.unit() < o.wildcards)
+                    filters.push_back(s % 2 ? "load/+/" + std::to_string(t % 10) : "load/" + std::to_string(t / 10) + "/#");
+                else
+                    filters.push_back(topicName(t));
+            }
+            c->subscribe(filters);
+        } });
+    size_t heapConnected = hostHeapStats().liveBytes;
+
+    // Lastphase
+    uint32_t qosTotal = o.qosWeight[0] + o.qosWeight[1] + o.qosWeight[2];
+    uint64_t startNs = nowNs();
+    uint32_t next = 0; // Publisher, der als Nächstes an der Reihe ist
+    if (ok)
+    {
+        ok = runUntil(broker, deadline, [&]
+                      {
+            if (stats.published < o.messages)
+                return false;
+            for (auto *c : publishers)
+                if (c->inflight)
+                    return false;
+            return true; },
+                      [&]
+                      {
+            uint64_t allowed = o.messages;
+            if (o.rate)
+                allowed = std::min<uint64_t>(o.messages, (nowNs() - startNs) * o.rate / 1000000000ULL + 1);
+            uint32_t blocked = 0;
+            while (stats.published < allowed && blocked < publishers.size())
+            {
+                LoadClient *c = publishers[next];
+                next = (next + 1) % publishers.size();
+                uint32_t r = rng.below(qosTotal);
+                uint8_t qos = r < o.qosWeight[0] ? 0 : (r < o.qosWeight[0] + o.qosWeight[1] ? 1 : 2);
+                bool retain = o.retained > 0 && rng.unit() < o.retained;
+                if (c->publish(topicName(rng.below(o.topics)), qos, retain, o.payload))
+                {
+                    stats.published++;
+                    blocked = 0;
+                }
+                else
+                {
+                    blocked++;
+                }
+            } });
+    }
+    uint64_t publishedNs = nowNs();
+
+    // Nachlauf: restliche Zustellungen abwarten (200 ms ohne neue Nachricht)
+    runUntil(broker, deadline, [&]
+             { return nowNs() - std::max(stats.lastDeliveryNs, publishedNs) > 200000000ULL; }, [] {});
+    uint64_t endNs = stats.lastDeliveryNs > publishedNs ? stats.lastDeliveryNs : publishedNs;
+
+    // Retained-Replay für spät abonnierende Clients
+    std::vector<uint64_t> replayNs;
+    uint32_t replayReceived = UINT32_MAX;
+    uint32_t retainedCount = broker.getMetrics()[MQTTMetric::RetainedCount];
+    if (ok && o.late > 0 && retainedCount > 0)
+    {
+        {
+            HostHeapUncounted scope;
+            for (uint32_t i = 0; i < o.late; i++)
+            {
+                lateClients.push_back(new LoadClient(LoadClient::Late, "late" + std::to_string(i)));
+                lateClients.back()->start(o.port);
+            }
+        }
+        std::vector<bool> lateSubscribed(o.late, false);
+        ok = runUntil(broker, deadline, [&]
+                      {
+            // Fertig, wenn alles angekommen ist oder 200 ms nichts mehr kam (der Broker verwirft
+            // QoS-1/2-Nachrichten jenseits des In-Flight-Fensters)
+            for (auto *c : lateClients)
+                if (c->received < retainedCount && (!c->ready || nowNs() - c->lastReceiveNs < 200000000ULL))
+                    return false;
+            return true; },
+                      [&]
+                      {
+            for (uint32_t i = 0; i < lateClients.size(); i++)
+            {
+                if (!lateSubscribed[i] && lateClients[i]->client.connected())
+                {
+                    lateSubscribed[i] = true;
+                    lateClients[i]->subscribe({"load/#"});
+                }
+            } });
+        for (auto *c : lateClients)
+        {
+            replayNs.push_back(c->lastReceiveNs - c->subscribeNs);
+            replayReceived = std::min(replayReceived, c->received);
+        }
+    }
+
+    MQTTMetricsSnapshot m = broker.getMetrics();
+    double seconds = (endNs - startNs) / 1e9;
+    HostHeapUncounted scope;
+    std::sort(replayNs.begin(), replayNs.end());
+
+    printf("{\n");
+    printf("  \"config\": {\"subscribers\": %u, \"publishers\": %u, \"topics\": %u, \"subs_per_client\": %u, "
+           "\"wildcards\": %.2f, \"qos\": [%u, %u, %u], \"payload\": %u, \"messages\": %u, \"rate\": %u, "
+           "\"window\": %u, \"pending\": %u, \"retained\": %.2f, \"late\": %u, \"seed\": %llu},\n",
+           o.subscribers, o.publishers, o.topics, o.subsPerClient, o.wildcards, o.qosWeight[0], o.qosWeight[1],
+           o.qosWeight[2], o.payload, o.messages, o.rate, o.window, o.pending, o.retained, o.late, (unsigned long long)o.seed);
+    printf("  \"completed\": %s,\n", ok ? "true" : "false");
+    printf("  \"duration_s\": %.3f,\n", seconds);
+    printf("  \"published\": %llu,\n", (unsigned long long)stats.published);
+    printf("  \"delivered\": %llu,\n", (unsigned long long)stats.delivered);
+    printf("  \"dropped\": %u,\n", m[MQTTMetric::PublishDropped]);
+    printf("  \"publish_rate\": %.0f,\n", seconds > 0 ? stats.published / seconds : 0);
+    printf("  \"deliver_rate\": %.0f,\n", seconds > 0 ? stats.delivered / seconds : 0);
+    printf("  \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f},\n",
+           percentileUs(stats.latencies, 0.5), percentileUs(stats.latencies, 0.99), percentileUs(stats.latencies, 0.999),
+           stats.latencies.empty() ? 0 : *std::max_element(stats.latencies.begin(), stats.latencies.end()) / 1000.0);
+    if (!replayNs.empty())
+        printf("  \"retained_replay_ms\": {\"topics\": %u, \"received_min\": %u, \"p50\": %.2f, \"max\": %.2f},\n",
+               retainedCount, replayReceived, replayNs[replayNs.size() / 2] / 1e6, replayNs.back() / 1e6);
+    printf("  \"heap_bytes\": {\"connected\": %zu, \"peak\": %zu, \"per_client\": %zu},\n", heapConnected - heapStart,
+           hostHeapStats().peakBytes - heapStart, (o.subscribers + o.publishers) ? (heapConnected - heapStart) / (o.subscribers + o.publishers) : 0);
+    printf("  \"heap_allocations\": %zu,\n", hostHeapStats().allocations);
+    MQTTPoolStats pool = broker.getPoolStats();
+    printf("  \"pool\": {\"hit_rate\": %u, \"hits\": %u, \"grows\": %u, \"misses\": %u, \"oversize\": %u, \"arena_bytes\": %zu, \"slab_bytes\": %zu, "
+           "\"used_bytes\": %zu, \"requested_bytes\": %zu, \"slab_fragmentation\": %u},\n",
+           pool.hitRate(), pool.hits(), pool.grows(), pool.misses(), pool.oversize, pool.arenaBytes, pool.slabBytes, pool.usedBytes,
+           pool.requestedBytes, pool.slabFragmentation());
+    printf("  \"broker\": {\"bytes_received\": %u, \"bytes_sent\": %u, \"fanout_max\": %u, \"qos_retries\": %u}\n",
+           m[MQTTMetric::BytesReceived], m[MQTTMetric::BytesSent], m[MQTTMetric::FanoutMax], m[MQTTMetric::QoSRetries]);
+    printf("}\n");
+
+    for (auto *c : subscribers)
+        delete c;
+    for (auto *c : publishers)
+        delete c;
+    for (auto *c : lateClients)
+        delete c;
+    // Trennungen verarbeiten lassen, damit Broker und Shim ihre Clients freigeben
+    runUntil(broker, nowNs() + 1000000000ULL, [&]
+             { return broker.getConnectedClientCount() == 0; }, [] {});
+    hostLoopRunOnce(0);
+    broker.stop();
+    return ok ? 0 : 2;
+}
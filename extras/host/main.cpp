@@ -0,0 +1,119 @@
+// Broker als Linux-Programm (Host-Build), z. B. für Messungen mit mosquitto_pub/-sub auf localhost.
+//
+// Bauen und starten (aus extras/host):
+//   make
+//   ./mqtt_broker_host [-p port] [-d 0..4] [-u user -P passwort] [-s sys-intervall] [-t off|prefix|property] [-m max-paketgroesse] [-c mitschnitt.bin]
+//
+// Die Bibliothek wird unverändert aus src/ übersetzt; Arduino.h, AsyncTCP.h und esp_timer.h
+// kommen aus diesem Verzeichnis. -DMQTT_TRACE in CXXFLAGS schaltet die Stufen-Histogramme ein,
+// die beim Beenden (Strg+C) ausgegeben werden. Mit -DMQTT_CAPTURE schreibt -c alle eingehenden
+// Pakete in eine Datei, die mqtt_replay wieder abspielt. -t wählt die Kennzeichnung weitergeleiteter
+// Nachrichten (SourceTagMode, Standard: prefix), -m das größte angenommene Paket (maxPacketSize).
+
+#include "HostLoop.h"
+#include "ESPAsyncMQTTBroker.h"
+
+#include <csignal>
+#include <unistd.h>
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int)
+{
+    running = 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t port = 1883;
+    int debugLevel = DEBUG_INFO;
+    ESPAsyncMQTTBrokerConfig config;
+    const char *capturePath = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:u:P:s:t:m:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = (uint16_t)atoi(optarg);
+            break;
+        case 'd':
+            debugLevel = atoi(optarg);
+            break;
+        case 'u':
+            config.username = optarg;
+            break;
+        case 'P':
+            config.password = optarg;
+            break;
+        case 's':
+            config.sysInterval = (uint16_t)atoi(optarg);
+            break;
+        case 't':
+            if (strcmp(optarg, "off") == 0)
+                config.sourceTag = SourceTagMode::Off;
+            else if (strcmp(optarg, "property") == 0)
+                config.sourceTag = SourceTagMode::UserProperty;
+            else
+                config.sourceTag = SourceTagMode::LegacyPrefix;
+            break;
+        case 'm':
+            config.maxPacketSize = (size_t)atol(optarg);
+            break;
+        case 'c':
+            capturePath = optarg;
+            break;
+        default:
+            fprintf(stderr, "Aufruf: %s [-p port] [-d 0..4] [-u user -P passwort] [-s sys-intervall] [-t off|prefix|property] [-m max-paketgroesse] [-c mitschnitt.bin]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    ESPAsyncMQTTBroker broker(port);
+    broker.setConfig(config);
+    broker.setDebugLevel((DebugLevel)debugLevel);
+    broker.begin();
+    printf("MQTT-Broker lauscht auf Port %u\n", port);
+
+    FILE *captureFile = nullptr;
+    if (capturePath)
+    {
+#ifdef MQTT_CAPTURE
+        captureFile = fopen(capturePath, "wb");
+        if (!captureFile)
+        {
+            perror(capturePath);
+            return 1;
+        }
+        broker.setCaptureSink([captureFile](const uint8_t *data, size_t len)
+                              { fwrite(data, 1, len, captureFile); });
+        printf("Mitschnitt nach %s\n", capturePath);
+#else
+        fprintf(stderr, "-c benötigt einen Build mit -DMQTT_CAPTURE\n");
+        return 1;
+#endif
+    }
+
+    while (running)
+    {
+        hostLoopRunOnce(MQTT_TIMER_TICK_MS);
+        broker.loop();
+    }
+
+#ifdef MQTT_TRACE
+    broker.setDebugLevel(DEBUG_INFO);
+    broker.logTraceReport();
+#endif
+#ifdef MQTT_CAPTURE
+    broker.setCaptureSink(nullptr);
+#endif
+    if (captureFile)
+        fclose(captureFile);
+    broker.stop();
+    return 0;
+}
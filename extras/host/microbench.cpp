@@ -0,0 +1,410 @@
+// Mikro-Benchmarks der heißen Funktionen (Host-Build, Google Benchmark).
+//
+// processPacket() je Pakettyp, Topic-Matching im Topic-Baum (Routing-Pfad von publish()) über
+// verschiedene Filterformen, isValidTopicFilter() sowie die PUBLISH-Kodierung
+// (mqttBuildPublishFrame(), die publish(), das Retry im Timer und sendRetainedMessages() gemeinsam nutzen).
+//
+// Bauen und starten (aus extras/host, benötigt libbenchmark-dev):
+//   make mqtt_microbench
+//   ./mqtt_microbench [--benchmark_filter=Topic]
+//
+// processPacket() läuft gegen einen echten Broker-Client auf einem Socket-Paar, Abonnenten sind
+// weitere Clients (der Publisher selbst wird nicht beliefert). Die Antworten (PUBACK, SUBACK, ...)
+// werden alle DrainEvery Iterationen außerhalb der Zeitmessung abgeholt.
+
+#include "HostLoop.h"
+#include "ESPAsyncMQTTBroker.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+struct ESPAsyncMQTTBrokerTestAccess
+{
+    static void processPacket(ESPAsyncMQTTBroker &broker, MQTTClient *client, const std::string &packet)
+    {
+        broker.processPacket(client, (uint8_t *)packet.data(), packet.size());
+    }
+    static MQTTClient *attach(ESPAsyncMQTTBroker &broker, AsyncClient *asyncClient)
+    {
+        broker.onClient(asyncClient);
+        return broker.clients[asyncClient].get();
+    }
+    static bool isValidTopicFilter(ESPAsyncMQTTBroker &broker, const String &filter) { return broker.isValidTopicFilter(filter); }
+};
+
+using Access = ESPAsyncMQTTBrokerTestAccess;
+
+// ---------------- Pakete ----------------
+
+static std::string str(const std::string &s)
+{
+    return std::string(1, (char)(s.size() >> 8)) + (char)(s.size() & 0xFF) + s;
+}
+
+static std::string packet(uint8_t header, const std::string &body)
+{
+    std::string out(1, (char)header);
+    size_t len = body.size();
+    do
+    {
+        uint8_t b = len % 128;
+        len /= 128;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+    return out + body;
+}
+
+static std::string packetId(uint16_t id)
+{
+    return std::string(1, (char)(id >> 8)) + (char)(id & 0xFF);
+}
+
+static std::string connectPacket(const std::string &clientId = "bench")
+{
+    // MQTT 3.1.1, Clean Session, Keep-Alive 0 (sonst legt jede Iteration einen Timer an)
+    return packet(0x10, str("MQTT") + '\x04' + '\x02' + std::string(2, '\0') + str(clientId));
+}
+
+static std::string publishPacket(uint8_t qos, uint16_t id, size_t payload)
+{
+    return packet(0x30 | (qos << 1), str("bench/sensor/temperature") + (qos ? packetId(id) : "") + std::string(payload, 'p'));
+}
+
+// ---------------- Broker-Fixture ----------------
+
+class BrokerFixture
+{
+public:
+    static const int DrainEvery = 32;
+
+    /// Broker-Client auf einem Socket-Paar; peer ist die Gegenstelle
+    struct Connection
+    {
+        AsyncClient *asyncClient;
+        MQTTClient *client;
+        int peer;
+    };
+
+    BrokerFixture()
+    {
+        broker.setDebugLevel(DEBUG_NONE);
+        client = connect("bench").client;
+    }
+
+    ~BrokerFixture()
+    {
+        for (Connection &c : connections)
+        {
+            c.asyncClient->close(true);
+            hostLoopRunOnce(0);
+            ::close(c.peer);
+        }
+    }
+
+    /// Weiteren Client verbinden (z. B. als Abonnent, der Publisher selbst wird nicht beliefert)
+    Connection &connect(const std::string &clientId)
+    {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+        Connection c;
+        c.peer = fds[1];
+        c.asyncClient = new AsyncClient(fds[0]);
+        c.asyncClient->hostServerOwned = true; // wie ein vom Server angenommener Client freigeben
+        c.client = Access::attach(broker, c.asyncClient);
+        connections.push_back(c);
+        process(c.client, connectPacket(clientId));
+        drain();
+        return connections.back();
+    }
+
+    /// Gegenstelle des zuletzt verbundenen Clients schließen, nachdem der Broker ihn getrennt hat
+    void forgetLast()
+    {
+        hostLoopRunOnce(0); // getrennte AsyncClients freigeben
+        ::close(connections.back().peer);
+        connections.pop_back();
+    }
+
+    void process(const std::string &p) { process(client, p); }
+    void process(MQTTClient *target, const std::string &p) { Access::processPacket(broker, target, p); }
+
+    /// Antworten des Brokers abholen und ACKs zustellen, damit die Sendewarteschlangen leer bleiben
+    void drain()
+    {
+        char buf[4096];
+        for (int i = 0; i < 4; i++)
+        {
+            hostLoopRunOnce(0);
+            for (Connection &c : connections)
+            {
+                while (recv(c.peer, buf, sizeof(buf), 0) > 0)
+                {
+                }
+            }
+        }
+        broker.loop();
+    }
+
+    /// Nach jeder Iteration aufrufen: alle DrainEvery Iterationen ohne Zeitmessung leeren
+    void step(benchmark::State &state)
+    {
+        if (++iterations % DrainEvery == 0)
+        {
+            state.PauseTiming();
+            drain();
+            state.ResumeTiming();
+        }
+    }
+
+    ESPAsyncMQTTBroker broker;
+    MQTTClient *client; ///< erster Client ("bench"), sendet die Pakete der Benchmarks
+    std::vector<Connection> connections;
+    uint64_t iterations = 0;
+};
+
+// ---------------- processPacket() ----------------
+
+static void BM_ProcessConnect(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string p = connectPacket();
+    for (auto _ : state)
+    {
+        f.process(p);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessConnect);
+
+static void BM_ProcessPublishQoS0(benchmark::State &state)
+{
+    BrokerFixture f;
+    if (state.range(1))
+    {
+        // Eigener Client als Abonnent: der Publisher selbst wird nicht beliefert
+        MQTTClient *subscriber = f.connect("bench-sub").client;
+        f.process(subscriber, packet(0x82, packetId(1) + str("bench/#") + '\x00'));
+        f.drain();
+    }
+    std::string p = publishPacket(0, 0, state.range(0));
+    for (auto _ : state)
+    {
+        f.process(p);
+        f.step(state);
+    }
+    state.SetBytesProcessed(state.iterations() * p.size());
+}
+// Argumente: Payload-Bytes, ein Abonnent (0/1)
+BENCHMARK(BM_ProcessPublishQoS0)->Args({16, 0})->Args({512, 0})->Args({16, 1})->Args({512, 1});
+
+static void BM_ProcessPublishQoS1(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string p = publishPacket(1, 1, 16);
+    for (auto _ : state)
+    {
+        f.process(p);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessPublishQoS1);
+
+static void BM_ProcessPublishQoS2WithRelease(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string publish = publishPacket(2, 7, 16);
+    std::string pubrel = packet(0x62, packetId(7));
+    for (auto _ : state)
+    {
+        f.process(publish);
+        f.process(pubrel);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessPublishQoS2WithRelease);
+
+static void BM_ProcessSubscribeUnsubscribe(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string subscribe = packet(0x82, packetId(1) + str("home/+/temperature") + '\x01');
+    std::string unsubscribe = packet(0xA2, packetId(2) + str("home/+/temperature"));
+    for (auto _ : state)
+    {
+        f.process(subscribe);
+        f.process(unsubscribe);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessSubscribeUnsubscribe);
+
+static void BM_ProcessPingReq(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string p = packet(0xC0, "");
+    for (auto _ : state)
+    {
+        f.process(p);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessPingReq);
+
+static void BM_ProcessPubAckUnknownId(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string p = packet(0x40, packetId(4711));
+    for (auto _ : state)
+    {
+        f.process(p);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessPubAckUnknownId);
+
+static void BM_ProcessPubRecPubCompUnknownId(benchmark::State &state)
+{
+    BrokerFixture f;
+    std::string pubrec = packet(0x50, packetId(4711));
+    std::string pubcomp = packet(0x70, packetId(4711));
+    for (auto _ : state)
+    {
+        f.process(pubrec); // unbekannte ID: Publisher-Pfad, antwortet mit PUBREL
+        f.process(pubcomp);
+        f.step(state);
+    }
+}
+BENCHMARK(BM_ProcessPubRecPubCompUnknownId);
+
+static void BM_ProcessQoS2ToSubscriber(benchmark::State &state)
+{
+    // Vollständiger QoS-2-Ablauf über einen Abonnenten: PUBLISH + PUBREL vom Publisher, PUBREC +
+    // PUBCOMP vom Abonnenten (Differenz zu BM_ProcessPublishQoS2WithRelease = PUBREC/PUBCOMP-Pfad)
+    BrokerFixture f;
+    MQTTClient *subscriber = f.connect("bench-sub").client;
+    f.process(subscriber, packet(0x82, packetId(1) + str("bench/#") + '\x02'));
+    f.drain();
+    std::string publish = publishPacket(2, 7, 16);
+    std::string pubrel = packet(0x62, packetId(7));
+    std::vector<std::string> pubrec, pubcomp;
+    for (uint32_t id = 0; id <= ESPAsyncMQTTBrokerConfig().maxInflightMessages; id++)
+    {
+        pubrec.push_back(packet(0x50, packetId(id)));
+        pubcomp.push_back(packet(0x70, packetId(id)));
+    }
+    for (auto _ : state)
+    {
+        f.process(publish);
+        f.process(pubrel);
+        uint16_t id = subscriber->outgoingMessages.empty() ? 0 : subscriber->outgoingMessages.begin()->first;
+        f.process(subscriber, pubrec[id]);
+        f.process(subscriber, pubcomp[id]);
+        f.step(state);
+    }
+    if (!subscriber->outgoingMessages.empty())
+        state.SkipWithError("QoS-2-Ablauf zum Abonnenten nicht abgeschlossen");
+}
+BENCHMARK(BM_ProcessQoS2ToSubscriber);
+
+static void BM_ProcessDisconnect(benchmark::State &state)
+{
+    // DISCONNECT mit Clean Session, einschließlich Abbau des Clients (onDisconnect läuft synchron)
+    BrokerFixture f;
+    std::string p = packet(0xE0, "");
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        MQTTClient *c = f.connect("bench-disconnect").client;
+        state.ResumeTiming();
+        f.process(c, p);
+        state.PauseTiming();
+        f.forgetLast();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_ProcessDisconnect);
+
+// ---------------- Topic-Matching ----------------
+
+struct MatchCase
+{
+    const char *name;
+    const char *filter;
+    const char *topic;
+};
+
+static const MatchCase matchCases[] = {
+    {"exact", "home/livingroom/sensor/temperature", "home/livingroom/sensor/temperature"},
+    {"plus_mid", "home/+/sensor/temperature", "home/livingroom/sensor/temperature"},
+    {"hash_trailing", "home/#", "home/livingroom/sensor/temperature"},
+    {"hash_parent", "home/livingroom/#", "home/livingroom"}, // '/#' passt auch auf die Elternebene
+    {"mismatch_last", "home/livingroom/sensor/humidity", "home/livingroom/sensor/temperature"},
+};
+
+static void BM_TopicTreeMatch(benchmark::State &state)
+{
+    // Routing-Pfad von publish(): ein Baum mit vielen Filtern, davon passt der eine Testfall
+    const MatchCase &c = matchCases[state.range(0)];
+    state.SetLabel(c.name);
+    MQTTTopicTree<int> tree;
+    for (int i = 0; i < 1000; i++)
+    {
+        std::string f = "home/room" + std::to_string(i) + "/sensor/temperature";
+        tree.insert(f.c_str(), f.size(), i);
+    }
+    tree.insert(c.filter, strlen(c.filter), -1);
+    size_t topicLen = strlen(c.topic);
+    for (auto _ : state)
+    {
+        int matches = 0;
+        tree.forEachMatch(c.topic, topicLen, [&](int)
+                          { matches++; });
+        benchmark::DoNotOptimize(matches);
+    }
+}
+BENCHMARK(BM_TopicTreeMatch)->DenseRange(0, 4);
+
+static void BM_IsValidTopicFilter(benchmark::State &state)
+{
+    static const char *const filters[] = {"home/livingroom/sensor/temperature", "home/+/sensor/+", "home/#", "home/#/invalid", "sport/tennis+"};
+    ESPAsyncMQTTBroker broker;
+    broker.setDebugLevel(DEBUG_NONE);
+    String filter(filters[state.range(0)]);
+    state.SetLabel(filters[state.range(0)]);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Access::isValidTopicFilter(broker, filter));
+}
+BENCHMARK(BM_IsValidTopicFilter)->DenseRange(0, 4);
+
+// ---------------- Kodierung ----------------
+
+static void BM_BuildPublishFrame(benchmark::State &state)
+{
+    std::string topic = "home/livingroom/sensor/temperature";
+    std::vector<uint8_t> payload(state.range(0), 'p');
+    for (auto _ : state)
+    {
+        MQTTFramePtr frame = mqttBuildPublishFrame(topic.data(), topic.size(), payload.data(), payload.size(), 1, false);
+        benchmark::DoNotOptimize(frame);
+    }
+    state.SetBytesProcessed(state.iterations() * (topic.size() + payload.size()));
+}
+// 16 Bytes: Remaining Length 1 Byte, 512: 2 Bytes, 20000: 3 Bytes
+BENCHMARK(BM_BuildPublishFrame)->Arg(16)->Arg(512)->Arg(20000);
+
+static void BM_EncodeRemainingLength(benchmark::State &state)
+{
+    uint8_t buf[4];
+    size_t value = state.range(0);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(mqttEncodeRemainingLength(buf, value));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_EncodeRemainingLength)->Arg(100)->Arg(16000)->Arg(2000000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,277 @@
+// Mitschnitt abspielen (Host-Build): jedes aufgezeichnete Paket geht wieder in processPacket().
+//
+// Der Mitschnitt entsteht mit einem Broker, der mit -DMQTT_CAPTURE übersetzt ist (Host:
+// mqtt_broker_host -c datei, ESP32: setCaptureSink() mit eigener Senke). Jede aufgezeichnete
+// Verbindung wird beim ersten Eintrag als Client an einem Socket-Paar angelegt, dessen
+// Gegenstelle nur mitliest; "Verbindung beendet" schließt sie wieder. ACKs der Abonnenten werden
+// so abgespielt, wie sie aufgezeichnet wurden: die Packet-IDs des Brokers stimmen überein, wenn der
+// Mitschnitt mit den Verbindungen beginnt (frische Sessions).
+//
+// Bauen und starten (aus extras/host):
+//   make mqtt_replay
+//   ./mqtt_replay mitschnitt.bin [--speed=1] [--debug=0]
+//
+// --speed: 1 = Originaltempo, 10 = zehnfach beschleunigt, 0 = so schnell wie möglich.
+// Ergebnis als JSON: Pakete je Typ, Dauer, Pakete/s, Zeit in processPacket() (p50/p99/max),
+// Verspätung gegenüber dem Zeitplan und die Broker-Metriken.
+
+#include "HostLoop.h"
+#include "ESPAsyncMQTTBroker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+struct ESPAsyncMQTTBrokerTestAccess
+{
+    static void processPacket(ESPAsyncMQTTBroker &broker, MQTTClient *client, uint8_t *data, size_t len)
+    {
+        broker.processPacket(client, data, len);
+    }
+    static MQTTClient *attach(ESPAsyncMQTTBroker &broker, AsyncClient *asyncClient)
+    {
+        broker.onClient(asyncClient);
+        return broker.clients[asyncClient].get();
+    }
+    /// MQTTClient der Verbindung, nullptr wenn der Broker sie inzwischen geschlossen hat
+    /// (die Seriennummer schützt vor einem neuen Client an derselben Adresse)
+    static MQTTClient *find(ESPAsyncMQTTBroker &broker, AsyncClient *asyncClient, uint32_t serial)
+    {
+        auto it = broker.clients.find(asyncClient);
+        return it == broker.clients.end() || it->second->serial != serial ? nullptr : it->second.get();
+    }
+};
+
+using Access = ESPAsyncMQTTBrokerTestAccess;
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Connection
+{
+    AsyncClient *asyncClient = nullptr;
+    uint32_t serial = 0;
+    int peer = -1;
+    bool closed = false;
+};
+
+static std::map<uint32_t, Connection> connections;
+
+/// Antworten des Brokers abholen (die Gegenstellen lesen nur mit)
+static void drain(ESPAsyncMQTTBroker &broker)
+{
+    char buf[8192];
+    hostLoopRunOnce(0);
+    for (auto &entry : connections)
+    {
+        if (entry.second.peer < 0)
+            continue;
+        ssize_t n;
+        while ((n = recv(entry.second.peer, buf, sizeof(buf), 0)) > 0)
+        {
+        }
+        if (n == 0)
+        {
+            ::close(entry.second.peer); // Broker hat geschlossen
+            entry.second.peer = -1;
+        }
+    }
+    broker.loop();
+}
+
+static double percentileUs(std::vector<uint64_t> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    double speed = 1;
+    int debug = DEBUG_NONE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--speed=", 8) == 0)
+            speed = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--debug=", 8) == 0)
+            debug = atoi(argv[i] + 8);
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+            path = nullptr, i = argc;
+    }
+    if (!path || speed < 0)
+    {
+        fprintf(stderr, "Aufruf: %s mitschnitt.bin [--speed=1|10|0] [--debug=0..4]\n", argv[0]);
+        return 2;
+    }
+
+    std::string file;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        file.append(chunk, n);
+    fclose(f);
+
+    MQTTCaptureReader reader((const uint8_t *)file.data(), file.size());
+    if (!reader.isValid())
+    {
+        fprintf(stderr, "%s: kein Mitschnitt (Kopf/Version)\n", path);
+        return 1;
+    }
+    std::vector<MQTTCaptureRecord> records;
+    MQTTCaptureRecord record;
+    while (reader.next(record))
+        records.push_back(record);
+    if (reader.truncated())
+        fprintf(stderr, "%s: Mitschnitt endet mitten in einem Eintrag, %zu Einträge lesbar\n", path, records.size());
+
+    // Keine echten Sockets: begin() startet nur den Timer des Brokers
+    asyncTcpHostSetVirtual(true);
+    ESPAsyncMQTTBroker broker;
+    broker.setDebugLevel((DebugLevel)debug);
+    broker.begin();
+
+    uint64_t packetsByType[16] = {0};
+    uint64_t skipped = 0;
+    std::vector<uint64_t> processNs, lagNs;
+    processNs.reserve(records.size());
+    std::vector<uint8_t> scratch;
+
+    uint64_t start = nowNs();
+    size_t sinceDrain = 0;
+    for (const MQTTCaptureRecord &r : records)
+    {
+        if (speed > 0)
+        {
+            uint64_t due = start + (uint64_t)(r.timeUs * 1000 / speed);
+            while (nowNs() < due)
+            {
+                uint64_t waitMs = (due - nowNs()) / 1000000;
+                hostLoopRunOnce((int)std::min<uint64_t>(waitMs, MQTT_TIMER_TICK_MS));
+                drain(broker);
+            }
+            lagNs.push_back(nowNs() - due);
+        }
+
+        Connection &c = connections[r.client];
+        if (!c.asyncClient && !c.closed)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+            {
+                perror("socketpair");
+                return 1;
+            }
+            c.peer = fds[1];
+            c.asyncClient = new AsyncClient(fds[0]);
+            c.asyncClient->hostServerOwned = true; // wie ein vom Server angenommener Client freigeben
+            c.serial = Access::attach(broker, c.asyncClient)->serial;
+        }
+        MQTTClient *client = c.closed ? nullptr : Access::find(broker, c.asyncClient, c.serial);
+        if (!client)
+        {
+            // Vom Broker bereits geschlossen (DISCONNECT, Protokollfehler): nur Pakete danach zählen
+            c.closed = true;
+            if (r.kind == MQTTCaptureKind::Packet)
+                skipped++;
+            continue;
+        }
+
+        if (r.kind == MQTTCaptureKind::Closed)
+        {
+            c.closed = true;
+            c.asyncClient->close(true);
+        }
+        else
+        {
+            // processPacket() darf das Paket verändern: mit einer Kopie arbeiten
+            scratch.assign(r.data, r.data + r.len);
+            if (r.len)
+                packetsByType[r.data[0] >> 4]++;
+            uint64_t t0 = nowNs();
+            Access::processPacket(broker, client, scratch.data(), scratch.size());
+            processNs.push_back(nowNs() - t0);
+            if (!Access::find(broker, c.asyncClient, c.serial))
+                c.closed = true;
+        }
+
+        if (++sinceDrain >= 64)
+        {
+            sinceDrain = 0;
+            drain(broker);
+        }
+    }
+    drain(broker);
+    double durationS = (nowNs() - start) / 1e9;
+
+    // Übrige Verbindungen schließen und abbauen, bevor der Broker endet
+    for (auto &entry : connections)
+    {
+        Connection &c = entry.second;
+        if (!c.closed && Access::find(broker, c.asyncClient, c.serial))
+            c.asyncClient->close(true);
+    }
+    drain(broker);
+    for (auto &entry : connections)
+    {
+        if (entry.second.peer >= 0)
+            ::close(entry.second.peer);
+    }
+
+    MQTTMetricsSnapshot m = broker.getMetrics();
+    broker.stop();
+
+    uint64_t packets = processNs.size();
+    uint64_t processTotal = 0;
+    for (uint64_t v : processNs)
+        processTotal += v;
+    int64_t capturedUs = records.empty() ? 0 : records.back().timeUs;
+
+    printf("{\n");
+    printf("  \"file\": \"%s\",\n", path);
+    printf("  \"speed\": %g,\n", speed);
+    printf("  \"records\": %zu,\n", records.size());
+    printf("  \"connections\": %zu,\n", connections.size());
+    printf("  \"packets\": %llu,\n", (unsigned long long)packets);
+    printf("  \"skipped\": %llu,\n", (unsigned long long)skipped);
+    printf("  \"packets_by_type\": {");
+    bool first = true;
+    for (uint8_t t = 1; t < 16; t++)
+    {
+        if (!packetsByType[t])
+            continue;
+        printf("%s\"%s\": %llu", first ? "" : ", ", mqttPacketTypeName(t), (unsigned long long)packetsByType[t]);
+        first = false;
+    }
+    printf("},\n");
+    printf("  \"captured_s\": %.3f,\n", capturedUs / 1e6);
+    printf("  \"duration_s\": %.3f,\n", durationS);
+    printf("  \"packets_per_s\": %.0f,\n", durationS > 0 ? packets / durationS : 0.0);
+    printf("  \"process_us\": {\"total\": %.0f, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n", processTotal / 1000.0,
+           percentileUs(processNs, 0.5), percentileUs(processNs, 0.99), percentileUs(processNs, 1.0));
+    if (speed > 0)
+        printf("  \"lag_us\": {\"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n", percentileUs(lagNs, 0.5), percentileUs(lagNs, 0.99),
+               percentileUs(lagNs, 1.0));
+    printf("  \"broker\": {\"routed\": %u, \"delivered\": %u, \"dropped\": %u, \"retries\": %u, \"retained\": %u}\n",
+           m[MQTTMetric::PublishRouted], m[MQTTMetric::PublishDelivered], m[MQTTMetric::PublishDropped], m[MQTTMetric::QoSRetries],
+           m[MQTTMetric::RetainedCount]);
+    printf("}\n");
+    return 0;
+}
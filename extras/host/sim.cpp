@@ -0,0 +1,458 @@
+// Deterministische Simulation: Broker und MQTT-Clients auf SimNet (virtuelles Netz, virtuelle Uhr).
+//
+// Abonnenten (QoS 1 auf sim/#), Publisher mit fester Rate und stille Clients, die nach dem
+// CONNECT nichts mehr senden (Keep-Alive-Abbruch nach 1,5 x Keep-Alive). Ein Teil der Abonnenten
+// liest zeitweise nicht (Sendepuffer voll, QoS-Wiederholungen, Überlast der Sendewarteschlange),
+// abgebrochene Clients verbinden sich nach einer Sekunde neu. Ergebnis als JSON auf stdout;
+// "digest" ist bei gleichem Seed und gleichen Optionen immer gleich.
+//
+// Bauen und starten (aus extras/host):
+//   make mqtt_sim
+//   ./mqtt_sim --subscribers=20 --publishers=5 --rate=20 --duration=120 --seed=1
+//              [--latency=1:20 --split=0.2 --coalesce=0.2 --short=0.1 --reset=0.0005 --stall=0.25]
+//
+// --rate: Nachrichten/s je Publisher, --duration: Sekunden virtuelle Zeit, --latency: ms min:max
+// (Einweg), --split/--coalesce/--short: Wahrscheinlichkeiten je Segment bzw. Schreibvorgang,
+// --reset: Abbruch je Segment, --stall: Anteil der Abonnenten, die alle 15 s für 6 s nicht lesen.
+
+#include "SimNet.h"
+#include "ESPAsyncMQTTBroker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct Options
+{
+    uint32_t subscribers = 20;
+    uint32_t publishers = 5;
+    uint32_t silent = 2;
+    uint32_t rate = 20;
+    uint32_t duration = 120;
+    uint32_t qos = 1;
+    uint32_t payload = 64;
+    uint32_t latencyMinMs = 1;
+    uint32_t latencyMaxMs = 20;
+    double split = 0.2;
+    double coalesce = 0.2;
+    double shortWrite = 0.1;
+    double reset = 0;
+    double stall = 0.25;
+    uint32_t sndbuf = ASYNC_TCP_HOST_SNDBUF;
+    uint32_t window = 16;
+    uint32_t keepAlive = 30;
+    uint64_t seed = 1;
+    int debug = DEBUG_NONE;
+};
+
+struct Stats
+{
+    uint64_t published = 0;
+    uint64_t acked = 0;
+    uint64_t delivered = 0;
+    uint64_t duplicates = 0;
+    uint64_t reconnects = 0;
+    uint64_t stalls = 0;
+    std::vector<int64_t> latencies;      ///< µs virtuelle Zeit
+    std::vector<int64_t> keepAliveCloses; ///< µs vom CONNECT bis zum Schließen (stille Clients)
+};
+
+static Options o;
+static Stats stats;
+static bool shuttingDown = false; ///< beim Abbau nicht mehr neu verbinden
+static const uint16_t Port = 1883;
+
+// ---------------- Pakete ----------------
+
+static void putString(std::string &out, const std::string &s)
+{
+    out += (char)(s.size() >> 8);
+    out += (char)(s.size() & 0xFF);
+    out += s;
+}
+
+static std::string packet(uint8_t header, const std::string &body)
+{
+    std::string out(1, (char)header);
+    size_t len = body.size();
+    do
+    {
+        uint8_t b = len % 128;
+        len /= 128;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+    return out + body;
+}
+
+// ---------------- Clients ----------------
+
+class SimClient
+{
+public:
+    enum Role
+    {
+        Subscriber,
+        Publisher,
+        Silent
+    };
+
+    SimClient(SimNet &net, Role role, const std::string &id) : net(net), role(role), id(id) {}
+
+    void start()
+    {
+        peer = net.connect(Port);
+        if (!peer)
+            return;
+        generation++;
+        in.clear();
+        connectedAt = net.now();
+        peer->onData = [this](SimPeer *p)
+        { handleData(p); };
+        peer->onClose = [this](SimPeer *)
+        { handleClose(); };
+
+        std::string body;
+        putString(body, "MQTT");
+        body += (char)4;    // MQTT 3.1.1
+        body += (char)0x02; // Clean Session
+        uint16_t keepAlive = role == Silent ? 10 : o.keepAlive;
+        body += (char)(keepAlive >> 8);
+        body += (char)(keepAlive & 0xFF);
+        putString(body, id);
+        peer->send(packet(0x10, body));
+
+        if (role == Subscriber)
+        {
+            std::string sub(2, '\0');
+            sub[1] = 1;
+            putString(sub, "sim/#");
+            sub += (char)o.qos;
+            peer->send(packet(0x82, sub));
+        }
+        if (role != Silent)
+            schedulePing();
+    }
+
+    void startStalling()
+    {
+        // Alle 15 s für 6 s nicht lesen (länger als MQTT_RETRY_TIMEOUT_MS)
+        uint32_t g = generation;
+        net.after(15000000, [this, g]
+                  {
+            if (g != generation || !peer->connected())
+                return;
+            stats.stalls++;
+            peer->setStalled(true);
+            net.after(6000000, [this, g]
+                      {
+                if (g == generation)
+                    peer->setStalled(false); });
+            startStalling(); });
+    }
+
+    /// Nächsten PUBLISH mit der Rate des Publishers einplanen
+    void schedulePublish(uint32_t count)
+    {
+        uint32_t g = generation;
+        int64_t interval = 1000000 / std::max<uint32_t>(1, o.rate);
+        net.after(interval / 2 + (int64_t)net.below(interval), [this, g, count]
+                  {
+            if (g != generation || !peer->connected())
+                return;
+            publish(count);
+            schedulePublish(count + 1); });
+    }
+
+    SimPeer *peer = nullptr;
+
+private:
+    void schedulePing()
+    {
+        uint32_t g = generation;
+        net.after((int64_t)o.keepAlive * 500000, [this, g]
+                  {
+            if (g != generation || !peer->connected())
+                return;
+            peer->send(std::string("\xC0\x00", 2));
+            schedulePing(); });
+    }
+
+    void publish(uint32_t count)
+    {
+        char stamp[17];
+        snprintf(stamp, sizeof(stamp), "%016llx", (unsigned long long)net.now());
+        std::string body;
+        putString(body, "sim/" + id + "/" + std::to_string(count % 10));
+        if (o.qos > 0)
+        {
+            nextId = nextId == 0xFFFF ? 1 : nextId + 1;
+            body += (char)(nextId >> 8);
+            body += (char)(nextId & 0xFF);
+        }
+        body += stamp;
+        if (o.payload > 16)
+            body.append(o.payload - 16, 'x');
+        peer->send(packet(0x30 | (o.qos << 1), body));
+        stats.published++;
+    }
+
+    void handleClose()
+    {
+        if (role == Silent)
+        {
+            stats.keepAliveCloses.push_back(net.now() - connectedAt);
+            return;
+        }
+        // Nach einer Sekunde neu verbinden
+        generation++;
+        net.after(1000000, [this]
+                  {
+            if (shuttingDown)
+                return;
+            stats.reconnects++;
+            start();
+            if (role == Subscriber && stalling)
+                startStalling(); });
+    }
+
+    void handleData(SimPeer *p)
+    {
+        in += p->inbox;
+        p->inbox.clear();
+        size_t pos = 0;
+        while (in.size() - pos >= 2)
+        {
+            size_t value = 0, multiplier = 1, idx = pos + 1;
+            bool complete = false;
+            while (idx < in.size() && idx - pos <= 4)
+            {
+                uint8_t b = in[idx++];
+                value += (b & 0x7F) * multiplier;
+                multiplier *= 128;
+                if (!(b & 0x80))
+                {
+                    complete = true;
+                    break;
+                }
+            }
+            if (!complete || in.size() - idx < value)
+                break;
+            handlePacket((uint8_t)in[pos], (const uint8_t *)in.data() + idx, value);
+            pos = idx + value;
+        }
+        in.erase(0, pos);
+    }
+
+    void sendAck(uint8_t header, const uint8_t *packetId)
+    {
+        peer->send(packet(header, std::string((const char *)packetId, 2)));
+    }
+
+    void handlePacket(uint8_t header, const uint8_t *body, size_t len)
+    {
+        switch (header >> 4)
+        {
+        case MQTT_CONNACK:
+            if (role == Publisher)
+                schedulePublish(0);
+            break;
+        case MQTT_PUBLISH:
+        {
+            uint8_t qos = (header >> 1) & 0x03;
+            size_t topicLen = ((size_t)body[0] << 8) | body[1];
+            size_t offset = 2 + topicLen + (qos ? 2 : 0);
+            if (qos == 1)
+                sendAck(0x40, body + 2 + topicLen);
+            else if (qos == 2)
+                sendAck(0x50, body + 2 + topicLen);
+            if (header & 0x08)
+                stats.duplicates++;
+            stats.delivered++;
+            // Source-Präfix "source:[id];" des Brokers überspringen
+            std::string payload((const char *)body + offset, len - offset);
+            size_t start = 0;
+            if (payload.compare(0, 8, "source:[") == 0)
+            {
+                size_t end = payload.find("];");
+                start = end == std::string::npos ? payload.size() : end + 2;
+            }
+            if (payload.size() - start >= 16)
+                stats.latencies.push_back(net.now() - (int64_t)strtoull(payload.substr(start, 16).c_str(), nullptr, 16));
+            break;
+        }
+        case MQTT_PUBREL:
+            sendAck(0x70, body);
+            break;
+        case MQTT_PUBREC:
+            sendAck(0x62, body);
+            break;
+        case MQTT_PUBACK:
+        case MQTT_PUBCOMP:
+            stats.acked++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    SimNet &net;
+    Role role;
+    std::string id;
+    std::string in;
+    uint16_t nextId = 0;
+    uint32_t generation = 0; ///< verwirft geplante Aufgaben einer früheren Verbindung
+    int64_t connectedAt = 0;
+
+public:
+    bool stalling = false;
+};
+
+// ---------------- Ablauf ----------------
+
+static bool parseOption(const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || !eq)
+        return false;
+    std::string key(arg + 2, eq - arg - 2);
+    const char *v = eq + 1;
+    if (key == "subscribers")
+        o.subscribers = atoi(v);
+    else if (key == "publishers")
+        o.publishers = atoi(v);
+    else if (key == "silent")
+        o.silent = atoi(v);
+    else if (key == "rate")
+        o.rate = std::max(1, atoi(v));
+    else if (key == "duration")
+        o.duration = atoi(v);
+    else if (key == "qos")
+        o.qos = std::min(2, std::max(0, atoi(v)));
+    else if (key == "payload")
+        o.payload = std::max(16, atoi(v));
+    else if (key == "latency")
+        return sscanf(v, "%u:%u", &o.latencyMinMs, &o.latencyMaxMs) == 2;
+    else if (key == "split")
+        o.split = atof(v);
+    else if (key == "coalesce")
+        o.coalesce = atof(v);
+    else if (key == "short")
+        o.shortWrite = atof(v);
+    else if (key == "reset")
+        o.reset = atof(v);
+    else if (key == "stall")
+        o.stall = atof(v);
+    else if (key == "sndbuf")
+        o.sndbuf = std::max(64, atoi(v));
+    else if (key == "window")
+        o.window = std::max(1, atoi(v));
+    else if (key == "keepalive")
+        o.keepAlive = std::max(2, atoi(v));
+    else if (key == "seed")
+        o.seed = strtoull(v, nullptr, 10);
+    else if (key == "debug")
+        o.debug = atoi(v);
+    else
+        return false;
+    return true;
+}
+
+static double percentileMs(std::vector<int64_t> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!parseOption(argv[i]))
+        {
+            fprintf(stderr, "Unbekannte Option: %s (Format --name=wert, siehe Kopf von sim.cpp)\n", argv[i]);
+            return 1;
+        }
+    }
+
+    SimNetConfig netConfig;
+    netConfig.latencyMinUs = o.latencyMinMs * 1000;
+    netConfig.latencyMaxUs = o.latencyMaxMs * 1000;
+    netConfig.splitProbability = o.split;
+    netConfig.coalesceProbability = o.coalesce;
+    netConfig.shortWriteProbability = o.shortWrite;
+    netConfig.resetProbability = o.reset;
+    netConfig.sendBuffer = o.sndbuf;
+    SimNet net(o.seed, netConfig);
+
+    auto wallStart = std::chrono::steady_clock::now();
+    MQTTMetricsSnapshot m;
+    {
+        ESPAsyncMQTTBroker broker(Port);
+        broker.setDebugLevel((DebugLevel)o.debug);
+        ESPAsyncMQTTBrokerConfig config;
+        config.maxInflightMessages = o.window;
+        broker.setConfig(config);
+        broker.begin();
+        auto loop = [&]
+        { broker.loop(); };
+
+        std::vector<std::unique_ptr<SimClient>> clients;
+        for (uint32_t i = 0; i < o.subscribers; i++)
+        {
+            clients.emplace_back(new SimClient(net, SimClient::Subscriber, "sub" + std::to_string(i)));
+            clients.back()->stalling = net.unit() < o.stall;
+        }
+        for (uint32_t i = 0; i < o.publishers; i++)
+            clients.emplace_back(new SimClient(net, SimClient::Publisher, "pub" + std::to_string(i)));
+        for (uint32_t i = 0; i < o.silent; i++)
+            clients.emplace_back(new SimClient(net, SimClient::Silent, "silent" + std::to_string(i)));
+        for (auto &c : clients)
+        {
+            c->start();
+            if (c->stalling)
+                c->startStalling();
+        }
+
+        net.runFor((int64_t)o.duration * 1000000, loop);
+        shuttingDown = true;
+        net.closeAll(loop);
+        m = broker.getMetrics();
+        broker.stop();
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+
+    printf("{\n");
+    printf("  \"config\": {\"subscribers\": %u, \"publishers\": %u, \"silent\": %u, \"rate\": %u, \"duration_s\": %u, \"qos\": %u, "
+           "\"latency_ms\": [%u, %u], \"split\": %.3f, \"coalesce\": %.3f, \"short\": %.3f, \"reset\": %.5f, \"stall\": %.2f, "
+           "\"sndbuf\": %u, \"window\": %u, \"seed\": %llu},\n",
+           o.subscribers, o.publishers, o.silent, o.rate, o.duration, o.qos, o.latencyMinMs, o.latencyMaxMs, o.split, o.coalesce,
+           o.shortWrite, o.reset, o.stall, o.sndbuf, o.window, (unsigned long long)o.seed);
+    printf("  \"wall_ms\": %.1f,\n", wallMs);
+    printf("  \"speedup\": %.1f,\n", wallMs > 0 ? o.duration * 1000.0 / wallMs : 0.0);
+    printf("  \"events\": %llu,\n", (unsigned long long)net.events());
+    printf("  \"published\": %llu,\n", (unsigned long long)stats.published);
+    printf("  \"acked\": %llu,\n", (unsigned long long)stats.acked);
+    printf("  \"delivered\": %llu,\n", (unsigned long long)stats.delivered);
+    printf("  \"duplicates\": %llu,\n", (unsigned long long)stats.duplicates);
+    printf("  \"stalls\": %llu,\n", (unsigned long long)stats.stalls);
+    printf("  \"resets\": %llu,\n", (unsigned long long)net.resets());
+    printf("  \"reconnects\": %llu,\n", (unsigned long long)stats.reconnects);
+    printf("  \"short_writes\": %llu,\n", (unsigned long long)net.shortWrites());
+    printf("  \"latency_ms\": {\"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n", percentileMs(stats.latencies, 0.5),
+           percentileMs(stats.latencies, 0.99), percentileMs(stats.latencies, 1.0));
+    std::sort(stats.keepAliveCloses.begin(), stats.keepAliveCloses.end());
+    printf("  \"keepalive_close_s\": [");
+    for (size_t i = 0; i < stats.keepAliveCloses.size(); i++)
+        printf("%s%.2f", i ? ", " : "", stats.keepAliveCloses[i] / 1e6);
+    printf("],\n");
+    printf("  \"broker\": {\"routed\": %u, \"delivered\": %u, \"dropped\": %u, \"retries\": %u, \"discarded\": %u},\n",
+           m[MQTTMetric::PublishRouted], m[MQTTMetric::PublishDelivered], m[MQTTMetric::PublishDropped], m[MQTTMetric::QoSRetries],
+           m[MQTTMetric::QoSDiscarded]);
+    printf("  \"digest\": \"%016llx\"\n", (unsigned long long)net.digest());
+    printf("}\n");
+    return 0;
+}
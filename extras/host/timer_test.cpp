@@ -0,0 +1,418 @@
+// Tests für das Timer-Rad (MQTTTimerWheel) und checkTimeouts() auf der virtuellen Uhr von SimNet.
+//
+// Das Rad wird direkt getrieben (Planen, verworfene Einträge über Token, Fristen über mehrere
+// Radumdrehungen, Überlauf der Millisekunden-Uhr, Aufwand je Tick), der Broker über SimNet:
+// Keep-Alive-Abbruch nach 1,5 x Keep-Alive, aufgefrischtes Keep-Alive, QoS-1-Wiederholung nach
+// MQTT_RETRY_TIMEOUT_MS und Verwerfen nach MQTT_MAX_RETRIES. Die virtuelle Uhr startet kurz vor
+// dem Überlauf von millis(), alle Broker-Fristen laufen also über die Grenze.
+//
+// Bauen und starten (aus extras/host):
+//   make test
+// Exit-Code 0, wenn alle Prüfungen bestehen; fehlgeschlagene Prüfungen mit Datei und Zeile auf stderr.
+
+#include "SimNet.h"
+#include "ESPAsyncMQTTBroker.h"
+#include "MQTTTimerWheel.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ESPAsyncMQTTBrokerTestAccess
+{
+    static size_t timerEntries(ESPAsyncMQTTBroker &broker) { return broker.timerWheel.size(); }
+};
+
+using Access = ESPAsyncMQTTBrokerTestAccess;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                      \
+    do                                                                   \
+    {                                                                    \
+        if (!(cond))                                                     \
+        {                                                                \
+            fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                  \
+        }                                                                \
+    } while (0)
+
+// ---------------- Timer-Rad ----------------
+
+static void testScheduleAndAdvance()
+{
+    MQTTTimerWheel<int> wheel(100, 128);
+    std::vector<int> fired;
+    auto collect = [&](int v)
+    { fired.push_back(v); };
+
+    wheel.advance(1000, collect); // Start
+    wheel.schedule(1250, 1);
+    wheel.schedule(1250, 2);
+    wheel.schedule(1410, 3);
+    CHECK(wheel.size() == 3);
+
+    wheel.advance(1200, collect);
+    CHECK(fired.empty());
+    wheel.advance(1249, collect);
+    CHECK(fired.empty()); // gleicher Slot, Frist noch nicht erreicht
+    wheel.advance(1250, collect);
+    CHECK(fired.size() == 2);
+    wheel.advance(1400, collect);
+    CHECK(fired.size() == 2);
+    wheel.advance(1410, collect);
+    CHECK(fired.size() == 3 && fired.back() == 3);
+    CHECK(wheel.size() == 0);
+
+    // Frist in der Vergangenheit: läuft beim nächsten advance() ab
+    wheel.schedule(500, 4);
+    wheel.advance(1410, collect);
+    CHECK(fired.size() == 4 && fired.back() == 4);
+}
+
+static void testLazyCancel()
+{
+    // Der Aufrufer verwirft Einträge über ein Token (wie timerToken im Broker)
+    MQTTTimerWheel<std::pair<int, uint32_t>> wheel(100, 128);
+    std::map<int, uint32_t> current;
+    uint32_t nextToken = 0;
+    std::vector<int> fired;
+    auto plan = [&](int key, uint32_t deadline)
+    {
+        current[key] = ++nextToken;
+        wheel.schedule(deadline, {key, nextToken});
+    };
+    auto handle = [&](const std::pair<int, uint32_t> &e)
+    {
+        auto it = current.find(e.first);
+        if (it == current.end() || it->second != e.second)
+            return; // abgesagt oder neu geplant
+        current.erase(it);
+        fired.push_back(e.first);
+    };
+
+    wheel.advance(0, handle);
+    plan(1, 500);
+    plan(2, 500);
+    plan(3, 700);
+    current.erase(2); // absagen
+    plan(3, 900);     // verschieben: der Eintrag bei 700 wird ungültig
+
+    wheel.advance(600, handle);
+    CHECK(fired.size() == 1 && fired[0] == 1);
+    wheel.advance(800, handle);
+    CHECK(fired.size() == 1);
+    wheel.advance(900, handle);
+    CHECK(fired.size() == 2 && fired[1] == 3);
+    CHECK(wheel.size() == 0); // auch die ungültigen Einträge sind abgebaut
+}
+
+static void testWrapPastSlots()
+{
+    // Fristen mehrere Radumdrehungen (128 x 100 ms) voraus laufen weder früher noch mehrfach ab
+    MQTTTimerWheel<int> wheel(100, 128);
+    int fired = 0;
+    uint32_t firedAt = 0;
+    uint32_t now = 0;
+    wheel.advance(now, [](int) {});
+    const uint32_t deadline = 3 * 12800 + 4250;
+    wheel.schedule(deadline, 1);
+    for (now = 100; now <= deadline + 1000; now += 100)
+    {
+        wheel.advance(now, [&](int)
+                      { fired++; firedAt = now; });
+    }
+    CHECK(fired == 1);
+    CHECK(firedAt == (deadline / 100 + 1) * 100); // erster Tick nach der Frist
+
+    // Lange Pause (mehr als eine Umdrehung): jeder Slot einmal, alle fälligen Einträge genau einmal
+    fired = 0;
+    for (int i = 0; i < 300; i++)
+        wheel.schedule(now + 1 + i * 97, i);
+    wheel.schedule(now + 40000, 999);
+    wheel.advance(now + 30000, [&](int)
+                  { fired++; });
+    CHECK(fired == 300);
+    CHECK(wheel.size() == 1);
+    CHECK(wheel.scanned() <= 301);
+}
+
+static void testMillisOverflow()
+{
+    // millis() läuft nach ~49 Tagen über; Fristen jenseits der Grenze dürfen nicht sofort ablaufen
+    MQTTTimerWheel<int> wheel(100, 128);
+    int fired = 0;
+    auto count = [&](int)
+    { fired++; };
+    uint32_t now = 0xFFFFFF00u;
+    wheel.advance(now, count);
+    wheel.schedule(now + 1500, 1); // nach dem Überlauf
+    for (int i = 0; i < 14; i++)
+    {
+        now += 100;
+        wheel.advance(now, count);
+    }
+    CHECK(fired == 0);
+    now += 100;
+    wheel.advance(now, count);
+    CHECK(fired == 1);
+}
+
+static void testWorkPerTick()
+{
+    // Aufwand je Tick ~ abgelaufene Einträge: 10000 Fristen über eine Umdrehung verteilt plus
+    // 1000 Einträge drei Umdrehungen voraus in einem einzigen Slot
+    MQTTTimerWheel<int> wheel(100, 128);
+    uint32_t now = 50;
+    wheel.advance(now, [](int) {});
+    const uint32_t farTime = 3 * 12800 + 6420; // drei Runden voraus, alle im selben Slot
+    for (int i = 0; i < 10000; i++)
+        wheel.schedule(now + 1 + (uint32_t)(i * 12700ULL / 10000), i);
+    for (int i = 0; i < 1000; i++)
+        wheel.schedule(farTime, -1);
+
+    size_t total = 0;
+    size_t scannedTotal = 0;
+    size_t maxScanned = 0;
+    for (int tick = 1; tick <= 128; tick++)
+    {
+        now += 100;
+        wheel.advance(now, [&](int v)
+                      { total += v >= 0; });
+        scannedTotal += wheel.scanned();
+        maxScanned = std::max(maxScanned, wheel.scanned());
+    }
+    CHECK(total == 10000);
+    CHECK(wheel.size() == 1000);
+    // advance() besucht den angebrochenen Slot und die neuen: jeder Eintrag wird höchstens
+    // zweimal je Umdrehung geprüft, nie alle 11000 in einem Tick
+    CHECK(scannedTotal <= 2 * 11000);
+    CHECK(maxScanned <= 1000 + 2 * 80);
+
+    // Ein Tick ohne fällige Einträge prüft nichts
+    wheel.advance(now + 100, [](int) {});
+    CHECK(wheel.scanned() == 0);
+}
+
+// ---------------- Broker auf der virtuellen Uhr ----------------
+
+static std::string str(const std::string &s)
+{
+    return std::string(1, (char)(s.size() >> 8)) + (char)(s.size() & 0xFF) + s;
+}
+
+static std::string packet(uint8_t header, const std::string &body)
+{
+    std::string out(1, (char)header);
+    size_t len = body.size();
+    do
+    {
+        uint8_t b = len % 128;
+        len /= 128;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+    return out + body;
+}
+
+static std::string connectPacket(const std::string &clientId, uint16_t keepAlive)
+{
+    std::string body = str("MQTT") + (char)4 + (char)0x02 + (char)(keepAlive >> 8) + (char)(keepAlive & 0xFF) + str(clientId);
+    return packet(0x10, body);
+}
+
+/// Gegenstelle, die alle empfangenen Pakete mit Zeitstempel sammelt
+struct TestPeer
+{
+    struct Packet
+    {
+        uint8_t header;
+        std::string body;
+        int64_t time;
+    };
+
+    TestPeer(SimNet &net, const std::string &clientId, uint16_t keepAlive) : net(net)
+    {
+        peer = net.connect(1883);
+        peer->onData = [this](SimPeer *p)
+        { parse(p); };
+        peer->onClose = [this](SimPeer *)
+        { closedAt = this->net.now(); };
+        connectedAt = net.now();
+        peer->send(connectPacket(clientId, keepAlive));
+    }
+
+    size_t count(uint8_t type) const
+    {
+        size_t n = 0;
+        for (const Packet &p : packets)
+            n += (p.header >> 4) == type;
+        return n;
+    }
+
+    const Packet *last(uint8_t type) const
+    {
+        for (auto it = packets.rbegin(); it != packets.rend(); ++it)
+            if ((it->header >> 4) == type)
+                return &*it;
+        return nullptr;
+    }
+
+    SimNet &net;
+    SimPeer *peer = nullptr;
+    std::vector<Packet> packets;
+    std::string in;
+    int64_t connectedAt = 0;
+    int64_t closedAt = -1;
+
+private:
+    void parse(SimPeer *p)
+    {
+        in += p->inbox;
+        p->inbox.clear();
+        size_t pos = 0;
+        while (in.size() - pos >= 2)
+        {
+            size_t value = 0, multiplier = 1, idx = pos + 1;
+            bool complete = false;
+            while (idx < in.size() && idx - pos <= 4)
+            {
+                uint8_t b = in[idx++];
+                value += (b & 0x7F) * multiplier;
+                multiplier *= 128;
+                if (!(b & 0x80))
+                {
+                    complete = true;
+                    break;
+                }
+            }
+            if (!complete || in.size() - idx < value)
+                break;
+            packets.push_back(Packet{(uint8_t)in[pos], in.substr(idx, value), net.now()});
+            pos = idx + value;
+        }
+        in.erase(0, pos);
+    }
+};
+
+static void testKeepAliveClose(SimNet &net, ESPAsyncMQTTBroker &broker, const std::function<void()> &loop)
+{
+    // Keep-Alive 2 s, danach still: Abbruch nach 1,5 x 2 s (+ ein Tick des Timer-Rads)
+    TestPeer silent(net, "silent", 2);
+    net.runFor(2900000, loop);
+    CHECK(silent.count(MQTT_CONNACK) == 1);
+    CHECK(silent.closedAt < 0);
+    net.runFor(1000000, loop);
+    CHECK(silent.closedAt >= 0);
+    int64_t after = silent.closedAt - silent.connectedAt;
+    CHECK(after > 3000000 && after <= 3000000 + MQTT_TIMER_TICK_MS * 1000 + 20000);
+}
+
+static void testKeepAliveRefresh(SimNet &net, ESPAsyncMQTTBroker &broker, const std::function<void()> &loop)
+{
+    // PINGREQ jede Sekunde hält die Verbindung offen; das Rad wächst dabei nicht
+    TestPeer active(net, "active", 2);
+    size_t maxEntries = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        net.runFor(1000000, loop);
+        active.peer->send(std::string("\xC0\x00", 2));
+        maxEntries = std::max(maxEntries, Access::timerEntries(broker));
+    }
+    net.runFor(100000, loop);
+    CHECK(active.closedAt < 0);
+    CHECK(active.count(MQTT_PINGRESP) == 20);
+    CHECK(maxEntries <= 2);
+
+    active.peer->close();
+    net.runFor(100000, loop);
+}
+
+static void testQoSRetry(SimNet &net, ESPAsyncMQTTBroker &broker, const std::function<void()> &loop)
+{
+    TestPeer sub(net, "retry-sub", 60);
+    TestPeer pub(net, "retry-pub", 60);
+    sub.peer->send(packet(0x82, std::string("\x00\x01", 2) + str("retry/#") + (char)1));
+    net.runFor(100000, loop);
+    CHECK(sub.count(MQTT_SUBACK) == 1);
+
+    // QoS 1 veröffentlichen (zugestellt wird mit min(QoS Publisher, QoS Abo)).
+    // Nicht bestätigt: DUP-Wiederholung nach MQTT_RETRY_TIMEOUT_MS, verworfen nach MQTT_MAX_RETRIES
+    uint32_t retriesBefore = broker.getMetrics()[MQTTMetric::QoSRetries];
+    uint32_t discardedBefore = broker.getMetrics()[MQTTMetric::QoSDiscarded];
+    pub.peer->send(packet(0x32, str("retry/a") + std::string("\x00\x01", 2) + "one"));
+    net.runFor(100000, loop);
+    CHECK(sub.count(MQTT_PUBLISH) == 1);
+    const TestPeer::Packet *first = sub.last(MQTT_PUBLISH);
+    CHECK(first && (first->header & 0x08) == 0);
+    int64_t sentAt = first ? first->time : 0;
+
+    net.runFor(MQTT_RETRY_TIMEOUT_MS * 1000 - 200000, loop);
+    CHECK(sub.count(MQTT_PUBLISH) == 1);
+    net.runFor(400000, loop);
+    CHECK(sub.count(MQTT_PUBLISH) == 2);
+    const TestPeer::Packet *dup = sub.last(MQTT_PUBLISH);
+    CHECK(dup && (dup->header & 0x08) != 0);
+    CHECK(dup && first && dup->body == first->body); // gleiche Packet-ID und Payload
+    CHECK(dup && dup->time - sentAt > MQTT_RETRY_TIMEOUT_MS * 1000);
+
+    net.runFor((int64_t)MQTT_RETRY_TIMEOUT_MS * 1000 * (MQTT_MAX_RETRIES + 1), loop);
+    CHECK(sub.count(MQTT_PUBLISH) == 1 + MQTT_MAX_RETRIES);
+    CHECK(broker.getMetrics()[MQTTMetric::QoSRetries] - retriesBefore == MQTT_MAX_RETRIES);
+    CHECK(broker.getMetrics()[MQTTMetric::QoSDiscarded] - discardedBefore == 1);
+
+    // Rechtzeitig bestätigt: der geplante Eintrag läuft ins Leere, keine Wiederholung
+    pub.peer->send(packet(0x32, str("retry/b") + std::string("\x00\x02", 2) + "two"));
+    net.runFor(100000, loop);
+    const TestPeer::Packet *second = sub.last(MQTT_PUBLISH);
+    CHECK(second && (second->header & 0x08) == 0);
+    if (second)
+    {
+        size_t topicLen = ((uint8_t)second->body[0] << 8) | (uint8_t)second->body[1];
+        sub.peer->send(packet(0x40, second->body.substr(2 + topicLen, 2)));
+    }
+    size_t published = sub.count(MQTT_PUBLISH);
+    net.runFor(MQTT_RETRY_TIMEOUT_MS * 3000, loop);
+    CHECK(sub.count(MQTT_PUBLISH) == published);
+    CHECK(broker.getMetrics()[MQTTMetric::QoSRetries] - retriesBefore == MQTT_MAX_RETRIES);
+
+    sub.peer->close();
+    pub.peer->close();
+    net.runFor(100000, loop);
+}
+
+int main()
+{
+    testScheduleAndAdvance();
+    testLazyCancel();
+    testWrapPastSlots();
+    testMillisOverflow();
+    testWorkPerTick();
+
+    // Virtuelle Uhr 2 s vor dem Überlauf von millis(): der Keep-Alive-Abbruch liegt dahinter
+    SimNetConfig netConfig;
+    netConfig.startUs = (0x100000000LL - 2000) * 1000;
+    SimNet net(1, netConfig);
+    {
+        ESPAsyncMQTTBroker broker(1883);
+        broker.setDebugLevel(DEBUG_NONE);
+        broker.begin();
+        auto loop = [&]
+        { broker.loop(); };
+
+        testKeepAliveClose(net, broker, loop);
+        testKeepAliveRefresh(net, broker, loop);
+        testQoSRetry(net, broker, loop);
+
+        net.closeAll(loop);
+        broker.stop();
+    }
+
+    if (failures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("timer tests passed\n");
+    return 0;
+}
@@ -11,85 +11,104 @@ static inline void sendConnackAndClose(MQTTClient *client, uint8_t returnCode)
 
 {
 
-    uint8_t connack[] = {0x20, 0x02, 0x00, returnCode};
+    if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
 
-    client->client->write((const char *)connack, sizeof(connack));
+    {
 
-    client->client->close();
-}
+        // MQTT 5: Reason Code statt 3.1.1-Return-Code, danach leere Properties
+        static const uint8_t reasonCodes[] = {0x00, 0x84, 0x85, 0x88, 0x86, 0x87};
 
-uint16_t ESPAsyncMQTTBroker::getNextPacketId()
+        uint8_t connack[] = {0x20, 0x03, 0x00, returnCode < sizeof(reasonCodes) ? reasonCodes[returnCode] : (uint8_t)0x80, 0x00};
 
-{
+        client->client->write((const char *)connack, sizeof(connack));
+    }
 
-    if (nextPacketId == 0)
+    else
 
     {
 
-        nextPacketId = 1;
+        uint8_t connack[] = {0x20, 0x02, 0x00, returnCode};
+
+        client->client->write((const char *)connack, sizeof(connack));
     }
 
-    return nextPacketId++;
+    client->client->close();
 }
 
 // Zentrale Logging-Funktion
 
-void ESPAsyncMQTTBroker::logMessage(DebugLevel level, const char *format, ...)
+void ESPAsyncMQTTBroker::writeLog(DebugLevel level, const char *format, ...)
 
 {
 
-    if (debugLevel == DEBUG_NONE)
-        return; // Keine Ausgabe wenn DEBUG_NONE gesetzt
+    char buffer[256];
 
-    if (level <= debugLevel)
+    va_list args;
 
-    {
+    va_start(args, format);
 
-        char buffer[256];
+    vsnprintf(buffer, sizeof(buffer), format, args);
 
-        va_list args;
+    va_end(args);
 
-        va_start(args, format);
+    emitLog(level, buffer);
+}
 
-        vsnprintf(buffer, sizeof(buffer), format, args);
+void ESPAsyncMQTTBroker::emitLog(DebugLevel level, const char *message)
 
-        va_end(args);
+{
 
-        String message = buffer;
+    // Log ausgeben (Serial oder über Callback)
 
-        // Log ausgeben (Serial oder über Callback)
+    if (level <= DEBUG_ERROR)
 
-        if (level <= DEBUG_ERROR)
+    {
 
-        {
+        Serial.print("❌ ");
+    }
 
-            Serial.print("❌ ");
-        }
+    else if (level <= DEBUG_INFO)
 
-        else if (level <= DEBUG_INFO)
+    {
 
-        {
+        Serial.print("ℹ️ ");
+    }
 
-            Serial.print("ℹ️ ");
-        }
+    else
 
-        else
+    {
 
-        {
+        Serial.print("🔍 ");
+    }
 
-            Serial.print("🔍 ");
-        }
+    Serial.println(message);
 
-        Serial.println(message);
+    // Wenn verfügbar, auch an Callback weiterleiten
 
-        // Wenn verfügbar, auch an Callback weiterleiten
+    if (loggingCallback)
 
-        if (loggingCallback)
+    {
 
-        {
+        loggingCallback(level, String(message));
+    }
+}
 
-            loggingCallback(level, message);
-        }
+void ESPAsyncMQTTBroker::drainLog()
+{
+    // Gesammelte Log-Einträge außerhalb der AsyncTCP-Callbacks formatieren und ausgeben
+    if (!logRing)
+        return;
+    uint32_t dropped = logRing->takeDropped();
+    if (dropped > 0)
+    {
+        writeLog(DEBUG_WARNING, "Log ring full, %u log messages dropped.", (unsigned)dropped);
+    }
+
+    char buffer[256];
+    uint8_t level;
+    while (logRing->pop(level, buffer, sizeof(buffer)))
+    {
+        emitLog((DebugLevel)level, buffer);
     }
 }
 
@@ -120,22 +139,85 @@ ESPAsyncMQTTBroker::~ESPAsyncMQTTBroker()
 
 size_t ESPAsyncMQTTBroker::getConnectedClientCount() const
 {
-    size_t count = 0;
-    for (const auto &kv : clients)
+    return metrics.get(MQTTMetric::ClientsConnected);
+}
+
+void ESPAsyncMQTTBroker::setConnected(MQTTClient *client, bool connected)
+{
+    // Messwert nur bei einem echten Wechsel anpassen
+    if (client->connected == connected)
+        return;
+    client->connected = connected;
+    if (connected)
+        metrics.add(MQTTMetric::ClientsConnected);
+    else
+        metrics.sub(MQTTMetric::ClientsConnected);
+}
+
+void ESPAsyncMQTTBroker::publishSysTopics()
+{
+    MQTTMetricsSnapshot snap = metrics.snapshot();
+    char topic[64];
+    char value[16];
+
+    for (size_t i = 0; i < (size_t)MQTTMetric::Count; i++)
     {
-        const auto &c = kv.second;
-        if (c && c->connected)
-        {
-            count++;
-        }
+        snprintf(topic, sizeof(topic), "$SYS/broker/%s", mqttMetricTopic((MQTTMetric)i));
+        snprintf(value, sizeof(value), "%u", (unsigned)snap.values[i]);
+        publish(topic, value, true, 0);
+    }
+
+    snprintf(value, sizeof(value), "%u", (unsigned)snap.totalPacketsIn());
+    publish("$SYS/broker/messages/received", value, true, 0);
+    snprintf(value, sizeof(value), "%u", (unsigned)snap.totalPacketsOut());
+    publish("$SYS/broker/messages/sent", value, true, 0);
+
+    for (uint8_t type = MQTT_CONNECT; type <= 15; type++)
+    {
+        if (snap.packetsIn[type] == 0 && snap.packetsOut[type] == 0)
+            continue;
+        snprintf(topic, sizeof(topic), "$SYS/broker/packets/received/%s", mqttPacketTypeName(type));
+        snprintf(value, sizeof(value), "%u", (unsigned)snap.packetsIn[type]);
+        publish(topic, value, true, 0);
+        snprintf(topic, sizeof(topic), "$SYS/broker/packets/sent/%s", mqttPacketTypeName(type));
+        snprintf(value, sizeof(value), "%u", (unsigned)snap.packetsOut[type]);
+        publish(topic, value, true, 0);
     }
-    return count;
+
+    snprintf(value, sizeof(value), "%lu", (unsigned long)(millis() / 1000));
+    publish("$SYS/broker/uptime", value, true, 0);
 }
 
+#ifdef MQTT_CAPTURE
+void ESPAsyncMQTTBroker::setCaptureSink(MQTTCaptureSink sink)
+{
+    if (sink)
+        capture.begin(sink, esp_timer_get_time());
+    else
+        capture.end();
+}
+#endif
+
+#ifdef MQTT_TRACE
+void ESPAsyncMQTTBroker::logTraceReport()
+{
+    for (size_t i = 0; i < (size_t)MQTTTraceStage::Count; i++)
+    {
+        const MQTTTraceHistogram &h = mqttTraceHistogram((MQTTTraceStage)i);
+        MQTT_LOG(DEBUG_INFO, "trace %-8s n=%u mean=%llu p50<=%llu p99<=%llu max=%llu", mqttTraceStageName((MQTTTraceStage)i),
+                 (unsigned)h.count, (unsigned long long)h.mean(), (unsigned long long)h.percentile(50),
+                 (unsigned long long)h.percentile(99), (unsigned long long)h.max);
+    }
+}
+#endif
+
 void ESPAsyncMQTTBroker::begin()
 
 {
 
+    if (brokerConfig.deferredLogging && !logRing)
+        logRing.reset(new MQTTLogRing()); // Standardkonfiguration ohne setConfig()
+
     server.reset(new AsyncServer(port));
 
     server->onClient([](void *arg, AsyncClient *client)
@@ -170,7 +252,7 @@ void ESPAsyncMQTTBroker::begin()
 
     esp_timer_create(&timer_args, &timeoutTimer);
 
-    esp_timer_start_periodic(timeoutTimer, 1000000); // 1 second
+    esp_timer_start_periodic(timeoutTimer, MQTT_TIMER_TICK_MS * 1000); // Auflösung des Timer-Rads
 }
 
 void ESPAsyncMQTTBroker::loop()
@@ -180,6 +262,37 @@ void ESPAsyncMQTTBroker::loop()
         checkTimeoutsFlag = false;
         checkTimeouts();
     }
+
+    if (closeClientsFlag)
+    {
+        // Nicht im Sende- oder Parserpfad schließen: onDisconnect gibt den Client sofort frei,
+        // publish(), sendRetainedMessages() und processPacket() könnten ihn danach noch verwenden
+        closeClientsFlag = false;
+        std::vector<AsyncClient *> overflowed;
+        std::vector<AsyncClient *> requested;
+        for (auto &entry : clients)
+        {
+            if (entry.second->outboundOverflow)
+                overflowed.push_back(entry.first);
+            else if (entry.second->closeRequested)
+                requested.push_back(entry.first);
+        }
+        for (AsyncClient *asyncClient : overflowed)
+            asyncClient->close(true);
+        for (AsyncClient *asyncClient : requested)
+        {
+            drainOutbound(clients[asyncClient].get()); // DISCONNECT noch mitgeben
+            asyncClient->close();
+        }
+    }
+
+    if (brokerConfig.sysInterval > 0 && millis() - lastSysPublish >= brokerConfig.sysInterval * 1000UL)
+    {
+        lastSysPublish = millis();
+        publishSysTopics();
+    }
+
+    drainLog();
 }
 
 void ESPAsyncMQTTBroker::stop()
@@ -205,106 +318,118 @@ void ESPAsyncMQTTBroker::stop()
 
         server.reset();
     }
+
+#ifdef MQTT_CAPTURE
+    capture.flush();
+#endif
+
+    drainLog(); // Noch gepufferte Log-Zeilen ausgeben
 }
 
 void ESPAsyncMQTTBroker::checkTimeouts()
 {
+    // Nur abgelaufene Fristen aus dem Timer-Rad bearbeiten statt alle Clients/Nachrichten zu scannen
     uint32_t now = millis();
-    const uint32_t retryTimeout = 5000; // 5 seconds
-    const uint8_t maxRetries = 3;
+    timerWheel.advance(now, [this, now](const MQTTTimerRef &ref)
+                       { handleTimer(ref, now); });
+}
 
-    for (auto it = clients.begin(); it != clients.end();)
+void ESPAsyncMQTTBroker::scheduleKeepAlive(MQTTClient *client)
+{
+    if (client->keepAlive > 0)
     {
-        auto &mqttClient = it->second;
+        MQTTTimerRef ref = {client->client, client->serial, 0, MQTTTimerRef::KeepAlive};
+        timerWheel.schedule(client->lastActivity + client->keepAlive * 1500UL + 1, ref);
+    }
+}
 
-        // Check for client keep-alive timeout
-        if (mqttClient->connected && mqttClient->keepAlive > 0 &&
-            (now - mqttClient->lastActivity > mqttClient->keepAlive * 1500UL))
+void ESPAsyncMQTTBroker::scheduleRetry(MQTTClient *client, OutgoingQoSMessage &outMsg)
+{
+    outMsg.timerToken = ++timerTokenCounter;
+    MQTTTimerRef ref = {client->client, outMsg.timerToken, outMsg.packetId, MQTTTimerRef::Retry};
+    timerWheel.schedule(outMsg.sentTime + MQTT_RETRY_TIMEOUT_MS + 1, ref);
+}
+
+void ESPAsyncMQTTBroker::handleTimer(const MQTTTimerRef &ref, uint32_t now)
+{
+    // Der Client kann inzwischen getrennt (oder die AsyncClient-Adresse neu vergeben) sein
+    auto it = clients.find(ref.client);
+    if (it == clients.end())
+        return;
+    MQTTClient *mqttClient = it->second.get();
+
+    if (ref.kind == MQTTTimerRef::KeepAlive)
+    {
+        if (mqttClient->serial != ref.token || !mqttClient->connected || mqttClient->keepAlive == 0)
+            return;
+
+        // Check for client keep-alive timeout (1.5 x Keep-Alive seit der letzten Aktivität)
+        if (now - mqttClient->lastActivity > mqttClient->keepAlive * 1500UL)
         {
-            logMessage(DEBUG_INFO, "Client ⏰ inactive, disconnecting: %s", mqttClient->clientId.c_str());
-            AsyncClient *clientToClose = mqttClient->client;
-            it++;
-            clientToClose->close();
+            MQTT_LOG(DEBUG_INFO, "Client ⏰ inactive, disconnecting: %s", mqttClient->clientId.c_str());
+            mqttClient->client->close();
         }
         else
         {
-            // Check for outgoing QoS message timeouts
-            for (auto msgIt = mqttClient->outgoingMessages.begin(); msgIt != mqttClient->outgoingMessages.end();)
-            {
-                auto &outMsg = msgIt->second;
-                if (now - outMsg.sentTime > retryTimeout)
-                {
-                    if (outMsg.retryCount >= maxRetries)
-                    {
-                        logMessage(DEBUG_ERROR, "QoS %d message for client '%s' (packet ID %u) timed out after %d retries. Discarding.", outMsg.qos, mqttClient->clientId.c_str(), outMsg.packetId, maxRetries);
-                        msgIt = mqttClient->outgoingMessages.erase(msgIt);
-                    }
-                    else
-                    {
-                        logMessage(DEBUG_INFO, "QoS %d message for client '%s' (packet ID %u) timed out. Retrying (%d/%d)...", outMsg.qos, mqttClient->clientId.c_str(), outMsg.packetId, outMsg.retryCount + 1, maxRetries);
-                        outMsg.retryCount++;
-                        outMsg.sentTime = now;
-                        if (outMsg.state == OutgoingQoSState::AwaitingPuback || outMsg.state == OutgoingQoSState::AwaitingPubrec)
-                        {
-                            // BP2-01: Resend PUBLISH with DUP flag — Variable-Length-Encoding für Remaining-Length
-                            size_t topicLen = outMsg.topic.length();
-                            size_t packet_id_len = 2;
-                            size_t remainingLength = 2 + topicLen + packet_id_len + outMsg.payloadLen;
-
-                            // Header-Länge berechnen (1 Byte Fixheader + Variable-Length-Bytes)
-                            size_t header_len = 1;
-                            if (remainingLength <= 127)
-                                header_len += 1;
-                            else if (remainingLength <= 16383)
-                                header_len += 2;
-                            else
-                                header_len += 3;
-
-                            size_t packetSize = header_len + remainingLength;
-                            auto packet = std::unique_ptr<uint8_t[]>(new uint8_t[packetSize]);
-                            uint8_t *ptr = packet.get();
-                            *ptr++ = (MQTT_PUBLISH << 4) | (outMsg.qos << 1) | (outMsg.retain ? 1 : 0) | 0x08; // Set DUP flag
-
-                            // Variable-Length-Encoding
-                            size_t rem_len = remainingLength;
-                            do
-                            {
-                                uint8_t byte = rem_len % 128;
-                                rem_len /= 128;
-                                if (rem_len > 0)
-                                    byte |= 128;
-                                *ptr++ = byte;
-                            } while (rem_len > 0);
-
-                            *ptr++ = topicLen >> 8;
-                            *ptr++ = topicLen & 0xFF;
-                            memcpy(ptr, outMsg.topic.c_str(), topicLen);
-                            ptr += topicLen;
-                            *ptr++ = outMsg.packetId >> 8;
-                            *ptr++ = outMsg.packetId & 0xFF;
-                            if (outMsg.payloadLen > 0)
-                            {
-                                memcpy(ptr, outMsg.payload.get(), outMsg.payloadLen);
-                            }
-                            mqttClient->client->write((const char *)packet.get(), packetSize);
-                        }
-                        else if (outMsg.state == OutgoingQoSState::AwaitingPubcomp)
-                        {
-                            // Resend PUBREL
-                            uint8_t pubrel[] = {0x62, 0x02, (uint8_t)(outMsg.packetId >> 8), (uint8_t)(outMsg.packetId & 0xFF)};
-                            mqttClient->client->write((const char *)pubrel, sizeof(pubrel));
-                        }
-                        ++msgIt;
-                    }
-                }
-                else
-                {
-                    ++msgIt;
-                }
-            }
-            ++it;
+            scheduleKeepAlive(mqttClient); // Aktivität seit der Planung: Frist verschieben
         }
+        return;
     }
+
+    // Check for outgoing QoS message timeouts
+    auto msgIt = mqttClient->outgoingMessages.find(ref.packetId);
+    if (msgIt == mqttClient->outgoingMessages.end() || msgIt->second.timerToken != ref.token)
+        return; // bereits bestätigt oder Packet-ID neu vergeben
+
+    auto &outMsg = msgIt->second;
+    if (now - outMsg.sentTime <= MQTT_RETRY_TIMEOUT_MS)
+    {
+        scheduleRetry(mqttClient, outMsg); // z.B. durch PUBREC aufgefrischt
+        return;
+    }
+
+    if (outMsg.retryCount >= MQTT_MAX_RETRIES)
+    {
+        MQTT_LOG(DEBUG_ERROR, "QoS %d message for client '%s' (packet ID %u) timed out after %d retries. Discarding.", outMsg.qos, mqttClient->clientId.c_str(), outMsg.packetId, MQTT_MAX_RETRIES);
+        mqttClient->outgoingMessages.erase(msgIt);
+        metrics.add(MQTTMetric::QoSDiscarded);
+        releasePacketId(mqttClient, ref.packetId);
+        return;
+    }
+
+    MQTT_LOG(DEBUG_INFO, "QoS %d message for client '%s' (packet ID %u) timed out. Retrying (%d/%d)...", outMsg.qos, mqttClient->clientId.c_str(), outMsg.packetId, outMsg.retryCount + 1, MQTT_MAX_RETRIES);
+    outMsg.retryCount++;
+    metrics.add(MQTTMetric::QoSRetries);
+    outMsg.sentTime = now;
+    if (outMsg.state == OutgoingQoSState::AwaitingPuback || outMsg.state == OutgoingQoSState::AwaitingPubrec)
+    {
+        // Resend PUBLISH with DUP flag: Kopie des geteilten Frames, damit andere Empfänger
+        // (oder ein laufender Versand) nicht das DUP-Bit bzw. eine fremde Packet-ID sehen
+        if (outMsg.frame)
+        {
+            // (bei großen Payloads nur der Kopf, die Payload bleibt geteilt)
+            size_t headLength = outMsg.frame->headLength();
+            MQTTPoolBuffer packet = mqttPoolBuffer(headLength);
+            memcpy(packet.get(), outMsg.frame->data.get(), headLength);
+            packet[0] |= 0x08; // Set DUP flag
+            packet[outMsg.frame->packetIdOffset] = outMsg.packetId >> 8;
+            packet[outMsg.frame->packetIdOffset + 1] = outMsg.packetId & 0xFF;
+            MQTTFramePtr resend = mqttNewFrame();
+            resend->data = std::move(packet);
+            resend->length = outMsg.frame->length;
+            resend->body = outMsg.frame->body;
+            resend->bodyData = outMsg.frame->bodyData;
+            resend->bodyLength = outMsg.frame->bodyLength;
+            writeFrame(mqttClient, resend, 0, 0, false);
+        }
+    }
+    else if (outMsg.state == OutgoingQoSState::AwaitingPubcomp)
+    {
+        // Resend PUBREL
+        uint8_t pubrel[] = {0x62, 0x02, (uint8_t)(outMsg.packetId >> 8), (uint8_t)(outMsg.packetId & 0xFF)};
+        writeControl(mqttClient, pubrel, sizeof(pubrel));
+    }
+    scheduleRetry(mqttClient, outMsg);
 }
 
 void ESPAsyncMQTTBroker::setConfig(const ESPAsyncMQTTBrokerConfig &config)
@@ -313,6 +438,15 @@ void ESPAsyncMQTTBroker::setConfig(const ESPAsyncMQTTBrokerConfig &config)
 
     brokerConfig = config;
 
+    if (brokerConfig.maxPacketSize > MQTT_MAX_PACKET_SIZE_LIMIT)
+        brokerConfig.maxPacketSize = MQTT_MAX_PACKET_SIZE_LIMIT;
+
+    mqttPool().configure(brokerConfig.poolMaxBytes, brokerConfig.poolPsram);
+
+    // Log-Ring erst bei Bedarf anlegen und danach nicht mehr freigeben (Callbacks könnten gerade schreiben)
+    if (brokerConfig.deferredLogging && !logRing)
+        logRing.reset(new MQTTLogRing());
+
     // ---------- AUTH CACHE AUFBAU (einmalig) ----------
     allowedUsersLower.clear();
     authAnonMode = brokerConfig.username.isEmpty();
@@ -345,13 +479,19 @@ void ESPAsyncMQTTBroker::setConfig(const ESPAsyncMQTTBrokerConfig &config)
     // und sollte NICHT durch setConfig() überschrieben werden.
     // Der Benutzer kann alternativ setDebugLevel() direkt aufrufen, wenn gewünscht.
 
-    logMessage(DEBUG_INFO, "🔧 MQTT-Broker Configuration:");
+    MQTT_LOG(DEBUG_INFO, "🔧 MQTT-Broker Configuration:");
+
+    MQTT_LOG(DEBUG_INFO, "   Username: %s", (brokerConfig.username.isEmpty() ? "[empty]" : brokerConfig.username.c_str()));
 
-    logMessage(DEBUG_INFO, "   Username: %s", (brokerConfig.username.isEmpty() ? "[empty]" : brokerConfig.username.c_str()));
+    MQTT_LOG(DEBUG_INFO, "   Password: %s", (brokerConfig.password.isEmpty() ? "[empty]" : "[set]"));
 
-    logMessage(DEBUG_INFO, "   Password: %s", (brokerConfig.password.isEmpty() ? "[empty]" : "[set]"));
+    MQTT_LOG(DEBUG_INFO, "   Auth required: %s", (brokerConfig.username != "" ? "Yes" : "No"));
 
-    logMessage(DEBUG_INFO, "   Auth required: %s", (brokerConfig.username != "" ? "Yes" : "No"));
+    MQTT_LOG(DEBUG_INFO, "   Max packet size: %u", (unsigned)brokerConfig.maxPacketSize);
+
+    MQTT_LOG(DEBUG_INFO, "   Pool: %u bytes%s", (unsigned)brokerConfig.poolMaxBytes, brokerConfig.poolPsram ? " (PSRAM)" : "");
+
+    MQTT_LOG(DEBUG_INFO, "   Source tag: %s", brokerConfig.sourceTag == SourceTagMode::Off ? "off" : (brokerConfig.sourceTag == SourceTagMode::LegacyPrefix ? "prefix" : "user property"));
 }
 
 void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
@@ -362,6 +502,10 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
     mqttClient->client = client;
 
+    mqttClient->serial = ++clientSerialCounter;
+
+    mqttClient->packetIds.setWindow(brokerConfig.maxInflightMessages);
+
     mqttClient->connected = false;
 
     mqttClient->lastActivity = millis();
@@ -404,27 +548,12 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
 
 
-            if (len > MQTT_MAX_PACKET_SIZE) {
-
-
-
-                broker->logMessage(DEBUG_ERROR, "Packet size exceeds limit: %u > %u", (unsigned)len, (unsigned)MQTT_MAX_PACKET_SIZE);
-
-
-
-                return;
-
-
-
-            }
-
-
-
-            broker->processPacket(mqttClient, (uint8_t*)data, len);
+            // Aktivität vor der Verarbeitung setzen – processPacket() kann den Client schließen (und löschen)
+            mqttClient->lastActivity = millis();
 
 
 
-            mqttClient->lastActivity = millis();
+            broker->handleData(client, mqttClient, (uint8_t*)data, len);
 
 
 
@@ -450,6 +579,13 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
             auto& target = it->second;
 
+#ifdef MQTT_CAPTURE
+            if (broker->capture.active())
+                broker->capture.closed(target->serial, esp_timer_get_time());
+#endif
+            // Verbindung ist weg: nicht mehr als verbunden zählen (und kein Empfänger des eigenen LWT)
+            broker->setConnected(target.get(), false);
+
 
 
 
@@ -460,7 +596,7 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
 
 
-                broker->logMessage(DEBUG_INFO, "Unclean disconnect from client %s. Publishing LWT: Topic='%s', QoS=%d, Retain=%s",
+                MQTT_LOG_TO(broker, DEBUG_INFO, "Unclean disconnect from client %s. Publishing LWT: Topic='%s', QoS=%d, Retain=%s",
 
 
 
@@ -468,7 +604,7 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
 
 
-                broker->publish(target->willTopic.c_str(), target->willPayload.get(), target->willPayloadLen, target->willRetain, target->willQos, "");
+                broker->publish(mqttView(target->willTopic), MQTTView(target->willPayload.get(), target->willPayloadLen), target->willRetain, target->willQos, "");
 
 
 
@@ -480,7 +616,7 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
 
 
-                broker->logMessage(DEBUG_DEBUG, "LWT for client %s not sent (clean disconnect already handled).", target->clientId.c_str());
+                MQTT_LOG_TO(broker, DEBUG_DEBUG, "LWT for client %s not sent (clean disconnect already handled).", target->clientId.c_str());
 
 
 
@@ -495,26 +631,28 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
             // Disconnect-Callback + Aufräumen in beiden Branches (BP2-05)
             String disconnectedClientId = target->clientId; // Vor std::move sichern
 
-            // BP2-03: Pending QoS2-Nachrichten des disconnecting Clients aufräumen
-            for (auto qIt = broker->incomingQoS2Messages.begin(); qIt != broker->incomingQoS2Messages.end();)
+            // Nicht gesendete Frames verwerfen, die Verbindung ist weg
+            target->outbound.clear();
+            target->pending.clear();
+            target->outboundBytes = 0;
+            target->outboundCongested = false;
+            target->outboundOverflow = false;
+            target->closeRequested = false;
+
+            // Offline-Sessions werden nicht geroutet: Subscriptions aus dem Topic-Baum nehmen
+            for (const auto &sub : target->subscriptions)
             {
-                if (qIt->second.senderClientId == disconnectedClientId)
-                {
-                    broker->logMessage(DEBUG_DEBUG, "QoS2 message (packetId %u) from disconnected client '%s' discarded.",
-                                       qIt->first, disconnectedClientId.c_str());
-                    qIt = broker->incomingQoS2Messages.erase(qIt);
-                }
-                else
-                {
-                    ++qIt;
-                }
+                broker->subscriptionTree.remove(sub.filter.c_str(), sub.filter.length(), SubscriberRef{target.get(), 0});
             }
 
+            // Offene eingehende QoS-2-Nachrichten hängen an target->incomingQoS2: sie bleiben mit
+            // einer persistenten Session erhalten und werden bei Clean Session mit dem Client freigegeben
+
             if (!target->cleanSession) {
 
 
 
-                broker->logMessage(DEBUG_INFO, "Client %s disconnected (graceful: %s), session will be kept.",
+                MQTT_LOG_TO(broker, DEBUG_INFO, "Client %s disconnected (graceful: %s), session will be kept.",
 
 
 
@@ -524,13 +662,15 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
                 broker->persistentSessions[target->clientId] = std::move(target);
 
+                broker->metrics.set(MQTTMetric::SessionsStored, broker->persistentSessions.size());
+
 
 
             } else {
 
 
 
-                broker->logMessage(DEBUG_INFO, "Client %s disconnected (graceful: %s), Clean Session, removing client.",
+                MQTT_LOG_TO(broker, DEBUG_INFO, "Client %s disconnected (graceful: %s), Clean Session, removing client.",
 
 
 
@@ -579,7 +719,7 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
 
 
-                broker->logMessage(DEBUG_ERROR, "Client %s Error: %d", mqttClient->clientId.c_str(), error);
+                MQTT_LOG_TO(broker, DEBUG_ERROR, "Client %s Error: %d", mqttClient->clientId.c_str(), error);
 
 
 
@@ -593,20 +733,461 @@ void ESPAsyncMQTTBroker::onClient(AsyncClient *client)
 
         } }, this);
 
+    // Sendewarteschlange weiterschreiben, sobald TCP-Puffer frei wird (ACK) bzw. periodisch (Poll)
+    client->onAck([](void *arg, AsyncClient *client, size_t len, uint32_t time)
+                  {
+        ESPAsyncMQTTBroker *broker = (ESPAsyncMQTTBroker *)arg;
+        auto it = broker->clients.find(client);
+        if (it != broker->clients.end())
+        {
+            broker->drainOutbound(it->second.get());
+        } }, this);
+
+    client->onPoll([](void *arg, AsyncClient *client)
+                   {
+        ESPAsyncMQTTBroker *broker = (ESPAsyncMQTTBroker *)arg;
+        auto it = broker->clients.find(client);
+        if (it != broker->clients.end())
+        {
+            broker->drainOutbound(it->second.get());
+        } }, this);
+
     clients[client] = std::move(mqttClient);
 
-    logMessage(DEBUG_DEBUG, "New MQTT connection accepted (IP: %s)", client->remoteIP().toString().c_str());
+    MQTT_LOG(DEBUG_DEBUG, "New MQTT connection accepted (IP: %s)", client->remoteIP().toString().c_str());
+}
+
+// Fixed Header (Typ-Byte + Remaining Length) eines Pakets dekodieren.
+// Rückgabe: 1 = Gesamtlänge in frameLen, 0 = Header noch unvollständig, -1 = ungültige Remaining Length
+static int decodeFixedHeader(const uint8_t *data, size_t len, size_t &frameLen)
+{
+    size_t value = 0;
+    size_t multiplier = 1;
+    for (size_t idx = 1; idx < len; idx++)
+    {
+        uint8_t encodedByte = data[idx];
+        value += (encodedByte & 127) * multiplier;
+        if ((encodedByte & 128) == 0)
+        {
+            frameLen = idx + 1 + value;
+            return 1;
+        }
+        if (idx == 4)
+        {
+            return -1; // Maximal 4 Längen-Bytes erlaubt
+        }
+        multiplier *= 128;
+    }
+    return 0;
+}
+
+// Zerlegt den TCP-Bytestrom eines Clients in MQTT-Pakete.
+// Vollständige Pakete werden direkt aus dem onData-Puffer verarbeitet (auch mehrere pro Segment),
+// nur ein unvollständiger Rest am Segmentende wird in den Decoder des Clients kopiert.
+void ESPAsyncMQTTBroker::handleData(AsyncClient *asyncClient, MQTTClient *client, uint8_t *data, size_t len)
+{
+    MQTT_TRACE_SCOPE(trace, Packet);
+    MQTTFrameDecoder &dec = client->decoder;
+
+    if (client->closeRequested)
+        return; // wartet auf das Trennen in loop()
+
+    while (len > 0)
+    {
+        // Rest eines übergroßen Pakets verwerfen
+        if (dec.skip > 0)
+        {
+            size_t n = (len < dec.skip) ? len : dec.skip;
+            dec.skip -= n;
+            data += n;
+            len -= n;
+            continue;
+        }
+
+        const uint8_t *frame = nullptr;
+        size_t frameLen = 0;
+        MQTTPoolBuffer completed; // hält ein zusammengesetztes Paket bis nach processPacket()
+
+        if (dec.pending())
+        {
+            // Angefangenes Paket mit bekannter Länge auffüllen
+            size_t n = dec.frameLen - dec.used;
+            if (n > len)
+                n = len;
+            memcpy(dec.buffer() + dec.used, data, n);
+            dec.used += n;
+            data += n;
+            len -= n;
+            if (dec.used < dec.frameLen)
+                return;
+            if (dec.large)
+            {
+                // Großes Paket: der Puffer kann von den ausgehenden Frames übernommen werden
+                largePacket = std::move(dec.large);
+                frame = largePacket.get();
+            }
+            else
+            {
+                completed = std::move(dec.frame);
+                frame = completed.get();
+            }
+            frameLen = dec.frameLen;
+            dec.used = 0;
+            dec.frameLen = 0;
+        }
+        else
+        {
+            // Header entweder aus dem Segment oder (bei angefangenem Header) byteweise aus dem Decoder lesen
+            const uint8_t *head = data;
+            size_t headLen = len;
+            if (dec.used > 0)
+            {
+                dec.header[dec.used++] = *data++;
+                len--;
+                head = dec.header;
+                headLen = dec.used;
+            }
+
+            int result = decodeFixedHeader(head, headLen, frameLen);
+            if (result < 0)
+            {
+                MQTT_LOG(DEBUG_ERROR, "Remaining Length has invalid format from client '%s'. Closing connection.", client->clientId.c_str());
+                dec.used = 0;
+                asyncClient->close();
+                return;
+            }
+            if (result == 0)
+            {
+                // Header unvollständig (max. 4 Bytes ohne Abschluss) – für das nächste Segment merken
+                if (head == data)
+                {
+                    memcpy(dec.header, data, len);
+                    dec.used = len;
+                    return;
+                }
+                continue;
+            }
+
+            if (frameLen > brokerConfig.maxPacketSize || (frameLen > MQTT_MAX_PACKET_SIZE && !(dec.large = mqttAllocLargeBuffer(frameLen))))
+            {
+                if (frameLen > brokerConfig.maxPacketSize)
+                    MQTT_LOG(DEBUG_ERROR, "Packet size exceeds limit: %u > %u", (unsigned)frameLen, (unsigned)brokerConfig.maxPacketSize);
+                else
+                    MQTT_LOG(DEBUG_ERROR, "No memory for packet of %u bytes, dropped.", (unsigned)frameLen);
+                size_t consumed = (head == data) ? 0 : dec.used;
+                dec.used = 0;
+                dec.skip = frameLen - consumed;
+                continue;
+            }
+
+            if (dec.large)
+            {
+                // Immer in den eigenen Puffer zusammensetzen, auch wenn das Segment das ganze Paket
+                // enthält: nur so können die ausgehenden Frames die Payload ohne Kopie übernehmen
+                dec.frameLen = frameLen;
+                if (head != data)
+                    memcpy(dec.large.get(), dec.header, dec.used);
+                else
+                    dec.used = 0;
+                continue;
+            }
+
+            if (head == data && frameLen <= len)
+            {
+                // Schneller Pfad: Paket liegt vollständig im Segment, keine Kopie
+                frame = data;
+                data += frameLen;
+                len -= frameLen;
+            }
+            else if (head != data && frameLen == dec.used)
+            {
+                // Paket besteht nur aus dem Header (z.B. PINGREQ)
+                frame = dec.header;
+                dec.used = 0;
+            }
+            else
+            {
+                // Unvollständiges Paket: nur die vorhandenen Bytes in einen Puffer der exakten Größe kopieren
+                dec.frame = mqttPoolBuffer(frameLen);
+                dec.frameLen = frameLen;
+                if (head == data)
+                {
+                    memcpy(dec.frame.get(), data, len);
+                    dec.used = len;
+                    return;
+                }
+                memcpy(dec.frame.get(), dec.header, dec.used);
+                continue;
+            }
+        }
+
+        processPacket(client, (uint8_t *)frame, frameLen);
+        largePacket.reset(); // bleibt nur über Frames, Retained Messages oder QoS-2-Zwischenspeicher erhalten
+
+        // processPacket() kann die Verbindung geschlossen und den Client entfernt haben
+        auto it = clients.find(asyncClient);
+        if (it == clients.end() || it->second.get() != client)
+            return;
+        // Protokollfehler: Rest verwerfen, loop() trennt die Verbindung
+        if (client->closeRequested)
+            return;
+    }
+}
+
+// Frame an einen Client senden. Ist die Warteschlange leer und der TCP-Sendepuffer frei,
+// wird direkt geschrieben; sonst wird eingereiht (begrenzt durch die Watermarks).
+// Rückgabe false: Nachricht wurde wegen Überlast verworfen bzw. abgelehnt.
+bool ESPAsyncMQTTBroker::writeFrame(MQTTClient *client, const MQTTFramePtr &frame, uint16_t packetId, uint8_t qos, bool droppable)
+{
+    MQTT_TRACE_SCOPE(trace, Write);
+    if (!client->client || client->outboundOverflow)
+        return false;
+
+    if (client->outbound.empty() && !frame->body && client->client->space() >= frame->length)
+    {
+        // add() und send() getrennt: write() meldet 0, wenn nur send() scheitert, die Bytes liegen
+        // dann aber schon im Sendepuffer. Maßgeblich ist add(); bei space() >= Länge übernimmt es
+        // alles oder nichts, nichts -> einreihen.
+        frame->setPacketId(packetId);
+        if (client->client->add((const char *)frame->data.get(), frame->length) == frame->length)
+        {
+            client->client->send();
+            metrics.packetOut(frame->data[0], frame->length);
+            return true;
+        }
+    }
+
+    if (droppable || qos > 0)
+    {
+        // Leere Warteschlange nimmt jedes Paket an, auch eines über der Watermark (große Payloads)
+        if (!client->outboundCongested && !client->outbound.empty() && client->outboundBytes + frame->length > brokerConfig.outboundHighWatermark)
+        {
+            client->outboundCongested = true;
+            MQTT_LOG(DEBUG_WARNING, "Client '%s' is congested (%u bytes queued), dropping new messages.", client->clientId.c_str(), (unsigned)client->outboundBytes);
+        }
+
+        if (client->outboundCongested)
+        {
+            // QoS 1/2: ablehnen, bevor ein In-Flight-Zustand entsteht
+            bool accept = false;
+            if (qos == 0 && brokerConfig.qos0Policy == OutboundQoS0Policy::DropOldest)
+            {
+                // Älteste noch nicht angefangene QoS-0-Nachrichten verdrängen, bis die neue Platz hat
+                for (auto it = client->outbound.begin(); it != client->outbound.end();)
+                {
+                    if (client->outboundBytes + frame->length <= brokerConfig.outboundHighWatermark)
+                        break;
+                    if (it->droppable && it->offset == 0)
+                    {
+                        client->outboundBytes -= it->frame->length;
+                        client->outboundDropped++;
+                        metrics.add(MQTTMetric::PublishDropped);
+                        it = client->outbound.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+                accept = client->outboundBytes + frame->length <= brokerConfig.outboundHighWatermark;
+            }
+            if (!accept)
+            {
+                client->outboundDropped++;
+                metrics.add(MQTTMetric::PublishDropped);
+                MQTT_LOG(DEBUG_DEBUG, "Outbound queue of '%s' full, QoS %d message dropped (%u dropped so far).", client->clientId.c_str(), qos, (unsigned)client->outboundDropped);
+                return false;
+            }
+        }
+    }
+
+    // Harte Grenze für alles, was die Watermarks nicht verwerfen dürfen (ein einzelnes großes
+    // Paket in einer leeren Warteschlange bleibt erlaubt)
+    if (!client->outbound.empty() && client->outboundBytes + frame->length > brokerConfig.outboundHighWatermark * MQTT_OUTBOUND_HARD_LIMIT_FACTOR)
+    {
+        client->outboundOverflow = true;
+        closeClientsFlag = true;
+        MQTT_LOG(DEBUG_ERROR, "Outbound queue of '%s' exceeds hard limit (%u bytes queued), closing connection.", client->clientId.c_str(), (unsigned)client->outboundBytes);
+        return false;
+    }
+
+    OutboundFrame entry;
+    entry.frame = frame;
+    entry.packetId = packetId;
+    entry.qos = qos;
+    entry.droppable = droppable;
+    client->outbound.push_back(std::move(entry));
+    client->outboundBytes += frame->length;
+    metrics.packetOut(frame->data[0], frame->length);
+    drainOutbound(client);
+    return true;
+}
+
+bool ESPAsyncMQTTBroker::deliverPublish(MQTTClient *client, const MQTTFramePtr &frame, uint8_t qos, bool retain)
+{
+    uint16_t packetId = 0;
+    if (qos > 0)
+    {
+        // Packet-ID aus dem In-Flight-Fenster dieses Clients; voll (oder wartet schon etwas, Reihenfolge)
+        // -> hinten anstellen, bis releasePacketId() eine ID freigibt
+        packetId = client->pending.empty() ? client->packetIds.acquire() : 0;
+        if (packetId == 0)
+        {
+            if (client->pending.size() >= brokerConfig.maxPendingMessages)
+            {
+                client->outboundDropped++;
+                metrics.add(MQTTMetric::PublishDropped);
+                MQTT_LOG(DEBUG_WARNING, "In-flight window (%u) and pending queue of client '%s' full, QoS %d message dropped.", (unsigned)client->packetIds.window(), client->clientId.c_str(), qos);
+                return false;
+            }
+            PendingPublish entry;
+            entry.frame = frame;
+            entry.qos = qos;
+            entry.retain = retain;
+            client->pending.push_back(std::move(entry));
+            return true;
+        }
+    }
+    return startPublish(client, frame, qos, retain, packetId);
+}
+
+bool ESPAsyncMQTTBroker::startPublish(MQTTClient *client, const MQTTFramePtr &frame, uint8_t qos, bool retain, uint16_t packetId)
+{
+    if (!writeFrame(client, frame, packetId, qos, qos == 0))
+    {
+        client->packetIds.release(packetId);
+        return false;
+    }
+
+    // In-Flight-Zustand nur für angenommene Nachrichten (bei Überlast abgelehnte QoS 1/2 nicht)
+    if (qos > 0)
+    {
+        OutgoingQoSMessage &outMsg = client->outgoingMessages[packetId];
+        outMsg.qos = qos;
+        outMsg.retain = retain;
+        outMsg.frame = frame;
+        outMsg.sentTime = millis();
+        outMsg.retryCount = 0;
+        outMsg.packetId = packetId;
+        outMsg.state = (qos == 1) ? OutgoingQoSState::AwaitingPuback : OutgoingQoSState::AwaitingPubrec;
+        scheduleRetry(client, outMsg);
+
+        MQTT_LOG(DEBUG_DEBUG, "Storing outgoing QoS %d message for client '%s' (packet ID %u)", qos, client->clientId.c_str(), packetId);
+    }
+    return true;
+}
+
+// Packet-ID einer abgeschlossenen (oder verworfenen) QoS-1/2-Nachricht freigeben und wartende nachschieben
+void ESPAsyncMQTTBroker::releasePacketId(MQTTClient *client, uint16_t packetId)
+{
+    client->packetIds.release(packetId);
+    sendPending(client);
+}
+
+// Wartende QoS-1/2-Nachrichten starten, solange Packet-IDs frei sind und die Warteschlange sie annimmt.
+// Bei Überlast bleiben sie stehen (writeFrame() würde sie verwerfen), drainOutbound() macht weiter.
+void ESPAsyncMQTTBroker::sendPending(MQTTClient *client)
+{
+    while (!client->pending.empty() && !client->outboundCongested && !client->outboundOverflow)
+    {
+        const PendingPublish &next = client->pending.front();
+        if (!client->outbound.empty() && client->outboundBytes + next.frame->length > brokerConfig.outboundHighWatermark)
+        {
+            client->outboundCongested = true;
+            MQTT_LOG(DEBUG_DEBUG, "Client '%s' is congested, holding %u pending messages.", client->clientId.c_str(), (unsigned)client->pending.size());
+            break;
+        }
+
+        uint16_t nextId = client->packetIds.acquire();
+        if (nextId == 0)
+            break;
+        PendingPublish entry = std::move(client->pending.front());
+        client->pending.pop_front();
+        startPublish(client, entry.frame, entry.qos, entry.retain, nextId);
+    }
+}
+
+// Steuerpakete (CONNACK, PUBACK, SUBACK, ...) werden nie verworfen, aber hinter bereits
+// eingereihte Nachrichten gestellt, damit die Reihenfolge erhalten bleibt.
+void ESPAsyncMQTTBroker::writeControl(MQTTClient *client, const uint8_t *data, size_t len)
+{
+    if (!client->client)
+        return;
+
+    if (client->outbound.empty() && client->client->space() >= len && client->client->add((const char *)data, len) == len)
+    {
+        client->client->send(); // wie in writeFrame(): angenommen ist, was add() übernommen hat
+        metrics.packetOut(data[0], len);
+        return;
+    }
+
+    MQTTFramePtr frame = mqttNewFrame();
+    frame->data = mqttPoolBuffer(len);
+    frame->length = len;
+    memcpy(frame->data.get(), data, len);
+    writeFrame(client, frame, 0, 0, false);
+}
+
+// Warteschlange so weit leeren, wie der TCP-Sendepuffer es zulässt (aus onAck/onPoll und nach dem Einreihen)
+void ESPAsyncMQTTBroker::drainOutbound(MQTTClient *client)
+{
+    if (!client->client || client->outbound.empty())
+        return;
+
+    bool added = false;
+    while (!client->outbound.empty())
+    {
+        size_t room = client->client->space();
+        if (room == 0)
+            break;
+
+        OutboundFrame &entry = client->outbound.front();
+        // Packet-ID vor jedem Teilstück patchen: andere Empfänger nutzen denselben Frame
+        entry.frame->setPacketId(entry.packetId);
+        size_t remaining;
+        const uint8_t *data = entry.frame->chunkAt(entry.offset, remaining);
+        size_t chunk = (remaining < room) ? remaining : room;
+        size_t written = client->client->add((const char *)data, chunk);
+        if (written == 0)
+            break;
+
+        added = true;
+        entry.offset += written;
+        client->outboundBytes -= written;
+        if (entry.offset == entry.frame->length)
+        {
+            client->outbound.pop_front();
+        }
+    }
+    if (added)
+    {
+        client->client->send();
+    }
+
+    if (client->outboundCongested && client->outboundBytes <= brokerConfig.outboundLowWatermark)
+    {
+        client->outboundCongested = false;
+        MQTT_LOG(DEBUG_INFO, "Client '%s' drained below low watermark (%u bytes queued, %u dropped).", client->clientId.c_str(), (unsigned)client->outboundBytes, (unsigned)client->outboundDropped);
+        sendPending(client);
+    }
 }
 
 void ESPAsyncMQTTBroker::processPacket(MQTTClient *client, uint8_t *data, size_t len)
 
 {
 
+#ifdef MQTT_CAPTURE
+    if (capture.active())
+        capture.packet(client->serial, data, len, esp_timer_get_time());
+#endif
+
+    MQTT_TRACE_SCOPE(trace, Parse);
+
     if (len < 2)
 
     {
 
-        logMessage(DEBUG_ERROR, "Packet too short for header (len=%d)", len);
+        MQTT_LOG(DEBUG_ERROR, "Packet too short for header (len=%d)", len);
 
         return;
     }
@@ -615,6 +1196,8 @@ void ESPAsyncMQTTBroker::processPacket(MQTTClient *client, uint8_t *data, size_t
 
     uint8_t packetType = (header >> 4) & 0x0F;
 
+    metrics.packetIn(header, len);
+
     size_t multiplier = 1;
 
     size_t value = 0;
@@ -631,7 +1214,7 @@ void ESPAsyncMQTTBroker::processPacket(MQTTClient *client, uint8_t *data, size_t
 
         {
 
-            logMessage(DEBUG_ERROR, "Packet too short for full Remaining Length");
+            MQTT_LOG(DEBUG_ERROR, "Packet too short for full Remaining Length");
 
             return;
         }
@@ -646,7 +1229,7 @@ void ESPAsyncMQTTBroker::processPacket(MQTTClient *client, uint8_t *data, size_t
 
         {
 
-            logMessage(DEBUG_ERROR, "Remaining Length has invalid format");
+            MQTT_LOG(DEBUG_ERROR, "Remaining Length has invalid format");
 
             return;
         }
@@ -657,11 +1240,13 @@ void ESPAsyncMQTTBroker::processPacket(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_ERROR, "Packet incomplete or damaged");
+        MQTT_LOG(DEBUG_ERROR, "Packet incomplete or damaged");
 
         return;
     }
 
+    MQTT_TRACE_STOP(trace);
+
     switch (packetType)
 
     {
@@ -728,20 +1313,20 @@ void ESPAsyncMQTTBroker::processPacket(MQTTClient *client, uint8_t *data, size_t
 
     default:
 
-        logMessage(DEBUG_DEBUG, "Unknown/unprocessed packet type: %d", packetType);
+        MQTT_LOG(DEBUG_DEBUG, "Unknown/unprocessed packet type: %d", packetType);
 
         break;
     }
 }
 
-void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32_t length)
+void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, size_t length)
 {
-    logMessage(DEBUG_DEBUG, "🔍 MQTT CONNECT Paket empfangen (len=%u)", length);
+    MQTT_LOG(DEBUG_DEBUG, "🔍 MQTT CONNECT Paket empfangen (len=%u)", length);
     if (length < 10)
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Paket zu kurz!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Paket zu kurz!");
 
         return;
     }
@@ -754,7 +1339,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Zu kurz für Protokollnamen!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Protokollnamen!");
 
         return;
     }
@@ -765,7 +1350,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Protocol name too long!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Protocol name too long!");
 
         return;
     }
@@ -778,7 +1363,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Zu kurz für Protokoll-Level!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Protokoll-Level!");
 
         return;
     }
@@ -793,7 +1378,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Zu kurz für CONNECT-Flags!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für CONNECT-Flags!");
 
         return;
     }
@@ -814,7 +1399,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Zu kurz für Keep-Alive!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Keep-Alive!");
 
         return;
     }
@@ -823,13 +1408,33 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     offset += 2;
 
+    // MQTT 5: CONNECT-Properties (Session Expiry, Receive Maximum, ...) werden nicht ausgewertet
+
+    uint32_t propertiesLength = 0;
+
+    if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
+
+    {
+
+        if (!mqttDecodeRemainingLength(data, length, offset, propertiesLength) || propertiesLength > length - offset)
+
+        {
+
+            MQTT_LOG(DEBUG_ERROR, "❌ CONNECT-Properties fehlerhaft!");
+
+            return;
+        }
+
+        offset += propertiesLength;
+    }
+
     // ClientID
 
     if (offset + 2 > length)
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Zu kurz für Client-ID!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Client-ID!");
 
         return;
     }
@@ -842,7 +1447,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "REJECT: Empty ClientID not allowed if cleanSession=false");
+        MQTT_LOG(DEBUG_ERROR, "REJECT: Empty ClientID not allowed if cleanSession=false");
 
         sendConnackAndClose(client, 0x02); // Identifier Rejected
 
@@ -853,7 +1458,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Zu kurz für komplette Client-ID!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für komplette Client-ID!");
 
         return;
     }
@@ -864,7 +1469,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "❌ Client-ID too long!");
+        MQTT_LOG(DEBUG_ERROR, "❌ Client-ID too long!");
 
         return;
     }
@@ -887,19 +1492,29 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_INFO, "♻️ Persistente Session wiederhergestellt für Client: %s", clientId.c_str());
+        MQTT_LOG(DEBUG_INFO, "♻️ Persistente Session wiederhergestellt für Client: %s", clientId.c_str());
 
         client->subscriptions = sessionIt->second->subscriptions;
 
+        // Noch nicht freigegebene QoS-2-Nachrichten übernehmen, damit ein wiederholtes PUBREL sie findet
+        client->incomingQoS2 = std::move(sessionIt->second->incomingQoS2);
+
+        for (const auto &sub : client->subscriptions)
+        {
+            subscriptionTree.insert(sub.filter.c_str(), sub.filter.length(), SubscriberRef{client, sub.qos});
+        }
+
         persistentSessions.erase(sessionIt);
 
+        metrics.set(MQTTMetric::SessionsStored, persistentSessions.size());
+
         sessionActuallyRestored = true;
     }
 
     client->cleanSession = cleanSession;
 
     client->keepAlive = keepAlive;
-    logMessage(DEBUG_INFO, "[BROKER] CONNECT cid=%s kaSec=%d", clientId.c_str(), keepAlive);
+    MQTT_LOG(DEBUG_INFO, "[BROKER] CONNECT cid=%s kaSec=%d", clientId.c_str(), keepAlive);
 
     // Will-Handling (falls gesetzt)
 
@@ -913,11 +1528,30 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         client->willRetain = (connectFlags & 0x20) != 0;
 
+        if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
+
+        {
+
+            // MQTT 5: Will-Properties überspringen
+            if (!mqttDecodeRemainingLength(data, length, offset, propertiesLength) || propertiesLength > length - offset)
+
+            {
+
+                MQTT_LOG(DEBUG_ERROR, "❌ Will-Properties fehlerhaft!");
+
+                client->client->close();
+
+                return;
+            }
+
+            offset += propertiesLength;
+        }
+
         if (offset + 2 > length)
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Will-Topic-Länge!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Will-Topic-Länge!");
 
             client->client->close();
 
@@ -932,7 +1566,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Will-Topic!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Will-Topic!");
 
             client->client->close();
 
@@ -943,7 +1577,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "Will-Topic too long!");
+            MQTT_LOG(DEBUG_ERROR, "Will-Topic too long!");
 
             client->client->close();
 
@@ -956,11 +1590,11 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         client->willTopic = String(willTopicBuffer);
 
-        if (!isValidPublishTopic(client->willTopic))
+        if (!isValidPublishTopic(mqttView(client->willTopic)))
 
         {
 
-            logMessage(DEBUG_ERROR, "Invalid Will-Topic (wildcards) -> close");
+            MQTT_LOG(DEBUG_ERROR, "Invalid Will-Topic (wildcards) -> close");
 
             client->client->close();
 
@@ -973,7 +1607,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Will-Payload-Länge!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Will-Payload-Länge!");
 
             client->client->close();
 
@@ -988,7 +1622,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Will-Payload!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Will-Payload!");
 
             client->client->close();
 
@@ -999,15 +1633,15 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         size_t lenToCopy = willPayloadActualLen;
 
-        if (lenToCopy > MQTT_MAX_PAYLOAD_SIZE)
+        if (lenToCopy > payloadLimit())
 
         {
 
-            logMessage(DEBUG_WARNING, "Will-Payload wird gekürzt auf %u (von %u)", MQTT_MAX_PAYLOAD_SIZE, willPayloadActualLen);
+            MQTT_LOG(DEBUG_WARNING, "Will-Payload wird gekürzt auf %u (von %u)", (unsigned)payloadLimit(), willPayloadActualLen);
 
-            lenToCopy = MQTT_MAX_PAYLOAD_SIZE;
+            lenToCopy = payloadLimit();
 
-            client->willPayloadLen = MQTT_MAX_PAYLOAD_SIZE;
+            client->willPayloadLen = payloadLimit();
         }
 
         if (lenToCopy > 0)
@@ -1046,7 +1680,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
     String password;
 
-    logMessage(DEBUG_DEBUG,
+    MQTT_LOG(DEBUG_DEBUG,
 
                "CONNECT: proto='%s'(lvl=%u), flags=0x%02X [clean=%d, will=%d, usr=%d, pwd=%d], keepAlive=%u, clientId='%s'",
 
@@ -1075,7 +1709,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "REJECT: Mode=USER_ONLY -> username flag missing");
+            MQTT_LOG(DEBUG_ERROR, "REJECT: Mode=USER_ONLY -> username flag missing");
 
             sendConnackAndClose(client, 0x04); // Bad user name or password
 
@@ -1095,7 +1729,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "REJECT: Mode=USER_PASS -> required flag(s) missing (usr=%d, pwd=%d)",
+            MQTT_LOG(DEBUG_ERROR, "REJECT: Mode=USER_PASS -> required flag(s) missing (usr=%d, pwd=%d)",
 
                        (int)usernameFlag, (int)passwordFlag);
 
@@ -1119,7 +1753,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Username-Länge!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Username-Länge!");
 
             return;
         }
@@ -1132,7 +1766,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Username!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Username!");
 
             return;
         }
@@ -1141,7 +1775,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "Username too long!");
+            MQTT_LOG(DEBUG_ERROR, "Username too long!");
 
             return;
         }
@@ -1163,7 +1797,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Password-Länge!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Password-Länge!");
 
             return;
         }
@@ -1176,7 +1810,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "❌ Zu kurz für Password!");
+            MQTT_LOG(DEBUG_ERROR, "❌ Zu kurz für Password!");
 
             return;
         }
@@ -1185,7 +1819,7 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "Password too long!");
+            MQTT_LOG(DEBUG_ERROR, "Password too long!");
 
             return;
         }
@@ -1199,8 +1833,8 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
         offset += passwordLen;
     }
 
-    // --- AUTH-Log im Rahmenformat ---
-    if (debugLevel >= DEBUG_INFO)
+    // --- AUTH-Log im Rahmenformat (ohne einkompiliertes DEBUG_INFO entfällt der ganze Block) ---
+    if (mqttLogCompiled(DEBUG_INFO) && logEnabled(DEBUG_INFO))
     {
         String cfgUserStr = brokerConfig.username.isEmpty() ? "<empty>" : brokerConfig.username;
         String cfgPassStr = brokerConfig.password.isEmpty() ? "<empty>" : "<set>";
@@ -1253,43 +1887,55 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
         }
         authFrame += F("+------------------------------------------+");
 
-        logMessage(DEBUG_INFO, "%s", authFrame.c_str());
+        MQTT_LOG(DEBUG_INFO, "%s", authFrame.c_str());
         // BP3-01: Zusammenfassung nur bei DEBUG_DEBUG (Auth-Frame oben enthält bereits alle Infos)
-        logMessage(DEBUG_DEBUG, "--- MQTT Client Connect Info ---");
-        logMessage(DEBUG_DEBUG, "ClientID      : %s", client->clientId.c_str());
-        logMessage(DEBUG_DEBUG, "Username      : '%s' (len=%u)", username.c_str(), (unsigned)username.length());
-        logMessage(DEBUG_DEBUG, "Password      : %s (len=%u)", password.isEmpty() ? "<empty>" : "<set>", (unsigned)password.length());
-        logMessage(DEBUG_DEBUG, "Flags(usr/pwd): %d / %d", (int)usernameFlag, (int)passwordFlag);
-        logMessage(DEBUG_DEBUG, "CleanSession  : %s", cleanSession ? "true" : "false");
-        logMessage(DEBUG_DEBUG, "KeepAlive     : %u", (unsigned)keepAlive);
-        logMessage(DEBUG_DEBUG, "ProtoVersion  : %u", (unsigned)client->protocolVersion);
-        logMessage(DEBUG_DEBUG, "--------------------------------");
+        MQTT_LOG(DEBUG_DEBUG, "--- MQTT Client Connect Info ---");
+        MQTT_LOG(DEBUG_DEBUG, "ClientID      : %s", client->clientId.c_str());
+        MQTT_LOG(DEBUG_DEBUG, "Username      : '%s' (len=%u)", username.c_str(), (unsigned)username.length());
+        MQTT_LOG(DEBUG_DEBUG, "Password      : %s (len=%u)", password.isEmpty() ? "<empty>" : "<set>", (unsigned)password.length());
+        MQTT_LOG(DEBUG_DEBUG, "Flags(usr/pwd): %d / %d", (int)usernameFlag, (int)passwordFlag);
+        MQTT_LOG(DEBUG_DEBUG, "CleanSession  : %s", cleanSession ? "true" : "false");
+        MQTT_LOG(DEBUG_DEBUG, "KeepAlive     : %u", (unsigned)keepAlive);
+        MQTT_LOG(DEBUG_DEBUG, "ProtoVersion  : %u", (unsigned)client->protocolVersion);
+        MQTT_LOG(DEBUG_DEBUG, "--------------------------------");
     }
 
     // --- Authentifizierung ---
 
-    logMessage(DEBUG_DEBUG, "Checking authentication…");
+    MQTT_LOG(DEBUG_DEBUG, "Checking authentication…");
 
     if (!authenticateClient(username, password))
 
     {
 
-        logMessage(DEBUG_ERROR, "🚫 Authentication failed – Reject (0x04)");
+        MQTT_LOG(DEBUG_ERROR, "🚫 Authentication failed – Reject (0x04)");
 
         sendConnackAndClose(client, 0x04); // Bad user name or password
 
         return;
     }
 
-    logMessage(DEBUG_INFO, "✅ Auth OK – Verbindung akzeptiert");
+    MQTT_LOG(DEBUG_INFO, "✅ Auth OK – Verbindung akzeptiert");
 
     // Erfolg: CONNACK senden
 
-    uint8_t connack[] = {0x20, 0x02, (uint8_t)(cleanSession ? 0x00 : (sessionActuallyRestored ? 0x01 : 0x00)), 0x00};
+    uint8_t sessionPresent = cleanSession ? 0x00 : (sessionActuallyRestored ? 0x01 : 0x00);
+
+    // MQTT 5: Properties mit Receive Maximum = Plätze der eingehenden QoS-2-Tabelle
+    uint8_t connack[] = {0x20, 0x02, sessionPresent, 0x00, 0x03, 0x21, (uint8_t)(MQTT_MAX_INCOMING_QOS2 >> 8), (uint8_t)MQTT_MAX_INCOMING_QOS2};
 
-    client->client->write((const char *)connack, sizeof(connack));
+    if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
 
-    client->connected = true;
+    {
+
+        connack[1] = 0x06;
+    }
+
+    writeControl(client, connack, connack[1] + 2);
+
+    setConnected(client, true);
+
+    scheduleKeepAlive(client);
 
     // Callback & Liste führen
 
@@ -1306,12 +1952,12 @@ void ESPAsyncMQTTBroker::handleConnect(MQTTClient *client, uint8_t *data, uint32
         }
     }
 
-    // Retained Messages pushen
+    // Retained Messages pushen (wiederhergestellte Subscriptions)
 
-    sendRetainedMessages(client);
+    sendRetainedMessages(client, client->subscriptions);
 }
 
-void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32_t length, uint8_t header)
+void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, size_t length, uint8_t header)
 
 {
 
@@ -1323,7 +1969,7 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "Publish packet too short");
+        MQTT_LOG(DEBUG_ERROR, "Publish packet too short");
 
         return;
     }
@@ -1334,7 +1980,7 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "Publish packet too short for topic");
+        MQTT_LOG(DEBUG_ERROR, "Publish packet too short for topic");
 
         return;
     }
@@ -1343,20 +1989,19 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        logMessage(DEBUG_ERROR, "Topic too long: %u > %u", topicLength, MQTT_MAX_TOPIC_SIZE);
+        MQTT_LOG(DEBUG_ERROR, "Topic too long: %u > %u", topicLength, MQTT_MAX_TOPIC_SIZE);
 
         return;
     }
 
-    // Topic direkt als String ohne 257-Byte Stack-Buffer konstruieren (BP1-03)
-    String topic;
-    topic.concat((const char *)(data + 2), topicLength);
+    // Topic und Payload bleiben Sichten in den Empfangspuffer, kopiert wird erst beim Kodieren
+    MQTTView topic(data + 2, topicLength);
 
     if (!isValidPublishTopic(topic))
 
     {
 
-        logMessage(DEBUG_ERROR, "Invalid Topic Name '%s' from client '%s'. Closing connection.", topic.c_str(), client->clientId.c_str());
+        MQTT_LOG(DEBUG_ERROR, "Invalid Topic Name '%s' from client '%s'. Closing connection.", topic, client->clientId.c_str());
 
         if (client->client)
 
@@ -1380,7 +2025,7 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
         {
 
-            logMessage(DEBUG_ERROR, "Publish packet too short for QoS Packet-ID");
+            MQTT_LOG(DEBUG_ERROR, "Publish packet too short for QoS Packet-ID");
 
             return;
         }
@@ -1388,6 +2033,30 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
         packetId = (data[payloadOffset] << 8) | data[payloadOffset + 1];
 
         payloadOffset += 2;
+    }
+
+    if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
+
+    {
+
+        // MQTT 5: PUBLISH-Properties überspringen (Topic Alias u. a. werden nicht unterstützt)
+        uint32_t propertiesLength = 0;
+
+        if (!mqttDecodeRemainingLength(data, length, payloadOffset, propertiesLength) || propertiesLength > length - payloadOffset)
+
+        {
+
+            MQTT_LOG(DEBUG_ERROR, "Publish properties malformed");
+
+            return;
+        }
+
+        payloadOffset += propertiesLength;
+    }
+
+    if (qos > 0)
+
+    {
 
         if (qos == 1)
 
@@ -1395,7 +2064,7 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
             uint8_t puback[] = {0x40, 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
 
-            client->client->write((const char *)puback, 4);
+            writeControl(client, puback, sizeof(puback));
         }
 
         else if (qos == 2)
@@ -1404,24 +2073,51 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
             uint32_t payloadLength = length - payloadOffset;
 
-            if (payloadLength > MQTT_MAX_PAYLOAD_SIZE)
+            if (payloadLength > payloadLimit())
 
             {
 
-                logMessage(DEBUG_WARNING, "QoS 2 Payload will be truncated to %u (from %u)", MQTT_MAX_PAYLOAD_SIZE, payloadLength);
+                MQTT_LOG(DEBUG_WARNING, "QoS 2 Payload will be truncated to %u (from %u)", (unsigned)payloadLimit(), payloadLength);
 
-                payloadLength = MQTT_MAX_PAYLOAD_SIZE;
+                payloadLength = payloadLimit();
             }
 
-            IncomingQoS2Message qos2Msg(topic, data + payloadOffset, payloadLength, retained, client->clientId);
+            IncomingQoS2Message *slot = client->incomingQoS2.insert(packetId);
+
+            if (!slot)
+
+            {
+
+                // Tabelle der Session voll: Der Client hat das im CONNACK angekündigte Receive Maximum
+                // überschritten. MQTT 5 verlangt DISCONNECT 0x93, MQTT 3.1.1 kennt keinen Fehlercode.
+                // In beiden Fällen trennt loop() die Verbindung; der Client wiederholt die Nachricht
+                // nach dem Reconnect, statt dass sie hier stillschweigend verloren geht.
+                MQTT_LOG(DEBUG_WARNING, "QoS 2 Publish from '%s' exceeds receive maximum (PacketID=%u, %u messages awaiting PUBREL), closing connection.",
+                           client->clientId.c_str(), packetId, (unsigned)MQTT_MAX_INCOMING_QOS2);
 
-            incomingQoS2Messages[packetId] = std::move(qos2Msg);
+                if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
 
-            logMessage(DEBUG_INFO, "QoS 2 Publish received - Topic='%s', PacketID=%u. Sending PUBREC.", topic.c_str(), packetId);
+                {
+
+                    uint8_t disconnect[] = {(MQTT_DISCONNECT << 4), 0x02, 0x93, 0x00};
+
+                    writeControl(client, disconnect, sizeof(disconnect));
+                }
+
+                client->closeRequested = true;
+
+                closeClientsFlag = true;
+
+                return;
+            }
+
+            *slot = IncomingQoS2Message(topic, data + payloadOffset, payloadLength, retained, largePacket);
+
+            MQTT_LOG(DEBUG_INFO, "QoS 2 Publish received - Topic='%s', PacketID=%u. Sending PUBREC.", topic, packetId);
 
             uint8_t pubrec[] = {(MQTT_PUBREC << 4), 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
 
-            client->client->write((const char *)pubrec, 4);
+            writeControl(client, pubrec, sizeof(pubrec));
 
             return;
         }
@@ -1435,64 +2131,100 @@ void ESPAsyncMQTTBroker::handlePublish(MQTTClient *client, uint8_t *data, uint32
 
     {
 
-        uint32_t payloadLength = length - payloadOffset;
+        MQTTView payload(data + payloadOffset, length - payloadOffset);
 
-        if (payloadLength > 0)
+        if (!payload.empty())
 
         {
 
-            if (payloadLength > MQTT_MAX_PAYLOAD_SIZE)
+            // Quelle nicht in die Payload kopieren: publish() kodiert Präfix bzw. User Property direkt in den Frame
+            MQTTView prefix, source;
+
+            if (brokerConfig.sourceTag == SourceTagMode::LegacyPrefix)
 
             {
 
-                logMessage(DEBUG_WARNING, "Payload will be truncated to %u (from %u)", MQTT_MAX_PAYLOAD_SIZE, payloadLength);
+                if (client->sourcePrefix.isEmpty())
+
+                {
 
-                payloadLength = MQTT_MAX_PAYLOAD_SIZE;
+                    client->sourcePrefix = "source:[" + client->clientId + "];";
+                }
+
+                prefix = mqttView(client->sourcePrefix);
+            }
+
+            else if (brokerConfig.sourceTag == SourceTagMode::UserProperty)
+
+            {
+
+                source = mqttView(client->clientId);
             }
 
-            // Payload direkt als String ohne 769-Byte Stack-Buffer konstruieren (BP1-03)
-            String originalPayload;
-            originalPayload.concat((const char *)(data + payloadOffset), payloadLength);
+            MQTT_LOG(DEBUG_INFO, "🔔 Weiterleiten (QoS %d, von %s) - Topic='%s', Payload='%s'", qos, client->clientId.c_str(), topic, payload);
+
+            notifyMessage(client, topic, payload, prefix);
+
+            publish(topic, payload, retained, qos, client->clientId, prefix, source, largePacket);
+        }
+
+        else if (retained)
+
+        {
+
+            MQTT_LOG(DEBUG_INFO, "Publish (QoS %d, empty Retained) - Topic='%s'", qos, topic);
+
+            notifyMessage(client, topic, MQTTView(), MQTTView());
+
+            publish(topic, MQTTView(), retained, qos, client->clientId, MQTTView(),
+                    brokerConfig.sourceTag == SourceTagMode::UserProperty ? mqttView(client->clientId) : MQTTView());
+        }
+    }
+}
+
+void ESPAsyncMQTTBroker::notifyMessage(MQTTClient *client, MQTTView topic, MQTTView payload, MQTTView prefix)
+
+{
+
+    if (!messageCallback && !binaryMessageCallback)
+
+    {
+
+        return;
+    }
 
-            // NEU: Payload mit Quelle-Präfix versehen
-            String newPayload = "source:[" + client->clientId + "];" + originalPayload;
-            if (newPayload.length() > MQTT_MAX_PAYLOAD_SIZE)
-            {
-                logMessage(DEBUG_WARNING, "Payload mit Source-Präfix überschreitet die maximale Größe und wird gekürzt.");
-                newPayload = newPayload.substring(0, MQTT_MAX_PAYLOAD_SIZE);
-            }
+    // Strings nur für die Callbacks bilden
+    String topicStr;
 
-            logMessage(DEBUG_INFO, "🔔 Weiterleiten (QoS %d, von %s) - Topic='%s', NeuerPayload='%s'", qos, client->clientId.c_str(), topic.c_str(), newPayload.c_str());
+    topicStr.concat(topic.data, topic.len);
 
-            if (messageCallback)
+    if (binaryMessageCallback)
 
-            {
+    {
 
-                messageCallback(client->clientId, topic, newPayload);
-            }
+        binaryMessageCallback(client->clientId, topicStr, payload.bytes(), payload.len);
+    }
 
-            publish(topic.c_str(), newPayload.c_str(), retained, qos, client->clientId);
-        }
+    if (messageCallback)
 
-        else if (retained)
+    {
 
-        {
+        // Wie publish() gekürzt, inklusive Quelle-Präfix (SourceTagMode::LegacyPrefix)
+        MQTTView limited = payload.first(prefix.len < MQTT_MAX_PAYLOAD_SIZE ? MQTT_MAX_PAYLOAD_SIZE - prefix.len : 0);
 
-            logMessage(DEBUG_INFO, "Publish (QoS %d, empty Retained) - Topic='%s'", qos, topic.c_str());
+        String message;
 
-            if (messageCallback)
+        message.reserve(prefix.len + limited.len);
 
-            {
+        message.concat(prefix.data, prefix.len);
 
-                messageCallback(client->clientId, topic, "");
-            }
+        message.concat(limited.data, limited.len);
 
-            publish(topic.c_str(), "", retained, qos, client->clientId);
-        }
+        messageCallback(client->clientId, topicStr, message);
     }
 }
 
-void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint32_t length)
+void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, size_t length)
 
 {
 
@@ -1500,7 +2232,7 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
 
     {
 
-        logMessage(DEBUG_ERROR, "Subscribe packet too short");
+        MQTT_LOG(DEBUG_ERROR, "Subscribe packet too short");
 
         return;
     }
@@ -1509,8 +2241,35 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
 
     size_t index = 2;
 
+    if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
+
+    {
+
+        // MQTT 5: Properties (z.B. Subscription Identifier) überspringen, sie werden nicht ausgewertet
+        uint32_t propertiesLength = 0;
+        if (!mqttDecodeRemainingLength(data, length, index, propertiesLength))
+        {
+            MQTT_LOG(DEBUG_ERROR, "Subscribe properties malformed");
+            return;
+        }
+
+        if (propertiesLength > length - index)
+
+        {
+
+            MQTT_LOG(DEBUG_ERROR, "Subscribe properties exceed packet length");
+
+            return;
+        }
+
+        index += propertiesLength;
+    }
+
     std::vector<uint8_t> returnCodes;
 
+    // Filter, für die Retained Messages gesendet werden (neu bzw. erneut abonniert, gemäß Retain Handling)
+    std::vector<Subscription> replayFilters;
+
     while (index < length)
 
     {
@@ -1531,7 +2290,7 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
 
         {
 
-            logMessage(DEBUG_ERROR, "Subscribe topic too long: %u > %u", topicLength, MQTT_MAX_TOPIC_SIZE);
+            MQTT_LOG(DEBUG_ERROR, "Subscribe topic too long: %u > %u", topicLength, MQTT_MAX_TOPIC_SIZE);
 
             break;
         }
@@ -1555,7 +2314,10 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
 
         bool noLocal = (options & 0x04) != 0;
 
-        logMessage(DEBUG_DEBUG, "Subscribe: Topic '%s', QoS %d, noLocal: %s", topicBuffer, requestedQoS, noLocal ? "true" : "false");
+        // MQTT 5 Retain Handling: 0 = immer senden, 1 = nur für neue Subscriptions, 2 = nie
+        uint8_t retainHandling = (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5) ? (options >> 4) & 0x03 : 0;
+
+        MQTT_LOG(DEBUG_DEBUG, "Subscribe: Topic '%s', QoS %d, noLocal: %s, retainHandling: %d", topicBuffer, requestedQoS, noLocal ? "true" : "false", retainHandling);
 
         if (isValidTopicFilter(topic))
 
@@ -1568,8 +2330,14 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
                 if (existing.filter == topic)
                 {
                     existing.noLocal = noLocal; // QoS/Flags aktualisieren
+                    if (existing.qos != requestedQoS)
+                    {
+                        existing.qos = requestedQoS;
+                        subscriptionTree.remove(topic.c_str(), topic.length(), SubscriberRef{client, 0});
+                        subscriptionTree.insert(topic.c_str(), topic.length(), SubscriberRef{client, requestedQoS});
+                    }
                     found = true;
-                    logMessage(DEBUG_DEBUG, "Subscription for client '%s' to topic '%s' updated (noLocal %s).", client->clientId.c_str(), topic.c_str(), noLocal ? "Yes" : "No");
+                    MQTT_LOG(DEBUG_DEBUG, "Subscription for client '%s' to topic '%s' updated (noLocal %s).", client->clientId.c_str(), topic.c_str(), noLocal ? "Yes" : "No");
                     break;
                 }
             }
@@ -1578,12 +2346,23 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
                 Subscription sub;
                 sub.filter = topic;
                 sub.noLocal = noLocal;
+                sub.qos = requestedQoS;
                 client->subscriptions.push_back(sub);
+                subscriptionTree.insert(topic.c_str(), topic.length(), SubscriberRef{client, requestedQoS});
+            }
+
+            if (retainHandling == 0 || (retainHandling == 1 && !found))
+            {
+                Subscription replay;
+                replay.filter = topic;
+                replay.noLocal = noLocal;
+                replay.qos = requestedQoS;
+                replayFilters.push_back(replay);
             }
 
             returnCodes.push_back(requestedQoS);
 
-            logMessage(DEBUG_INFO, "Subscription for client '%s' to topic filter '%s' added (QoS %d, noLocal %s).", client->clientId.c_str(), topic.c_str(), requestedQoS, noLocal ? "Yes" : "No");
+            MQTT_LOG(DEBUG_INFO, "Subscription for client '%s' to topic filter '%s' added (QoS %d, noLocal %s).", client->clientId.c_str(), topic.c_str(), requestedQoS, noLocal ? "Yes" : "No");
 
             if (subscribeCallback)
 
@@ -1597,7 +2376,7 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
 
         {
 
-            logMessage(DEBUG_WARNING, "Subscription for client '%s' to invalid topic filter '%s' rejected.", client->clientId.c_str(), topic.c_str());
+            MQTT_LOG(DEBUG_WARNING, "Subscription for client '%s' to invalid topic filter '%s' rejected.", client->clientId.c_str(), topic.c_str());
 
             if (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5)
 
@@ -1619,36 +2398,49 @@ void ESPAsyncMQTTBroker::handleSubscribe(MQTTClient *client, uint8_t *data, uint
 
     {
 
-        logMessage(DEBUG_ERROR, "No valid subscriptions in SUBSCRIBE packet");
+        MQTT_LOG(DEBUG_ERROR, "No valid subscriptions in SUBSCRIBE packet");
 
         return;
     }
 
-    size_t subackLength = 2 + returnCodes.size();
+    // MQTT 5: ein Byte Property-Länge (0) nach der Packet-ID
+    size_t propertiesLength = (client->protocolVersion == MQTT_PROTOCOL_LEVEL_5) ? 1 : 0;
+
+    size_t subackLength = 2 + propertiesLength + returnCodes.size();
+
+    size_t headerLength = 1 + mqttRemainingLengthSize(subackLength);
 
-    std::unique_ptr<uint8_t[]> suback(new uint8_t[2 + subackLength]);
+    MQTTPoolBuffer suback = mqttPoolBuffer(headerLength + subackLength);
 
     suback[0] = MQTT_SUBACK << 4;
 
-    suback[1] = subackLength;
+    uint8_t *ptr = mqttEncodeRemainingLength(suback.get() + 1, subackLength);
 
-    suback[2] = packetId >> 8;
+    *ptr++ = packetId >> 8;
 
-    suback[3] = packetId & 0xFF;
+    *ptr++ = packetId & 0xFF;
+
+    if (propertiesLength)
+
+    {
+
+        *ptr++ = 0;
+    }
 
     for (size_t i = 0; i < returnCodes.size(); i++)
 
     {
 
-        suback[4 + i] = returnCodes[i];
+        *ptr++ = returnCodes[i];
     }
 
-    client->client->write((const char *)suback.get(), 2 + subackLength);
+    writeControl(client, suback.get(), headerLength + subackLength);
 
-    sendRetainedMessages(client);
+    // Retained Messages nur für die Filter dieses Pakets, nicht für alle Subscriptions des Clients
+    sendRetainedMessages(client, replayFilters);
 }
 
-void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, uint32_t length)
+void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, size_t length)
 
 {
 
@@ -1656,7 +2448,7 @@ void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, ui
 
     {
 
-        logMessage(DEBUG_ERROR, "Unsubscribe packet too short");
+        MQTT_LOG(DEBUG_ERROR, "Unsubscribe packet too short");
 
         return;
     }
@@ -1665,7 +2457,7 @@ void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, ui
 
     uint8_t unsuback[4] = {0xB0, 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
 
-    client->client->write((const char *)unsuback, 4);
+    writeControl(client, unsuback, sizeof(unsuback));
 
     size_t index = 2;
 
@@ -1689,7 +2481,7 @@ void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, ui
 
         {
 
-            logMessage(DEBUG_ERROR, "Unsubscribe topic too long: %u > %u", topicLength, MQTT_MAX_TOPIC_SIZE);
+            MQTT_LOG(DEBUG_ERROR, "Unsubscribe topic too long: %u > %u", topicLength, MQTT_MAX_TOPIC_SIZE);
 
             break;
         }
@@ -1718,6 +2510,8 @@ void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, ui
                     unsubscribeCallback(client->clientId, topic);
                 }
 
+                subscriptionTree.remove(topic.c_str(), topic.length(), SubscriberRef{client, 0});
+
                 it = client->subscriptions.erase(it);
             }
 
@@ -1734,22 +2528,22 @@ void ESPAsyncMQTTBroker::handleUnsubscribe(MQTTClient *client, uint8_t *data, ui
 void ESPAsyncMQTTBroker::handlePingReq(MQTTClient *client)
 {
     uint8_t pingresp[] = {0xD0, 0x00};
-    client->client->write((const char *)pingresp, 2);
+    writeControl(client, pingresp, sizeof(pingresp));
     if (!client->kaSeen)
     {
         client->kaSeen = true;
-        logMessage(DEBUG_INFO, "[BROKER] KA REGISTERED cid=%s", client->clientId.c_str());
+        MQTT_LOG(DEBUG_INFO, "[BROKER] KA REGISTERED cid=%s", client->clientId.c_str());
     }
-    logMessage(DEBUG_DEBUG, "[BROKER] PINGREQ cid=%s -> PINGRESP", client->clientId.c_str());
+    MQTT_LOG(DEBUG_DEBUG, "[BROKER] PINGREQ cid=%s -> PINGRESP", client->clientId.c_str());
 }
 
 void ESPAsyncMQTTBroker::handleDisconnect(MQTTClient *client)
 
 {
 
-    logMessage(DEBUG_INFO, "Clean disconnect from client %s (DISCONNECT packet received).", client->clientId.c_str());
+    MQTT_LOG(DEBUG_INFO, "Clean disconnect from client %s (DISCONNECT packet received).", client->clientId.c_str());
 
-    client->connected = false;
+    setConnected(client, false);
 
     client->gracefulDisconnect = true;
 
@@ -1757,7 +2551,7 @@ void ESPAsyncMQTTBroker::handleDisconnect(MQTTClient *client)
 
     {
 
-        logMessage(DEBUG_DEBUG, "LWT for client %s is discarded (clean disconnect).", client->clientId.c_str());
+        MQTT_LOG(DEBUG_DEBUG, "LWT for client %s is discarded (clean disconnect).", client->clientId.c_str());
 
         client->hasWill = false;
 
@@ -1784,7 +2578,7 @@ void ESPAsyncMQTTBroker::handlePuback(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_ERROR, "Puback packet too short");
+        MQTT_LOG(DEBUG_ERROR, "Puback packet too short");
 
         return;
     }
@@ -1801,16 +2595,17 @@ void ESPAsyncMQTTBroker::handlePuback(MQTTClient *client, uint8_t *data, size_t
 
         {
 
-            logMessage(DEBUG_DEBUG, "PUBACK from subscriber '%s' for packet ID %u received.", client->clientId.c_str(), packetId);
+            MQTT_LOG(DEBUG_DEBUG, "PUBACK from subscriber '%s' for packet ID %u received.", client->clientId.c_str(), packetId);
 
             client->outgoingMessages.erase(it);
+            releasePacketId(client, packetId);
         }
 
         else
 
         {
 
-            logMessage(DEBUG_WARNING, "Received PUBACK for QoS 2 message from '%s' (packet ID %u). This is unexpected.", client->clientId.c_str(), packetId);
+            MQTT_LOG(DEBUG_WARNING, "Received PUBACK for QoS 2 message from '%s' (packet ID %u). This is unexpected.", client->clientId.c_str(), packetId);
         }
     }
 
@@ -1818,7 +2613,7 @@ void ESPAsyncMQTTBroker::handlePuback(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_DEBUG, "Spurious PUBACK from '%s' for packet ID %u received.", client->clientId.c_str(), packetId);
+        MQTT_LOG(DEBUG_DEBUG, "Spurious PUBACK from '%s' for packet ID %u received.", client->clientId.c_str(), packetId);
     }
 }
 
@@ -1830,7 +2625,7 @@ void ESPAsyncMQTTBroker::handlePubRec(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_ERROR, "PubRec packet too short");
+        MQTT_LOG(DEBUG_ERROR, "PubRec packet too short");
 
         return;
     }
@@ -1845,7 +2640,7 @@ void ESPAsyncMQTTBroker::handlePubRec(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_DEBUG, "PUBREC from subscriber '%s' for packet ID %u received.", client->clientId.c_str(), packetId);
+        MQTT_LOG(DEBUG_DEBUG, "PUBREC from subscriber '%s' for packet ID %u received.", client->clientId.c_str(), packetId);
 
         // Update state and send PUBREL
 
@@ -1855,9 +2650,9 @@ void ESPAsyncMQTTBroker::handlePubRec(MQTTClient *client, uint8_t *data, size_t
 
         uint8_t pubrel[] = {0x62, 0x02, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
 
-        client->client->write((const char *)pubrel, sizeof(pubrel));
+        writeControl(client, pubrel, sizeof(pubrel));
 
-        logMessage(DEBUG_DEBUG, "Sending PUBREL to subscriber '%s' for packet ID %u.", client->clientId.c_str(), packetId);
+        MQTT_LOG(DEBUG_DEBUG, "Sending PUBREL to subscriber '%s' for packet ID %u.", client->clientId.c_str(), packetId);
 
         return;
     }
@@ -1866,9 +2661,9 @@ void ESPAsyncMQTTBroker::handlePubRec(MQTTClient *client, uint8_t *data, size_t
 
     uint8_t pubrel[] = {0x62, 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
 
-    client->client->write((const char *)pubrel, sizeof(pubrel));
+    writeControl(client, pubrel, sizeof(pubrel));
 
-    logMessage(DEBUG_DEBUG, "PUBREC for publisher packet ID %u processed", packetId);
+    MQTT_LOG(DEBUG_DEBUG, "PUBREC for publisher packet ID %u processed", packetId);
 }
 
 void ESPAsyncMQTTBroker::handlePubRel(MQTTClient *client, uint8_t *data, size_t len)
@@ -1879,60 +2674,47 @@ void ESPAsyncMQTTBroker::handlePubRel(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_ERROR, "PubRel packet too short");
+        MQTT_LOG(DEBUG_ERROR, "PubRel packet too short");
 
         return;
     }
 
     uint16_t packetId = (data[0] << 8) | data[1];
 
-    auto it = incomingQoS2Messages.find(packetId);
+    IncomingQoS2Message *pending = client->incomingQoS2.find(packetId);
 
-    if (it != incomingQoS2Messages.end())
+    if (pending)
 
     {
 
-        IncomingQoS2Message &msg = it->second;
-
-        String payloadStr;
-
-        if (msg.payload_len > 0 && msg.payload)
+        IncomingQoS2Message &msg = *pending;
 
-        {
-
-            // BP3-02: VLA durch Heap-Allokation ersetzt (VLA ist kein Standard-C++)
-            std::unique_ptr<char[]> tempPayload(new char[msg.payload_len + 1]);
-            memcpy(tempPayload.get(), msg.payload.get(), msg.payload_len);
-            tempPayload[msg.payload_len] = '\0';
-            payloadStr = String(tempPayload.get());
-        }
-
-        else
-
-        {
+        MQTT_LOG(DEBUG_INFO, "PUBREL for packet ID %u received. Publishing QoS 2 message: Topic='%s'", packetId, msg.topic.c_str());
 
-            payloadStr = "";
-        }
+        // Zwischengespeicherte Payload direkt aus dem Slot kodieren (wird erst danach freigegeben)
+        MQTTView payload(msg.payload.get(), msg.payload ? msg.payload_len : 0);
 
-        logMessage(DEBUG_INFO, "PUBREL for packet ID %u received. Publishing QoS 2 message: Topic='%s'", packetId, msg.topic.c_str());
+        notifyMessage(client, mqttView(msg.topic), payload, MQTTView());
 
-        publish(msg.topic.c_str(), payloadStr.c_str(), msg.retained, MQTT_QOS2, msg.originalClientId);
+        publish(mqttView(msg.topic), payload, msg.retained, MQTT_QOS2, client->clientId, MQTTView(),
+                brokerConfig.sourceTag == SourceTagMode::UserProperty ? mqttView(client->clientId) : MQTTView(),
+                payload.len > MQTT_MAX_PAYLOAD_SIZE ? msg.payload : MQTTLargeBufferPtr());
 
-        incomingQoS2Messages.erase(it);
+        client->incomingQoS2.erase(packetId);
     }
 
     else
 
     {
 
-        logMessage(DEBUG_WARNING, "PUBREL for unknown packet ID %u received.", packetId);
+        MQTT_LOG(DEBUG_WARNING, "PUBREL for unknown packet ID %u received.", packetId);
     }
 
     uint8_t pubcomp[] = {(MQTT_PUBCOMP << 4), 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId};
 
-    client->client->write((const char *)pubcomp, sizeof(pubcomp));
+    writeControl(client, pubcomp, sizeof(pubcomp));
 
-    logMessage(DEBUG_DEBUG, "PUBCOMP for packet ID %u sent.", packetId);
+    MQTT_LOG(DEBUG_DEBUG, "PUBCOMP for packet ID %u sent.", packetId);
 }
 
 void ESPAsyncMQTTBroker::handlePubComp(MQTTClient *client, uint8_t *data, size_t len)
@@ -1943,7 +2725,7 @@ void ESPAsyncMQTTBroker::handlePubComp(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_ERROR, "PubComp packet too short");
+        MQTT_LOG(DEBUG_ERROR, "PubComp packet too short");
 
         return;
     }
@@ -1958,193 +2740,87 @@ void ESPAsyncMQTTBroker::handlePubComp(MQTTClient *client, uint8_t *data, size_t
 
     {
 
-        logMessage(DEBUG_DEBUG, "PUBCOMP from subscriber '%s' for packet ID %u received. QoS 2 flow complete.", client->clientId.c_str(), packetId);
+        MQTT_LOG(DEBUG_DEBUG, "PUBCOMP from subscriber '%s' for packet ID %u received. QoS 2 flow complete.", client->clientId.c_str(), packetId);
 
         client->outgoingMessages.erase(it);
+        releasePacketId(client, packetId);
 
         return;
     }
 
     // Original logic for PUBCOMP from a publisher
 
-    logMessage(DEBUG_DEBUG, "PUBCOMP for publisher packet ID %u received", packetId);
+    MQTT_LOG(DEBUG_DEBUG, "PUBCOMP for publisher packet ID %u received", packetId);
 }
 
-bool ESPAsyncMQTTBroker::topicMatches(const Subscription &subscription, const String &topic)
+void ESPAsyncMQTTBroker::sendRetainedMessages(MQTTClient *client, const std::vector<Subscription> &filters)
 
 {
 
-    return topicMatches(subscription.filter, topic);
-}
-
-bool ESPAsyncMQTTBroker::topicMatches(const String &filter, const String &topic)
-
-{
+    MQTT_TRACE_SCOPE(trace, Retained);
 
-    const char *f = filter.c_str();
+    // Pro Filter nur den passenden Teilbaum der Retained Messages besuchen. Passt eine
+    // Nachricht auf mehrere Filter, wird sie über die Replay-Marke nur einmal (mit der höchsten
+    // gewährten QoS) ausgewählt. Die Liste wird per swap() geliehen (wie routeScratch in publish()).
+    std::vector<RetainedMessage *> selected;
+    selected.swap(retainedScratch);
+    selected.clear();
+    uint32_t mark = ++retainedMark;
 
-    const char *t = topic.c_str();
-
-    while (*f && *t)
+    for (auto &sub : filters)
 
     {
 
-        const char *f_end = strchr(f, '/');
-
-        const char *t_end = strchr(t, '/');
+        retainedMessages.forEachMatchingTopic(sub.filter.c_str(), sub.filter.length(), [&](const std::unique_ptr<RetainedMessage> &msg)
+                                              {
+            if (msg->replayMark != mark)
+            {
+                msg->replayMark = mark;
+                msg->replayQos = sub.qos;
+                selected.push_back(msg.get());
+            }
+            else if (sub.qos > msg->replayQos)
+            {
+                msg->replayQos = sub.qos;
+            } });
+    }
 
-        size_t f_len = f_end ? (size_t)(f_end - f) : strlen(f);
+    for (RetainedMessage *msg : selected)
 
-        if (f_len == 1 && *f == '#')
+    {
 
-        {
+        uint8_t qos = (msg->replayQos < msg->qos) ? msg->replayQos : msg->qos;
 
-            return true;
-        }
+        const MQTTFramePtr &frame = msg->frameFor(qos, client->protocolVersion == MQTT_PROTOCOL_LEVEL_5);
 
-        if (f_len == 1 && *f == '+')
+        if (!frame)
 
         {
 
-            f = f_end ? f_end + 1 : f + f_len;
-
-            t = t_end ? t_end + 1 : t + strlen(t);
+            MQTT_LOG(DEBUG_ERROR, "Retained Message (Topic: %s) could not be encoded.", msg->topic.c_str());
 
             continue;
         }
 
-        size_t t_len = t_end ? (size_t)(t_end - t) : strlen(t);
-
-        if (f_len != t_len || strncmp(f, t, f_len) != 0)
-
-        {
-
-            return false;
-        }
-
-        f = f_end ? f_end + 1 : f + f_len;
-
-        t = t_end ? t_end + 1 : t + t_len;
-    }
-
-    if (*f && strcmp(f, "/#") == 0)
+        // Größte Payload plus dieselbe Reserve für Kopf und Topic wie bei MQTT_MAX_PACKET_SIZE
+        size_t frameLimit = payloadLimit() + (MQTT_MAX_PACKET_SIZE - MQTT_MAX_PAYLOAD_SIZE);
 
-    {
-
-        return true;
-    }
-
-    return *f == *t;
-}
-
-void ESPAsyncMQTTBroker::sendRetainedMessages(MQTTClient *client)
-
-{
-
-    for (auto const &entry : retainedMessages)
-
-    {
-
-        auto const &msg = entry.second;
-
-        if (!msg)
+        if (frame->length > frameLimit)
 
         {
 
-            logMessage(DEBUG_ERROR, "Error: Invalid unique_ptr in retainedMessages Map found.");
+            MQTT_LOG(DEBUG_ERROR, "Retained Message (Topic: %s) exceeds packet size limit: %u > %u.", msg->topic.c_str(), (unsigned)frame->length, (unsigned)frameLimit);
 
             continue;
         }
 
-        for (auto &sub : client->subscriptions)
-
-        {
-
-            if (topicMatches(sub, msg->topic))
-
-            {
-
-                size_t topicLength = msg->topic.length();
-
-                if (topicLength > MQTT_MAX_TOPIC_SIZE)
-
-                {
-
-                    logMessage(DEBUG_ERROR, "Retained Topic too long: %u > %u", (unsigned)topicLength, MQTT_MAX_TOPIC_SIZE);
-
-                    continue;
-                }
-
-                size_t actualPayloadLength = msg->length;
-
-                if (msg->length > MQTT_MAX_PAYLOAD_SIZE)
-
-                {
-
-                    logMessage(DEBUG_WARNING, "Retained Payload for Topic '%s' will be truncated: %u > %u", msg->topic.c_str(), (unsigned)msg->length, MQTT_MAX_PAYLOAD_SIZE);
-
-                    actualPayloadLength = MQTT_MAX_PAYLOAD_SIZE;
-                }
-
-                size_t remainingLengthField = 2 + topicLength + actualPayloadLength;
-
-                // BP2-02: Variable-Length-Encoding statt 1-Byte-Limit
-                size_t header_len = 1; // Fixed header byte
-                if (remainingLengthField <= 127)
-                    header_len += 1;
-                else if (remainingLengthField <= 16383)
-                    header_len += 2;
-                else
-                    header_len += 3;
-
-                size_t totalPacketLength = header_len + remainingLengthField;
-
-                if (totalPacketLength > MQTT_MAX_PACKET_SIZE)
-
-                {
-
-                    logMessage(DEBUG_ERROR, "Retained Message (Topic: %s) exceeds MQTT_MAX_PACKET_SIZE: %u > %u.", msg->topic.c_str(), (unsigned)totalPacketLength, MQTT_MAX_PACKET_SIZE);
-
-                    continue;
-                }
-
-                std::unique_ptr<uint8_t[]> packet(new uint8_t[totalPacketLength]);
-
-                uint8_t *ptr = packet.get();
-                *ptr++ = (MQTT_PUBLISH << 4) | (msg->qos << 1) | 0x01;
-
-                // Variable-Length-Encoding
-                size_t rem_len = remainingLengthField;
-                do
-                {
-                    uint8_t byte = rem_len % 128;
-                    rem_len /= 128;
-                    if (rem_len > 0)
-                        byte |= 128;
-                    *ptr++ = byte;
-                } while (rem_len > 0);
-
-                *ptr++ = topicLength >> 8;
-                *ptr++ = topicLength & 0xFF;
+        deliverPublish(client, frame, qos, true);
 
-                memcpy(ptr, msg->topic.c_str(), topicLength);
-                ptr += topicLength;
-
-                if (actualPayloadLength > 0 && msg->payload)
-
-                {
-
-                    memcpy(ptr, msg->payload.get(), actualPayloadLength);
-                }
-
-                client->client->write((const char *)packet.get(), totalPacketLength);
-
-                logMessage(DEBUG_DEBUG, "Retained Message sent: Topic='%s', Payload-length=%u, QoS=%d", msg->topic.c_str(), (unsigned)actualPayloadLength, msg->qos);
-
-                break;
-            }
-        }
+        MQTT_LOG(DEBUG_DEBUG, "Retained Message sent: Topic='%s', Payload-length=%u, QoS=%d", msg->topic.c_str(), (unsigned)msg->length, qos);
     }
+
+    selected.clear();
+    retainedScratch.swap(selected);
 }
 
 // BP3-06: isUserAllowed() als toter Code entfernt
@@ -2156,7 +2832,7 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_INFO, "[AUTH] Mode=ANON: Broker akzeptiert alle anonymen Clients. -> Accept");
+            MQTT_LOG(DEBUG_INFO, "[AUTH] Mode=ANON: Broker akzeptiert alle anonymen Clients. -> Accept");
         }
         return true;
     }
@@ -2170,7 +2846,7 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_ERROR, "[AUTH] Username fehlt/leer -> Reject");
+            MQTT_LOG(DEBUG_ERROR, "[AUTH] Username fehlt/leer -> Reject");
         }
         return false;
     }
@@ -2190,7 +2866,7 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_ERROR, "[AUTH] Username '%s' nicht in erlaubter Liste -> Reject", u.c_str());
+            MQTT_LOG(DEBUG_ERROR, "[AUTH] Username '%s' nicht in erlaubter Liste -> Reject", u.c_str());
         }
         return false;
     }
@@ -2200,7 +2876,7 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_INFO, "[AUTH] Mode=USER_ONLY: Username OK -> Accept");
+            MQTT_LOG(DEBUG_INFO, "[AUTH] Mode=USER_ONLY: Username OK -> Accept");
         }
         return true;
     }
@@ -2213,7 +2889,7 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_ERROR, "[AUTH] Mode=USER_PASS: Passwort fehlt/leer -> Reject");
+            MQTT_LOG(DEBUG_ERROR, "[AUTH] Mode=USER_PASS: Passwort fehlt/leer -> Reject");
         }
         return false;
     }
@@ -2223,7 +2899,7 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_ERROR, "[AUTH] Mode=USER_PASS: Passwort-Länge passt nicht -> Reject");
+            MQTT_LOG(DEBUG_ERROR, "[AUTH] Mode=USER_PASS: Passwort-Länge passt nicht -> Reject");
         }
         return false;
     }
@@ -2233,14 +2909,14 @@ bool ESPAsyncMQTTBroker::authenticateClient(const String &username, const String
     {
         if (brokerConfig.log)
         {
-            logMessage(DEBUG_ERROR, "[AUTH] Mode=USER_PASS: Passwort falsch -> Reject");
+            MQTT_LOG(DEBUG_ERROR, "[AUTH] Mode=USER_PASS: Passwort falsch -> Reject");
         }
         return false;
     }
 
     if (brokerConfig.log)
     {
-        logMessage(DEBUG_INFO, "[AUTH] Mode=USER_PASS: Username+Pass OK -> Accept");
+        MQTT_LOG(DEBUG_INFO, "[AUTH] Mode=USER_PASS: Username+Pass OK -> Accept");
     }
     return true;
 }
@@ -2253,7 +2929,7 @@ bool ESPAsyncMQTTBroker::setPort(uint16_t newPort)
 
     {
 
-        logMessage(DEBUG_ERROR, "Ungültiger Port 0");
+        MQTT_LOG(DEBUG_ERROR, "Ungültiger Port 0");
 
         return false;
     }
@@ -2262,54 +2938,56 @@ bool ESPAsyncMQTTBroker::setPort(uint16_t newPort)
 
     {
 
-        logMessage(DEBUG_WARNING, "Portänderung auf %u abgelehnt – Server läuft", (unsigned)newPort);
+        MQTT_LOG(DEBUG_WARNING, "Portänderung auf %u abgelehnt – Server läuft", (unsigned)newPort);
 
         return false;
     }
 
     port = newPort;
 
-    logMessage(DEBUG_INFO, "Broker-Port gesetzt auf %u (wirksam bei nächstem begin())", (unsigned)newPort);
+    MQTT_LOG(DEBUG_INFO, "Broker-Port gesetzt auf %u (wirksam bei nächstem begin())", (unsigned)newPort);
 
     return true;
 }
 
-bool ESPAsyncMQTTBroker::isValidPublishTopic(const String &topic)
+bool ESPAsyncMQTTBroker::isValidPublishTopic(MQTTView topic)
 
 {
 
-    if (topic.isEmpty())
+    MQTT_TRACE_SCOPE(trace, Validate);
+
+    if (topic.empty())
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid publish topic: Topic is empty.");
+        MQTT_LOG(DEBUG_WARNING, "Invalid publish topic: Topic is empty.");
 
         return false;
     }
 
-    if (topic.length() > MQTT_MAX_TOPIC_SIZE)
+    if (topic.len > MQTT_MAX_TOPIC_SIZE)
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid publish topic: Topic '%s' exceeds max length of %d.", topic.c_str(), MQTT_MAX_TOPIC_SIZE);
+        MQTT_LOG(DEBUG_WARNING, "Invalid publish topic: Topic '%s' exceeds max length of %d.", topic, MQTT_MAX_TOPIC_SIZE);
 
         return false;
     }
 
-    if (topic.indexOf('#') != -1)
+    if (topic.contains('#'))
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid publish topic: Topic '%s' contains multi-level wildcard '#'.", topic.c_str());
+        MQTT_LOG(DEBUG_WARNING, "Invalid publish topic: Topic '%s' contains multi-level wildcard '#'.", topic);
 
         return false;
     }
 
-    if (topic.indexOf('+') != -1)
+    if (topic.contains('+'))
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid publish topic: Topic '%s' contains single-level wildcard '+'.", topic.c_str());
+        MQTT_LOG(DEBUG_WARNING, "Invalid publish topic: Topic '%s' contains single-level wildcard '+'.", topic);
 
         return false;
     }
@@ -2332,7 +3010,7 @@ bool ESPAsyncMQTTBroker::publish(const char *topic, const char *payload, bool re
 
     {
 
-        logMessage(DEBUG_ERROR, "Null pointer as topic for C-String Publish");
+        MQTT_LOG(DEBUG_ERROR, "Null pointer as topic for C-String Publish");
 
         return false;
     }
@@ -2341,12 +3019,19 @@ bool ESPAsyncMQTTBroker::publish(const char *topic, const char *payload, bool re
 
     {
 
-        logMessage(DEBUG_DEBUG, "Null pointer as payload for C-String Publish, treating as empty string.");
+        MQTT_LOG(DEBUG_DEBUG, "Null pointer as payload for C-String Publish, treating as empty string.");
 
-        return publish(topic, (const uint8_t *)"", 0, retained, qos, excludeClientId);
+        return publish(MQTTView(topic), MQTTView(), retained, qos, excludeClientId);
     }
 
-    return publish(topic, (const uint8_t *)payload, strlen(payload), retained, qos, excludeClientId);
+    return publish(MQTTView(topic), MQTTView(payload), retained, qos, excludeClientId);
+}
+
+bool ESPAsyncMQTTBroker::publish(const char *topic, const uint8_t *payload, size_t len, bool retained, uint8_t qos)
+
+{
+
+    return publish(MQTTView(topic), MQTTView(payload, len), retained, qos, "");
 }
 
 bool ESPAsyncMQTTBroker::publish(const char *topic, uint8_t qos, bool retained, const char *payload)
@@ -2356,73 +3041,116 @@ bool ESPAsyncMQTTBroker::publish(const char *topic, uint8_t qos, bool retained,
     return publish(topic, payload, retained, qos);
 }
 
-bool ESPAsyncMQTTBroker::publish(const char *topic, const uint8_t *payload, size_t payloadLen, bool retained, uint8_t qos, const String &excludeClientId)
+bool ESPAsyncMQTTBroker::publish(MQTTView topic, MQTTView payload, bool retained, uint8_t qos, const String &excludeClientId,
+                                 MQTTView prefix, MQTTView source, const MQTTLargeBufferPtr &payloadOwner)
 
 {
 
-    if (!topic)
+    if (!topic.data)
 
     {
 
-        logMessage(DEBUG_ERROR, "Null pointer as topic for Publish");
+        MQTT_LOG(DEBUG_ERROR, "Null pointer as topic for Publish");
 
         return false;
     }
 
-    if (payloadLen > 0 && !payload)
+    if (!payload.empty() && !payload.data)
 
     {
 
-        logMessage(DEBUG_ERROR, "Null pointer as payload with payloadLen > 0 for Publish");
+        MQTT_LOG(DEBUG_ERROR, "Null pointer as payload with payloadLen > 0 for Publish");
 
         return false;
     }
 
-    size_t topicLen = strlen(topic);
-
-    if (topicLen > MQTT_MAX_TOPIC_SIZE)
+    if (topic.len > MQTT_MAX_TOPIC_SIZE)
 
     {
 
-        logMessage(DEBUG_ERROR, "Topic too long: %u > %u", (unsigned)topicLen, MQTT_MAX_TOPIC_SIZE);
+        MQTT_LOG(DEBUG_ERROR, "Topic too long: %u > %u", (unsigned)topic.len, MQTT_MAX_TOPIC_SIZE);
 
         return false;
     }
 
-    if (payloadLen > MQTT_MAX_PAYLOAD_SIZE)
+    size_t limit = payloadLimit();
+
+    if (prefix.len + payload.len > limit)
 
     {
 
-        logMessage(DEBUG_WARNING, "Payload will be truncated: %u > %u", (unsigned)payloadLen, MQTT_MAX_PAYLOAD_SIZE);
+        MQTT_LOG(DEBUG_WARNING, "Payload will be truncated: %u > %u", (unsigned)(prefix.len + payload.len), (unsigned)limit);
+
+        prefix = prefix.first(limit);
 
-        payloadLen = MQTT_MAX_PAYLOAD_SIZE;
+        payload = payload.first(limit - prefix.len);
     }
 
-    logMessage(DEBUG_INFO, "📤 Broker is publishing on topic '%s' (Length: %u, QoS: %d, Retained: %s)", topic, (unsigned)payloadLen, qos, retained ? "Yes" : "No");
+    size_t payloadLen = prefix.len + payload.len;
+
+    MQTT_LOG(DEBUG_INFO, "📤 Broker is publishing on topic '%s' (Length: %u, QoS: %d, Retained: %s)", topic, (unsigned)payloadLen, qos, retained ? "Yes" : "No");
 
     if (!excludeClientId.isEmpty())
 
     {
 
-        logMessage(DEBUG_INFO, "   - Excluded client: %s", excludeClientId.c_str());
+        MQTT_LOG(DEBUG_INFO, "   - Excluded client: %s", excludeClientId.c_str());
     }
 
-    String topicStr = String(topic);
+    MQTTFramePtr variants[2][3]; // kodierte PUBLISH-Frames je Protokoll (0 = 3.1.1, 1 = MQTT 5) und QoS-Stufe
+
+    MQTTPublishOptions options[2];
+
+    options[0].prefix = prefix;
+
+    options[1].prefix = prefix;
+
+    options[1].v5 = true;
+
+    options[1].source = source;
+
+    options[0].payloadOwner = payloadOwner;
+
+    options[1].payloadOwner = payloadOwner;
 
     if (retained)
 
     {
 
-        retainedMessages.erase(topicStr);
+        std::unique_ptr<RetainedMessage> *previous = retainedMessages.find(topic.data, topic.len);
+
+        if (previous)
+
+        {
+
+            metrics.sub(MQTTMetric::RetainedBytes, (*previous)->frames[0][(*previous)->qos]->length);
+        }
+
+        retainedMessages.erase(topic.data, topic.len);
 
         if (payloadLen > 0)
 
         {
 
-            auto msg = std::make_unique<RetainedMessage>(topicStr, payload, payloadLen, qos);
+            // Einmal kodieren: derselbe Frame wird an die Abonnenten verteilt und für das Replay gespeichert.
+            // Vom Heap: Retained Messages (auch $SYS) leben beliebig lange und würden den Pool dauerhaft belegen.
+            MQTTPublishOptions retainedOptions = options[0];
+            retainedOptions.heap = true;
+            MQTT_TRACE_SCOPE(traceEncode, Encode);
+            variants[0][qos] = mqttBuildPublishFrame(topic, payload, qos, true, retainedOptions);
+            MQTT_TRACE_STOP(traceEncode);
+
+            if (variants[0][qos])
+
+            {
+
+                retainedMessages.insert(topic.data, topic.len, std::make_unique<RetainedMessage>(topic, source, payloadLen, qos, variants[0][qos]));
 
-            retainedMessages[topicStr] = std::move(msg);
+                metrics.add(MQTTMetric::RetainedBytes, variants[0][qos]->length);
+            }
         }
+
+        metrics.set(MQTTMetric::RetainedCount, retainedMessages.size());
     }
 
     bool messageSent = false;
@@ -2431,170 +3159,83 @@ bool ESPAsyncMQTTBroker::publish(const char *topic, const uint8_t *payload, size
 
     int sentCount = 0;
 
-    for (auto &clientEntry : clients)
+    // Abonnenten über den Topic-Baum bestimmen. Ein Client mit mehreren passenden Filtern
+    // wird über die Zustellmarke nur einmal aufgenommen (mit der höchsten gewährten QoS).
+    // Die Liste wird per swap() geliehen, damit ein verschachteltes publish() sie nicht überschreibt.
+    std::vector<MQTTClient *> targets;
+    targets.swap(routeScratch);
+    targets.clear();
+    uint32_t mark = ++deliveryMark;
+    MQTT_TRACE_SCOPE(traceRoute, Route);
+    subscriptionTree.forEachMatch(topic.data, topic.len, [&](const SubscriberRef &ref)
+                                  {
+        MQTTClient *c = ref.client;
+        if (c->deliveryMark != mark)
+        {
+            c->deliveryMark = mark;
+            c->deliveryQos = ref.qos;
+            targets.push_back(c);
+        }
+        else if (ref.qos > c->deliveryQos)
+        {
+            c->deliveryQos = ref.qos;
+        } });
+    MQTT_TRACE_STOP(traceRoute);
 
+    for (MQTTClient *c : targets)
     {
-
-        auto &c = clientEntry.second;
-
         if (!c->connected)
-
             continue;
 
         clientCount++;
 
         if (!excludeClientId.isEmpty() && c->clientId == excludeClientId)
         {
-            logMessage(DEBUG_DEBUG, "  - Client %s (Original Publisher) will be skipped", c->clientId.c_str());
+            MQTT_LOG(DEBUG_DEBUG, "  - Client %s (Original Publisher) will be skipped", c->clientId.c_str());
             continue;
         }
 
-        for (const auto &sub : c->subscriptions)
+        // QoS auf die vom Abonnenten gewährte QoS herabstufen (höchste aller passenden Filter)
+        uint8_t final_qos = (c->deliveryQos < qos) ? c->deliveryQos : qos;
 
+        // Frame pro Protokoll und QoS-Variante nur einmal kodieren und zwischen allen Empfängern teilen
+        bool v5 = c->protocolVersion == MQTT_PROTOCOL_LEVEL_5;
+        MQTTFramePtr &frame = variants[v5][final_qos];
+        if (!frame)
         {
-
-            if (topicMatches(sub, topicStr))
-
+            MQTT_TRACE_SCOPE(traceEncode, Encode);
+            frame = mqttBuildPublishFrame(topic, payload, final_qos, retained, options[v5]);
+            MQTT_TRACE_STOP(traceEncode);
+            if (!frame)
             {
+                MQTT_LOG(DEBUG_ERROR, "Message too large to encode. Topic: %s", topic);
+                break;
+            }
+        }
 
-                uint8_t final_qos = qos; // We could downgrade QoS here based on subscription, but for now use original.
-
-                size_t packet_id_len = (final_qos > 0) ? 2 : 0;
-
-                size_t remainingLength = 2 + topicLen + packet_id_len + payloadLen;
-
-                // Basic check for remaining length encoding
-
-                if (remainingLength > 2097151)
-
-                { // Max for 3 bytes
-
-                    logMessage(DEBUG_ERROR, "Message too large to encode. Topic: %s", topicStr.c_str());
-
-                    continue; // Skip this client
-                }
-
-                size_t header_len = 1;
-
-                if (remainingLength <= 127)
-
-                    header_len += 1;
-
-                else if (remainingLength <= 16383)
-
-                    header_len += 2;
-
-                else
-
-                    header_len += 3;
-
-                size_t packetSize = header_len + remainingLength;
-
-                auto packet = std::unique_ptr<uint8_t[]>(new uint8_t[packetSize]);
-
-                uint8_t *ptr = packet.get();
-
-                *ptr++ = (MQTT_PUBLISH << 4) | (final_qos << 1) | (retained ? 1 : 0);
-
-                // Encode remaining length
-
-                size_t rem_len = remainingLength;
-
-                do
-
-                {
-
-                    uint8_t byte = rem_len % 128;
-
-                    rem_len /= 128;
-
-                    if (rem_len > 0)
-
-                    {
-
-                        byte |= 128;
-                    }
-
-                    *ptr++ = byte;
-
-                } while (rem_len > 0);
-
-                *ptr++ = topicLen >> 8;
-
-                *ptr++ = topicLen & 0xFF;
-
-                memcpy(ptr, topicStr.c_str(), topicLen);
-
-                ptr += topicLen;
-
-                if (final_qos > 0)
-
-                {
-
-                    uint16_t packetId = getNextPacketId();
-
-                    *ptr++ = packetId >> 8;
-
-                    *ptr++ = packetId & 0xFF;
-
-                    auto outMsg = std::make_unique<OutgoingQoSMessage>();
-
-                    outMsg->qos = final_qos;
-
-                    outMsg->retain = retained;
-
-                    outMsg->topic = topicStr;
-
-                    outMsg->payloadLen = payloadLen;
-
-                    if (payloadLen > 0)
-
-                    {
-
-                        outMsg->payload = std::unique_ptr<uint8_t[]>(new uint8_t[payloadLen]);
-
-                        memcpy(outMsg->payload.get(), payload, payloadLen);
-                    }
-
-                    outMsg->sentTime = millis();
-
-                    outMsg->retryCount = 0;
-
-                    outMsg->packetId = packetId;
-
-                    outMsg->state = (final_qos == 1) ? OutgoingQoSState::AwaitingPuback : OutgoingQoSState::AwaitingPubrec;
-
-                    c->outgoingMessages[packetId] = std::move(*outMsg);
-
-                    logMessage(DEBUG_DEBUG, "Storing outgoing QoS %d message for client '%s' (packet ID %u)", final_qos, c->clientId.c_str(), packetId);
-                }
-
-                if (payloadLen > 0)
-
-                {
+        bool writeSuccess = deliverPublish(c, frame, final_qos, retained);
 
-                    memcpy(ptr, payload, payloadLen);
-                }
+        if (writeSuccess)
 
-                bool writeSuccess = c->client->write((const char *)packet.get(), packetSize);
+        {
 
-                if (writeSuccess)
+            sentCount++;
 
-                {
+            messageSent = true;
+        }
 
-                    sentCount++;
+        MQTT_LOG(DEBUG_DEBUG, "  - Sent PUBLISH to %s (QoS %d), Success: %s", c->clientId.c_str(), final_qos, writeSuccess ? "Yes" : "No");
 
-                    messageSent = true;
-                }
+    }
 
-                logMessage(DEBUG_DEBUG, "  - Sent PUBLISH to %s (QoS %d), Success: %s", c->clientId.c_str(), final_qos, writeSuccess ? "Yes" : "No");
+    targets.clear();
+    routeScratch.swap(targets);
 
-                break; // Message sent to this client for this topic, move to next client
-            }
-        }
-    }
+    metrics.add(MQTTMetric::PublishRouted);
+    metrics.add(MQTTMetric::PublishDelivered, sentCount);
+    metrics.max(MQTTMetric::FanoutMax, sentCount);
 
-    logMessage(DEBUG_INFO, "📊 Message sent to %d of %d connected clients", sentCount, clientCount);
+    MQTT_LOG(DEBUG_INFO, "📊 Message sent to %d of %d subscribed clients", sentCount, clientCount);
 
     return messageSent;
 }
@@ -2603,11 +3244,13 @@ bool ESPAsyncMQTTBroker::isValidTopicFilter(const String &filter)
 
 {
 
+    MQTT_TRACE_SCOPE(trace, Validate);
+
     if (filter.isEmpty())
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid topic filter: Filter is empty.");
+        MQTT_LOG(DEBUG_WARNING, "Invalid topic filter: Filter is empty.");
 
         return false;
     }
@@ -2616,7 +3259,7 @@ bool ESPAsyncMQTTBroker::isValidTopicFilter(const String &filter)
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid topic filter: Filter exceeds 65535 bytes.");
+        MQTT_LOG(DEBUG_WARNING, "Invalid topic filter: Filter exceeds 65535 bytes.");
 
         return false;
     }
@@ -2647,7 +3290,7 @@ bool ESPAsyncMQTTBroker::isValidTopicFilter(const String &filter)
 
     {
 
-        logMessage(DEBUG_WARNING, "Invalid topic filter: Could not split levels for non-empty filter '%s'.", filter.c_str());
+        MQTT_LOG(DEBUG_WARNING, "Invalid topic filter: Could not split levels for non-empty filter '%s'.", filter.c_str());
 
         return false;
     }
@@ -2666,7 +3309,7 @@ bool ESPAsyncMQTTBroker::isValidTopicFilter(const String &filter)
 
             {
 
-                logMessage(DEBUG_WARNING, "Invalid topic filter: '#' cannot be part of a level (Level: '%s', Filter: '%s').", level.c_str(), filter.c_str());
+                MQTT_LOG(DEBUG_WARNING, "Invalid topic filter: '#' cannot be part of a level (Level: '%s', Filter: '%s').", level.c_str(), filter.c_str());
 
                 return false;
             }
@@ -2675,7 +3318,7 @@ bool ESPAsyncMQTTBroker::isValidTopicFilter(const String &filter)
 
             {
 
-                logMessage(DEBUG_WARNING, "Invalid topic filter: '#' must be the last level (Filter: '%s').", filter.c_str());
+                MQTT_LOG(DEBUG_WARNING, "Invalid topic filter: '#' must be the last level (Filter: '%s').", filter.c_str());
 
                 return false;
             }
@@ -2689,7 +3332,7 @@ bool ESPAsyncMQTTBroker::isValidTopicFilter(const String &filter)
 
             {
 
-                logMessage(DEBUG_WARNING, "Invalid topic filter: '+' cannot be part of a level (Level: '%s', Filter: '%s').", level.c_str(), filter.c_str());
+                MQTT_LOG(DEBUG_WARNING, "Invalid topic filter: '+' cannot be part of a level (Level: '%s', Filter: '%s').", level.c_str(), filter.c_str());
 
                 return false;
             }
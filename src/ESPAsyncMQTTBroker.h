@@ -7,9 +7,20 @@
 #include <AsyncTCP.h>
 #include <vector>
 #include <map>
+#include <deque>
 #include <memory>
 #include <functional>
 #include "esp_timer.h"
+#include "MQTTTopicTree.h"
+#include "MQTTFrame.h"
+#include "MQTTView.h"
+#include "MQTTTimerWheel.h"
+#include "MQTTPacketIdAllocator.h"
+#include "MQTTLog.h"
+#include "MQTTLogRing.h"
+#include "MQTTMetrics.h"
+#include "MQTTTrace.h"
+#include "MQTTCapture.h"
 
 #define MQTT_CONNECT 1
 #define MQTT_CONNACK 2
@@ -37,6 +48,12 @@
 #define MQTT_MAX_PACKET_SIZE 1280  // BP2-07: 1024→1280 damit Retained Messages mit Topic+Payload >127 Bytes Remaining-Length sicher passen
 #define MQTT_MAX_TOPIC_SIZE 256   // Maximale Größe für Topic
 #define MQTT_MAX_PAYLOAD_SIZE 768 // Maximale Größe für Payload
+#define MQTT_MAX_PACKET_SIZE_LIMIT (512 * 1024) // Obergrenze für ESPAsyncMQTTBrokerConfig::maxPacketSize
+#define MQTT_TIMER_TICK_MS 100      // Auflösung des Timer-Rads (Keep-Alive, QoS-Wiederholungen)
+#define MQTT_RETRY_TIMEOUT_MS 5000  // Wartezeit bis zur Wiederholung einer QoS-1/2-Nachricht
+#define MQTT_MAX_RETRIES 3          // Danach wird die Nachricht verworfen
+#define MQTT_MAX_INCOMING_QOS2 8    // Gleichzeitig offene eingehende QoS-2-Nachrichten pro Session
+#define MQTT_OUTBOUND_HARD_LIMIT_FACTOR 4 // Harte Grenze der Sendewarteschlange = Faktor x outboundHighWatermark
 
 // Eigene Implementation von std::make_unique (ab C++14 Standard)
 #if __cplusplus < 201402L
@@ -50,34 +67,162 @@ namespace std
 }
 #endif
 
+/// Sicht auf einen Arduino-String (gültig, solange der String unverändert lebt)
+inline MQTTView mqttView(const String &str) { return MQTTView(str.c_str(), str.length()); }
+
 /**
- * Debug-Level für Logging
- *  DEBUG_NONE = 0,     ///< Keine Debug-Ausgaben
- *  DEBUG_ERROR = 1,    ///< Nur Fehler werden angezeigt
- *  DEBUG_WARNING = 2,  ///< Warnungen und Fehler werden angezeigt
- *  DEBUG_INFO = 3,     ///< Warnungen, Fehler und Informationen werden angezeigt
- *  DEBUG_DEBUG = 4     ///< Alle Details werden angezeigt (inklusive Debug-Informationen)
+ *  Repräsentiert ein MQTT-Abonnement für einen Client
  */
-enum DebugLevel
+struct Subscription
 {
-    DEBUG_NONE = 0,    ///< Keine Debug-Ausgaben
-    DEBUG_ERROR = 1,   ///< Nur Fehler werden angezeigt
-    DEBUG_WARNING = 2, ///< Warnungen und Fehler werden angezeigt
-    DEBUG_INFO = 3,    ///< Warnungen, Fehler und Informationen werden angezeigt
-    DEBUG_DEBUG = 4    ///< Alle Details werden angezeigt (inklusive Debug-Informationen)
+    String filter;   ///< Topic-Filter, mit dem eingehende Nachrichten verglichen werden
+    bool noLocal;    ///< MQTT 5.0 noLocal-Flag: Bei true erhält der Client keine selbst veröffentlichten Nachrichten
+    uint8_t qos = 0; ///< Gewährte QoS; ausgehende Nachrichten werden auf diese Stufe herabgestuft
+    // evtl. später noch weitere Flags (retainAsPublished, retainHandling…)
 };
 
-// Logger-Funktion, die verschiedene Log-Levels unterstützt
-#define MQTT_LOG(level, format, ...) logMessage(level, format, ##__VA_ARGS__)
+/**
+ * Inkrementeller Paket-Decoder pro Verbindung.
+ * Hält nur den unvollständigen Rest eines Pakets, das über Segmentgrenzen hinweg ankommt.
+ */
+struct MQTTFrameDecoder
+{
+    uint8_t header[5];                 ///< Angefangener Fixed Header (Typ-Byte + max. 4 Längen-Bytes)
+    MQTTPoolBuffer frame;              ///< Puffer des angefangenen Pakets (exakte Paketgröße)
+    size_t frameLen = 0;               ///< Gesamtlänge des angefangenen Pakets
+    MQTTLargeBufferPtr large;          ///< Statt frame: Puffer eines Pakets über MQTT_MAX_PACKET_SIZE (PSRAM)
+    size_t used = 0;                   ///< Bereits vorhandene Bytes (in header bzw. frame)
+    size_t skip = 0;                   ///< Noch zu verwerfende Bytes eines übergroßen Pakets
+
+    bool pending() const { return frame || large; }
+    uint8_t *buffer() { return large ? large.get() : frame.get(); }
+};
 
 /**
- *  Repräsentiert ein MQTT-Abonnement für einen Client
+ * Empfangene QoS-2-Nachricht, die bis zum PUBREL des Publishers zurückgehalten wird
  */
-struct Subscription
+struct IncomingQoS2Message
 {
-    String filter; ///< Topic-Filter, mit dem eingehende Nachrichten verglichen werden
-    bool noLocal;  ///< MQTT 5.0 noLocal-Flag: Bei true erhält der Client keine selbst veröffentlichten Nachrichten
-    // evtl. später noch weitere Flags (retainAsPublished, retainHandling…)
+    String topic;
+    MQTTLargeBufferPtr payload; ///< eigene Kopie; bei großen PUBLISH Verweis in den Empfangspuffer (keine Kopie)
+    size_t payload_len; // BP3-07: Einziges Größenfeld (vorher doppelt mit 'length')
+    bool retained;
+
+    IncomingQoS2Message() : payload_len(0), retained(false) {}
+
+    IncomingQoS2Message(MQTTView t, const uint8_t *p, size_t len, bool ret, const MQTTLargeBufferPtr &owner = MQTTLargeBufferPtr())
+        : payload_len(len), retained(ret)
+    {
+        topic.concat(t.data, t.len);
+        if (len > 0 && p != nullptr)
+        {
+            if (owner)
+            {
+                payload = MQTTLargeBufferPtr(owner, (uint8_t *)p); // teilt den Besitz am Empfangspuffer
+            }
+            else
+            {
+                payload = MQTTLargeBufferPtr((uint8_t *)mqttPool().allocate(len), MQTTPoolDeleter{len}, MQTTPoolAllocator<uint8_t>());
+                memcpy(payload.get(), p, len);
+            }
+        }
+    }
+};
+
+/**
+ * QoS-2-Empfangszustand einer Session: kleine Tabelle fester Größe, Schlüssel = Packet-ID.
+ * Gehört zum MQTTClient, damit gleiche Packet-IDs verschiedener Publisher sich nicht
+ * überschreiben und beim Ende der Session alles mit dem Client freigegeben wird.
+ */
+struct IncomingQoS2Table
+{
+    struct Slot
+    {
+        uint16_t packetId = 0; ///< 0 = frei
+        IncomingQoS2Message message;
+    };
+
+    Slot slots[MQTT_MAX_INCOMING_QOS2];
+
+    IncomingQoS2Message *find(uint16_t packetId)
+    {
+        if (packetId == 0)
+            return nullptr;
+        for (auto &slot : slots)
+        {
+            if (slot.packetId == packetId)
+                return &slot.message;
+        }
+        return nullptr;
+    }
+
+    /// Slot für die Packet-ID belegen (bestehender Eintrag wird überschrieben, z.B. bei DUP).
+    IncomingQoS2Message *insert(uint16_t packetId)
+    {
+        if (packetId == 0)
+            return nullptr;
+        Slot *freeSlot = nullptr;
+        for (auto &slot : slots)
+        {
+            if (slot.packetId == packetId)
+                return &slot.message;
+            if (slot.packetId == 0 && !freeSlot)
+                freeSlot = &slot;
+        }
+        if (!freeSlot)
+            return nullptr;
+        freeSlot->packetId = packetId;
+        return &freeSlot->message;
+    }
+
+    void erase(uint16_t packetId)
+    {
+        if (packetId == 0)
+            return;
+        for (auto &slot : slots)
+        {
+            if (slot.packetId == packetId)
+            {
+                slot.packetId = 0;
+                slot.message = IncomingQoS2Message();
+                return;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        size_t n = 0;
+        for (const auto &slot : slots)
+        {
+            if (slot.packetId != 0)
+                n++;
+        }
+        return n;
+    }
+};
+
+/**
+ * Eintrag der Sendewarteschlange eines Clients.
+ * Der Frame ist geteilt; die Packet-ID wird vor jedem (Teil-)Schreiben gepatcht.
+ */
+struct OutboundFrame
+{
+    MQTTFramePtr frame;
+    uint16_t packetId = 0;
+    uint8_t qos = 0;       ///< QoS der Nachricht (Steuerpakete: 0, aber nicht verwerfbar)
+    bool droppable = false; ///< QoS-0-Nachricht, darf bei Überlast verworfen werden
+    size_t offset = 0;     ///< Bereits an AsyncTCP übergebene Bytes
+};
+
+/**
+ * QoS-1/2-Nachricht, die auf eine freie Packet-ID im In-Flight-Fenster wartet.
+ */
+struct PendingPublish
+{
+    MQTTFramePtr frame;
+    uint8_t qos = 0;
+    bool retain = false;
 };
 
 /**
@@ -86,7 +231,9 @@ struct Subscription
 struct MQTTClient
 {
     AsyncClient *client = nullptr;
+    uint32_t serial = 0; // eindeutig pro Verbindung (Timer-Einträge überleben den Client)
     String clientId;
+    String sourcePrefix; // "source:[clientId];" für SourceTagMode::LegacyPrefix, beim ersten PUBLISH gebildet
     bool connected = false;
     uint32_t lastActivity = 0;
     uint16_t keepAlive = 0;
@@ -103,10 +250,48 @@ struct MQTTClient
     size_t willPayloadLen = 0;
 
     // For QoS 1/2 messages sent *to* this client
-    std::map<uint16_t, struct OutgoingQoSMessage> outgoingMessages;
+    std::map<uint16_t, struct OutgoingQoSMessage, std::less<uint16_t>, MQTTPoolAllocator<std::pair<const uint16_t, OutgoingQoSMessage>>> outgoingMessages;
+    MQTTPacketIdAllocator packetIds; // Packet-IDs der outgoingMessages (Fenster = maxInflightMessages)
+    // Fenster voll: Nachrichten warten hier (höchstens maxPendingMessages), bis PUBACK/PUBCOMP eine ID freigibt
+    std::deque<PendingPublish, MQTTPoolAllocator<PendingPublish>> pending;
+
+    // QoS 2 messages received *from* this client, waiting for PUBREL
+    IncomingQoS2Table incomingQoS2;
 
     // KeepAlive tracking
     bool kaSeen = false;
+
+    // Reassemblierung von Paketen über TCP-Segmentgrenzen
+    MQTTFrameDecoder decoder;
+
+    // Sendewarteschlange, wenn der TCP-Sendepuffer (AsyncClient::space()) voll ist.
+    // Wird in onAck/onPoll geleert; begrenzt über die Watermarks der Broker-Konfiguration.
+    std::deque<OutboundFrame, MQTTPoolAllocator<OutboundFrame>> outbound;
+    size_t outboundBytes = 0;
+    bool outboundCongested = false; // über High-Watermark, bis Low-Watermark unterschritten ist
+    bool outboundOverflow = false;  // harte Grenze überschritten: nimmt nichts mehr an, loop() trennt die Verbindung
+    bool closeRequested = false;    // Protokollfehler: keine weiteren Pakete verarbeiten, loop() trennt die Verbindung
+    uint32_t outboundDropped = 0;
+
+    // Zustellmarke: verhindert Mehrfachzustellung, wenn mehrere Filter eines Clients passen
+    uint32_t deliveryMark = 0;
+    uint8_t deliveryQos = 0; // höchste gewährte QoS der passenden Filter (gültig zur aktuellen Marke)
+
+    // Clients kommen und gehen über die ganze Laufzeit: aus dem Slab-Pool statt vom Heap
+    static void *operator new(size_t size) { return mqttPool().allocate(size); }
+    static void operator delete(void *p, size_t size) { mqttPool().deallocate(p, size); }
+};
+
+/**
+ * Eintrag im Subscription-Baum: Abonnent + gewährte QoS des Filters.
+ * Gleichheit nur über den Client, damit remove() ohne QoS auskommt.
+ */
+struct SubscriberRef
+{
+    MQTTClient *client;
+    uint8_t qos;
+
+    bool operator==(const SubscriberRef &other) const { return client == other.client; }
 };
 
 /**
@@ -126,46 +311,89 @@ struct OutgoingQoSMessage
 {
     uint8_t qos;
     bool retain;
-    String topic;
-    std::unique_ptr<uint8_t[]> payload;
-    size_t payloadLen;
+    MQTTFramePtr frame; ///< Geteiltes, beim publish() kodiertes PUBLISH (Packet-ID wird beim Resend gepatcht)
     uint32_t sentTime;
     uint8_t retryCount;
     OutgoingQoSState state;
     uint16_t packetId;
+    uint32_t timerToken = 0; ///< Gültiger Timer-Eintrag für diese Nachricht (ältere werden ignoriert)
 
-    OutgoingQoSMessage() : qos(0), retain(false), payloadLen(0), sentTime(0), retryCount(0), state(OutgoingQoSState::AwaitingPuback), packetId(0) {}
+    OutgoingQoSMessage() : qos(0), retain(false), sentTime(0), retryCount(0), state(OutgoingQoSState::AwaitingPuback), packetId(0) {}
 };
 
 /**
- * Datenstruktur für gespeicherte (retained) Nachrichten
+ * Datenstruktur für gespeicherte (retained) Nachrichten.
+ * Die Nachricht liegt als fertig kodiertes PUBLISH (Retain-Bit gesetzt) vor, beim Replay
+ * wird der geteilte Frame nur noch geschrieben. Varianten mit niedrigerer QoS (Abonnent
+ * mit kleinerer gewährter QoS) werden beim ersten Bedarf aus diesem Frame erzeugt und behalten.
  */
 struct RetainedMessage
 {
     String topic;
-    std::unique_ptr<uint8_t[]> payload;
-    size_t length;
+    String source; ///< Publisher für die MQTT-5-User-Property (nur SourceTagMode::UserProperty)
+    size_t length; ///< Payload-Länge
     uint8_t qos;
+    MQTTFramePtr frames[2][3]; ///< PUBLISH je Protokoll (0 = 3.1.1, 1 = MQTT 5) und QoS-Stufe, frames[0][qos] immer vorhanden
+    uint32_t replayMark = 0; ///< Replay-Durchlauf, in dem die Nachricht zuletzt ausgewählt wurde
+    uint8_t replayQos = 0;   ///< Höchste gewährte QoS der passenden Filter in diesem Durchlauf
 
-    RetainedMessage(const String &t, const uint8_t *p, size_t len, uint8_t q)
-        : topic(t), length(len), qos(q)
+    RetainedMessage(MQTTView t, MQTTView src, size_t len, uint8_t q, const MQTTFramePtr &frame)
+        : length(len), qos(q)
     {
-        if (len > 0 && p != nullptr)
+        topic.concat(t.data, t.len);
+        source.concat(src.data, src.len);
+        frames[0][q] = frame;
+    }
+
+    /// Frame für die Zustellung mit QoS q (q <= qos), nullptr wenn nicht kodierbar
+    const MQTTFramePtr &frameFor(uint8_t q, bool v5)
+    {
+        MQTTFramePtr &frame = frames[v5][q];
+        if (!frame)
         {
-            payload.reset(new uint8_t[len]);
-            if (len <= MQTT_MAX_PAYLOAD_SIZE)
+            const MQTTSharedFrame &src = *frames[0][qos];
+            MQTTPublishOptions options;
+            options.v5 = v5;
+            options.source = mqttView(source);
+            options.heap = true;
+            MQTTView payload;
+            if (src.body)
             {
-                memcpy(payload.get(), p, len);
+                // Große Payload: Präfix am Ende des Kopfs, der Rest bleibt im geteilten Empfangspuffer
+                options.prefix = MQTTView(src.data.get() + src.length - length, length - src.bodyLength);
+                options.payloadOwner = src.body;
+                payload = MQTTView(src.bodyData, src.bodyLength);
             }
             else
             {
-                memcpy(payload.get(), p, MQTT_MAX_PAYLOAD_SIZE);
-                length = MQTT_MAX_PAYLOAD_SIZE;
+                payload = MQTTView(src.data.get() + src.length - length, length);
             }
+            frame = mqttBuildPublishFrame(mqttView(topic), payload, q, true, options);
         }
+        return frame;
     }
 };
 
+/**
+ * Verhalten bei voller Sendewarteschlange für QoS-0-Nachrichten.
+ * Neue QoS-1/2-Nachrichten werden bei Überlast immer abgelehnt (kein In-Flight-Zustand).
+ */
+enum class OutboundQoS0Policy
+{
+    DropOldest, ///< Älteste noch nicht begonnene QoS-0-Nachricht verwerfen
+    DropNewest  ///< Neue QoS-0-Nachricht verwerfen
+};
+
+/**
+ * Kennzeichnung weitergeleiteter Nachrichten mit der Client-ID des Publishers.
+ */
+enum class SourceTagMode
+{
+    Off,          ///< Payload unverändert weiterleiten
+    LegacyPrefix, ///< "source:[clientId];" vor die Payload von QoS-0/1-Nachrichten (bisheriges Verhalten)
+    UserProperty  ///< MQTT 5 User Property source=<clientId>, nur für MQTT-5-Abonnenten; Payload unverändert
+};
+
 /**
  * Konfigurationsstruktur für den MQTT-Broker
  */
@@ -175,40 +403,67 @@ struct ESPAsyncMQTTBrokerConfig
     String password = "";
     bool ignoreLoopDeliver = false;
     bool log = true;
-};
 
-struct IncomingQoS2Message
-{
-    String topic;
-    std::unique_ptr<uint8_t[]> payload;
-    size_t payload_len; // BP3-07: Einziges Größenfeld (vorher doppelt mit 'length')
-    bool retained;
-    String senderClientId;
-    String originalClientId;
+    // Sendewarteschlange pro Client (Bytes)
+    size_t outboundHighWatermark = 4096; ///< Ab hier gilt der Client als überlastet
+    size_t outboundLowWatermark = 1024;  ///< Unterhalb wird wieder normal eingereiht
+    // Steuerpakete (PUBACK, SUBACK, PINGRESP, ...) und Wiederholungen werden nie verworfen. Liest ein
+    // Client nicht mehr, begrenzt MQTT_OUTBOUND_HARD_LIMIT_FACTOR x outboundHighWatermark die Warteschlange:
+    // darüber wird die Verbindung getrennt.
+    OutboundQoS0Policy qos0Policy = OutboundQoS0Policy::DropOldest;
 
-    IncomingQoS2Message() : payload_len(0), retained(false) {}
+    // Maximal gleichzeitig unbestätigte QoS-1/2-Nachrichten pro Client (1..65535)
+    uint16_t maxInflightMessages = 16;
+    // QoS-1/2-Nachrichten, die bei vollem Fenster pro Client warten (0 = sofort verwerfen). Erst wenn
+    // auch diese Warteschlange voll ist, wird eine Nachricht verworfen.
+    uint16_t maxPendingMessages = 64;
+
+    // Log-Zeilen nur im Ring ablegen und erst in loop() formatieren/ausgeben (Serial, LoggingCallback).
+    // false: sofort ausgeben wie bisher (z.B. zur Fehlersuche bei Abstürzen). Der Ring (MQTT_LOG_RING_SLOTS
+    // x MQTT_LOG_RING_SLOT_SIZE, ~4,7 KB) wird erst mit setConfig()/begin() angelegt, wenn dies gesetzt ist.
+    bool deferredLogging = true;
+
+    // Größtes angenommenes Paket in Bytes (bis MQTT_MAX_PACKET_SIZE_LIMIT). Pakete über MQTT_MAX_PACKET_SIZE
+    // werden in einem eigenen Puffer (PSRAM, falls vorhanden) zusammengesetzt und ohne weitere Kopie der
+    // Payload stückweise an die Abonnenten gesendet; Payloads werden dann erst an dieser Grenze gekürzt.
+    size_t maxPacketSize = MQTT_MAX_PACKET_SIZE;
+
+    // Kennzeichnung weitergeleiteter Nachrichten mit dem Publisher (siehe SourceTagMode)
+    SourceTagMode sourceTag = SourceTagMode::LegacyPrefix;
 
-    IncomingQoS2Message(const String &t, const uint8_t *p, size_t len, bool ret, const String &clientId)
-        : topic(t), payload_len(len), retained(ret), senderClientId(clientId), originalClientId(clientId)
+    // Slab-Pool für Frames, QoS-Zustände und Clients (siehe MQTTSlabPool): Arena mit so vielen Bytes,
+    // angelegt bei der ersten Anforderung (0 = aus, alles vom Heap), bevorzugt im PSRAM.
+    // Kosten: die Arena wird sofort in voller Größe reserviert und nie zurückgegeben, auch wenn nur
+    // wenige Clients verbunden sind. Lohnt sich bei vielen Clients und langer Laufzeit gegen die
+    // Heap-Fragmentierung; Richtwert 16-32 KB (mindestens MQTT_POOL_SLAB_SIZE je genutzter Größenklasse).
+    size_t poolMaxBytes = MQTT_POOL_MAX_BYTES;
+    bool poolPsram = false;
+
+    // Metriken periodisch als Retained Messages unter $SYS/broker/... veröffentlichen (Sekunden, 0 = aus)
+    uint16_t sysInterval = 0;
+};
+
+/**
+ * Eintrag im Timer-Rad: Keep-Alive-Frist eines Clients oder Wiederholungsfrist einer QoS-Nachricht.
+ * token ist die Client-Seriennummer (KeepAlive) bzw. der timerToken der Nachricht (Retry).
+ */
+struct MQTTTimerRef
+{
+    enum Kind : uint8_t
     {
-        if (len > 0 && p != nullptr)
-        {
-            payload.reset(new uint8_t[len]);
-            if (len <= MQTT_MAX_PAYLOAD_SIZE)
-            {
-                memcpy(payload.get(), p, len);
-            }
-            else
-            {
-                memcpy(payload.get(), p, MQTT_MAX_PAYLOAD_SIZE);
-                payload_len = MQTT_MAX_PAYLOAD_SIZE;
-            }
-        }
-    }
+        KeepAlive,
+        Retry
+    };
+
+    AsyncClient *client;
+    uint32_t token;
+    uint16_t packetId;
+    Kind kind;
 };
 
 typedef std::function<void(const String& clientId, const String& clientIp, const String& username, int passwordLen)> ClientCallback;
 typedef std::function<void(const String& clientId, const String& topic, const String& message)> MessageCallback;
+typedef std::function<void(const String& clientId, const String& topic, const uint8_t *payload, size_t len)> BinaryMessageCallback;
 typedef std::function<void(const String& clientId)> ClientDisconnectCallback;
 typedef std::function<void(const String& clientId, int errorCode, const String& errorMessage)> ErrorCallback;
 typedef std::function<void(const String& clientId, const String& topic)> SubscribeCallback;
@@ -226,11 +481,15 @@ public:
     bool publish(const char *topic, const char *payload, bool retained = false, uint8_t qos = 0);
     bool publish(const char *topic, const char *payload, bool retained, uint8_t qos, const String &excludeClientId);
     bool publish(const char *topic, uint8_t qos, bool retained, const char *payload);
+    // Binäre Payload (z. B. Protobuf/CBOR), darf Nullbytes enthalten
+    bool publish(const char *topic, const uint8_t *payload, size_t len, bool retained = false, uint8_t qos = 0);
     void setConfig(const ESPAsyncMQTTBrokerConfig &config);
     void setDebugLevel(DebugLevel level) { debugLevel = level; }
     void setLoggingCallback(LoggingCallback callback) { loggingCallback = callback; }
     void onClientConnect(ClientCallback callback) { clientConnectCallback = callback; }
     void onMessage(MessageCallback callback) { messageCallback = callback; }
+    // Eingehende Nachrichten als Rohbytes (ohne Quelle-Präfix); payload ist nur während des Aufrufs gültig
+    void onMessageBinary(BinaryMessageCallback callback) { binaryMessageCallback = callback; }
     void onClientDisconnect(ClientDisconnectCallback callback) { clientDisconnectCallback = callback; }
     void onError(ErrorCallback callback) { errorCallback = callback; }
     void onSubscribe(SubscribeCallback callback) { subscribeCallback = callback; }
@@ -239,17 +498,48 @@ public:
     const std::map<String, String>& getConnectedClientsInfo() const { return connectedClientsInfo; }
 
     // ---- Connected-Clients API (für UI/Status ohne separaten Zähler) ----
-    // Gibt die Anzahl aktuell als "connected" markierter Sessions zurück.
+    // Gibt die Anzahl aktuell als "connected" markierter Sessions zurück (O(1), aus den Metriken).
     size_t getConnectedClientCount() const;
+
+    // ---- Metriken ----
+    // Atomare Zähler/Messwerte (auch aus einer anderen Task lesbar), siehe MQTTMetric
+    MQTTMetricsSnapshot getMetrics() const { return metrics.snapshot(); }
+    void resetMetrics() { metrics.resetCounters(); }
+
+    // ---- Speicher ----
+    // Trefferquote und Belegung des Slab-Pools sowie Fragmentierung des Heaps (ESP32)
+    MQTTPoolStats getPoolStats() const { return mqttPool().stats(); }
+
+#ifdef MQTT_TRACE
+    // ---- Laufzeitmessung (nur mit -DMQTT_TRACE) ----
+    // Histogramme in Zyklen (Host: rdtsc-Ticks bzw. ns), siehe MQTTTrace.h
+    const MQTTTraceHistogram &getTraceHistogram(MQTTTraceStage stage) const { return mqttTraceHistogram(stage); }
+    void resetTrace() { mqttTraceReset(); }
+    // Eine Zeile pro Stufe mit Anzahl, Mittelwert, p50/p99 und Maximum auf DEBUG_INFO ausgeben
+    void logTraceReport();
+#endif
+
+#ifdef MQTT_CAPTURE
+    // ---- Mitschnitt (nur mit -DMQTT_CAPTURE) ----
+    // Jedes eingehende Paket mit Verbindung und Zeitstempel kodiert an sink übergeben
+    // (Format: MQTTCapture.h). nullptr beendet den Mitschnitt und gibt den Rest aus.
+    void setCaptureSink(MQTTCaptureSink sink);
+#endif
     bool setPort(uint16_t newPort);
 
 private:
+    friend struct ESPAsyncMQTTBrokerTestAccess; // Host-Werkzeuge und -Tests (extras/host)
+
     uint16_t port;
     std::unique_ptr<AsyncServer> server;
     std::map<AsyncClient *, std::unique_ptr<MQTTClient>> clients;
-    std::map<String, std::unique_ptr<RetainedMessage>> retainedMessages;
+    MQTTTopicTree<std::unique_ptr<RetainedMessage>> retainedMessages; // Topic -> Retained Message
     std::map<String, std::unique_ptr<MQTTClient>> persistentSessions;
-    std::map<uint16_t, IncomingQoS2Message> incomingQoS2Messages;
+    MQTTTopicTree<SubscriberRef> subscriptionTree; // Filter -> verbundene Abonnenten
+    std::vector<MQTTClient *> routeScratch;       // wiederverwendete Zielliste für publish()
+    uint32_t deliveryMark = 0;
+    std::vector<RetainedMessage *> retainedScratch; // wiederverwendete Auswahl für sendRetainedMessages()
+    uint32_t retainedMark = 0;
     ESPAsyncMQTTBrokerConfig brokerConfig;
 
     // ---- Auth Cache (einmalig in setConfig() aufbauen) ----
@@ -259,21 +549,31 @@ private:
     DebugLevel debugLevel = DEBUG_INFO;  // ← Wird im Konstruktor überschrieben mit BROKER_DEBUG_LEVEL!
     esp_timer_handle_t timeoutTimer = nullptr;
     volatile bool checkTimeoutsFlag = false; // ISR-sicheres Flag fuer Timer-Callback (BP1-01)
+    bool closeClientsFlag = false; // Clients mit outboundOverflow oder closeRequested in loop() trennen
+    MQTTTimerWheel<MQTTTimerRef> timerWheel{MQTT_TIMER_TICK_MS};
+    uint32_t clientSerialCounter = 0;
+    uint32_t timerTokenCounter = 0;
     std::map<String, String> connectedClientsInfo;
-    uint16_t nextPacketId = 1;
-
-    uint16_t getNextPacketId();
 
     ClientCallback clientConnectCallback = nullptr;
     ClientDisconnectCallback clientDisconnectCallback = nullptr;
     MessageCallback messageCallback = nullptr;
+    BinaryMessageCallback binaryMessageCallback = nullptr;
     ErrorCallback errorCallback = nullptr;
     SubscribeCallback subscribeCallback = nullptr;
     UnsubscribeCallback unsubscribeCallback = nullptr;
     LoggingCallback loggingCallback = nullptr;
+    std::unique_ptr<MQTTLogRing> logRing; // verzögerte Log-Einträge aus den AsyncTCP-Callbacks (nur bei deferredLogging)
+    MQTTMetrics metrics;
+    uint32_t lastSysPublish = 0;
+    MQTTLargeBufferPtr largePacket; // Empfangspuffer des großen Pakets, das processPacket() gerade verarbeitet
+#ifdef MQTT_CAPTURE
+    MQTTCaptureWriter capture;
+#endif
 
     void handleConnect(MQTTClient *client, uint8_t *data, size_t len);
     void handlePublish(MQTTClient *client, uint8_t *data, size_t len, uint8_t header);
+    void notifyMessage(MQTTClient *client, MQTTView topic, MQTTView payload, MQTTView prefix);
     void handleSubscribe(MQTTClient *client, uint8_t *data, size_t len);
     void handleUnsubscribe(MQTTClient *client, uint8_t *data, size_t len);
     void handlePingReq(MQTTClient *client);
@@ -282,17 +582,47 @@ private:
     void handlePubRec(MQTTClient *client, uint8_t *data, size_t len);
     void handlePubRel(MQTTClient *client, uint8_t *data, size_t len);
     void handlePubComp(MQTTClient *client, uint8_t *data, size_t len);
+    void handleData(AsyncClient *asyncClient, MQTTClient *client, uint8_t *data, size_t len);
     void processPacket(MQTTClient *client, uint8_t *data, size_t len);
-    bool topicMatches(const Subscription &subscription, const String &topic);
-    bool topicMatches(const String &subscription, const String &topic);
-    void sendRetainedMessages(MQTTClient *client);
+    bool writeFrame(MQTTClient *client, const MQTTFramePtr &frame, uint16_t packetId, uint8_t qos, bool droppable);
+    void writeControl(MQTTClient *client, const uint8_t *data, size_t len);
+    void drainOutbound(MQTTClient *client);
+    bool deliverPublish(MQTTClient *client, const MQTTFramePtr &frame, uint8_t qos, bool retain);
+    bool startPublish(MQTTClient *client, const MQTTFramePtr &frame, uint8_t qos, bool retain, uint16_t packetId);
+    void releasePacketId(MQTTClient *client, uint16_t packetId);
+    void sendPending(MQTTClient *client);
+    void sendRetainedMessages(MQTTClient *client, const std::vector<Subscription> &filters);
     bool authenticateClient(const String &username, const String &password);
     void onClient(AsyncClient *client);
     void checkTimeouts();
-    void logMessage(DebugLevel level, const char *format, ...);
-    bool isValidPublishTopic(const String &topic);
+    void scheduleKeepAlive(MQTTClient *client);
+    void scheduleRetry(MQTTClient *client, OutgoingQoSMessage &outMsg);
+    void handleTimer(const MQTTTimerRef &ref, uint32_t now);
+    template <typename... Args>
+    void logMessage(DebugLevel level, const char *format, const Args &...args)
+    {
+        if (!logEnabled(level))
+            return;
+        if (brokerConfig.deferredLogging && logRing)
+            logRing->push(level, format, args...); // Formatieren und Ausgeben erst in loop()
+        else
+            writeLog(level, format, MQTTLogArg<Args>(args).get()...);
+    }
+    bool logEnabled(DebugLevel level) const { return level != DEBUG_NONE && level <= debugLevel; }
+    void writeLog(DebugLevel level, const char *format, ...);
+    void emitLog(DebugLevel level, const char *message);
+    void drainLog();
+    void setConnected(MQTTClient *client, bool connected);
+    void publishSysTopics();
+    bool isValidPublishTopic(MQTTView topic);
     bool isValidTopicFilter(const String &filter);
-    bool publish(const char *topic, const uint8_t *payload, size_t payloadLen, bool retained, uint8_t qos, const String &excludeClientId);
+    // Topic und Payload als Sicht (z. B. in den Empfangspuffer); prefix wird der Payload vorangestellt,
+    // source geht als User Property an MQTT-5-Abonnenten. payloadOwner: Payload liegt in diesem Puffer
+    // und wird nicht in die Frames kopiert (große Pakete)
+    bool publish(MQTTView topic, MQTTView payload, bool retained, uint8_t qos, const String &excludeClientId,
+                 MQTTView prefix = MQTTView(), MQTTView source = MQTTView(), const MQTTLargeBufferPtr &payloadOwner = MQTTLargeBufferPtr());
+    // Größte Payload: MQTT_MAX_PAYLOAD_SIZE bzw. maxPacketSize, wenn große Pakete erlaubt sind
+    size_t payloadLimit() const { return brokerConfig.maxPacketSize > MQTT_MAX_PACKET_SIZE ? brokerConfig.maxPacketSize : MQTT_MAX_PAYLOAD_SIZE; }
     // BP3-06: isUserAllowed() als toter Code entfernt
 };
 
@@ -0,0 +1,184 @@
+#ifndef MQTT_CAPTURE_H
+#define MQTT_CAPTURE_H
+
+/**
+ * Mitschnitt eingehender Pakete und Leser für das Mitschnitt-Format.
+ *
+ * Der Broker schreibt nur mit Build-Flag -DMQTT_CAPTURE (ESPAsyncMQTTBroker::setCaptureSink()),
+ * der Leser ist immer verfügbar (Replay im Host-Build: extras/host/replay.cpp).
+ *
+ * Format, Ganzzahlen als LEB128-Varint:
+ *   Kopf:    "MQCP", Version (1 Byte)
+ *   Eintrag: Art (1 Byte), Abstand zum vorigen Eintrag in µs, Verbindung,
+ *            bei Art Packet zusätzlich Länge und Paket (wie processPacket() es erhält)
+ * Die Verbindung ist die Seriennummer des Clients (eindeutig je TCP-Verbindung), die Zeit kommt
+ * aus esp_timer_get_time() beim Eintritt in processPacket(). Ein PUBLISH mit kurzem Topic kostet
+ * damit nur 4-6 Bytes mehr als das Paket selbst.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+enum class MQTTCaptureKind : uint8_t
+{
+    Packet = 1, ///< eingehendes Paket
+    Closed = 2  ///< Verbindung beendet (Client, Broker oder Netzwerk)
+};
+
+static const uint8_t MQTT_CAPTURE_VERSION = 1;
+
+/// Empfänger der kodierten Blöcke (z. B. Datei auf SD-Karte/LittleFS, im Host-Build fwrite())
+typedef std::function<void(const uint8_t *data, size_t len)> MQTTCaptureSink;
+
+/**
+ * Sammelt Einträge in einem Puffer und gibt ihn blockweise an die Senke weiter, sobald
+ * BufferSize erreicht ist sowie bei flush()/end(). Die Senke läuft damit im Netzwerk-Task
+ * und sollte schnell zurückkehren.
+ */
+class MQTTCaptureWriter
+{
+public:
+    static const size_t BufferSize = 4096;
+
+    void begin(MQTTCaptureSink sink, int64_t timeUs)
+    {
+        end();
+        this->sink = sink;
+        if (!this->sink)
+            return;
+        buffer.reserve(BufferSize + 64);
+        const uint8_t header[5] = {'M', 'Q', 'C', 'P', MQTT_CAPTURE_VERSION};
+        buffer.insert(buffer.end(), header, header + sizeof(header));
+        lastTimeUs = timeUs;
+    }
+
+    void end()
+    {
+        flush();
+        sink = nullptr;
+        std::vector<uint8_t>().swap(buffer);
+    }
+
+    bool active() const { return (bool)sink; }
+
+    void packet(uint32_t client, const uint8_t *data, size_t len, int64_t timeUs)
+    {
+        record(MQTTCaptureKind::Packet, client, timeUs);
+        putVarint(len);
+        buffer.insert(buffer.end(), data, data + len);
+        if (buffer.size() >= BufferSize)
+            flush();
+    }
+
+    void closed(uint32_t client, int64_t timeUs)
+    {
+        record(MQTTCaptureKind::Closed, client, timeUs);
+        if (buffer.size() >= BufferSize)
+            flush();
+    }
+
+    void flush()
+    {
+        if (sink && !buffer.empty())
+            sink(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+    void record(MQTTCaptureKind kind, uint32_t client, int64_t timeUs)
+    {
+        buffer.push_back((uint8_t)kind);
+        putVarint(timeUs > lastTimeUs ? (uint64_t)(timeUs - lastTimeUs) : 0);
+        lastTimeUs = timeUs;
+        putVarint(client);
+    }
+
+    void putVarint(uint64_t value)
+    {
+        do
+        {
+            uint8_t b = value & 0x7F;
+            value >>= 7;
+            buffer.push_back(value ? b | 0x80 : b);
+        } while (value);
+    }
+
+    MQTTCaptureSink sink;
+    std::vector<uint8_t> buffer;
+    int64_t lastTimeUs = 0;
+};
+
+/// Ein gelesener Eintrag; data zeigt in den Puffer des Lesers
+struct MQTTCaptureRecord
+{
+    MQTTCaptureKind kind;
+    int64_t timeUs;  ///< seit Beginn des Mitschnitts
+    uint32_t client;
+    const uint8_t *data;
+    size_t len;
+};
+
+/// Liest einen Mitschnitt aus dem Speicher (ohne Kopie)
+class MQTTCaptureReader
+{
+public:
+    MQTTCaptureReader(const uint8_t *data, size_t len) : data(data), len(len)
+    {
+        valid = len >= 5 && memcmp(data, "MQCP", 4) == 0 && data[4] == MQTT_CAPTURE_VERSION;
+        pos = valid ? 5 : len;
+    }
+
+    /// false, wenn Kopf oder Version nicht passen
+    bool isValid() const { return valid; }
+    /// true, wenn das Ende mitten in einem Eintrag lag (z. B. abgebrochener Mitschnitt)
+    bool truncated() const { return broken; }
+
+    bool next(MQTTCaptureRecord &record)
+    {
+        if (pos >= len)
+            return false;
+        uint64_t delta, client, size = 0;
+        uint8_t kind = data[pos++];
+        if (!getVarint(delta) || !getVarint(client) ||
+            (kind == (uint8_t)MQTTCaptureKind::Packet && (!getVarint(size) || size > len - pos)) ||
+            (kind != (uint8_t)MQTTCaptureKind::Packet && kind != (uint8_t)MQTTCaptureKind::Closed))
+        {
+            broken = true;
+            pos = len;
+            return false;
+        }
+        timeUs += (int64_t)delta;
+        record.kind = (MQTTCaptureKind)kind;
+        record.timeUs = timeUs;
+        record.client = (uint32_t)client;
+        record.data = data + pos;
+        record.len = (size_t)size;
+        pos += (size_t)size;
+        return true;
+    }
+
+private:
+    bool getVarint(uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < len; shift += 7)
+        {
+            uint8_t b = data[pos++];
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    int64_t timeUs = 0;
+    bool valid;
+    bool broken = false;
+};
+
+#endif // MQTT_CAPTURE_H
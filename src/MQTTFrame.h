@@ -0,0 +1,234 @@
+#ifndef MQTT_FRAME_H
+#define MQTT_FRAME_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include "MQTTPool.h"
+#include "MQTTView.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+/**
+ * Puffer für große Pakete (über MQTT_MAX_PACKET_SIZE, siehe ESPAsyncMQTTBrokerConfig::maxPacketSize).
+ * Auf dem ESP32 bevorzugt im PSRAM, ohne PSRAM im internen Heap. Der Empfangspuffer eines großen
+ * PUBLISH wird über diesen Zeiger von allen ausgehenden Frames geteilt statt kopiert.
+ */
+typedef std::shared_ptr<uint8_t> MQTTLargeBufferPtr;
+
+/// nullptr, wenn der Speicher nicht reicht
+inline MQTTLargeBufferPtr mqttAllocLargeBuffer(size_t len)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+    void *p = heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p)
+        p = heap_caps_malloc(len, MALLOC_CAP_8BIT);
+    if (!p)
+        return MQTTLargeBufferPtr();
+    return MQTTLargeBufferPtr((uint8_t *)p, [](uint8_t *q)
+                              { heap_caps_free(q); });
+#else
+    void *p = malloc(len);
+    if (!p)
+        return MQTTLargeBufferPtr();
+    return MQTTLargeBufferPtr((uint8_t *)p, [](uint8_t *q)
+                              { free(q); });
+#endif
+}
+
+/**
+ * Fertig kodiertes MQTT-Paket, das von mehreren Empfängern gemeinsam genutzt wird.
+ *
+ * publish() kodiert ein PUBLISH nur einmal pro Variante und teilt den Puffer über
+ * std::shared_ptr mit allen Abonnenten und den QoS-Wiederholungen. Pro Empfänger
+ * wird nur die Packet-ID gepatcht (setPacketId() direkt vor dem write()).
+ *
+ * Große PUBLISH liegen geteilt vor: data enthält nur den Kopf (bis einschließlich Properties
+ * und Präfix), die Payload bleibt im Empfangspuffer (body) und wird stückweise gesendet (chunkAt()).
+ */
+struct MQTTSharedFrame
+{
+    MQTTPoolBuffer data;             ///< ganzes Paket bzw. nur der Kopf, wenn body gesetzt ist
+    size_t length = 0;               ///< Gesamtlänge inklusive bodyLength
+    size_t packetIdOffset = 0; ///< Position der Packet-ID im Puffer (0 = keine, QoS 0)
+    MQTTLargeBufferPtr body;           ///< Besitzer der ausgelagerten Payload (leer: alles in data)
+    const uint8_t *bodyData = nullptr; ///< Payload innerhalb von body
+    size_t bodyLength = 0;
+
+    size_t headLength() const { return length - bodyLength; }
+
+    /// Zusammenhängendes Stück ab offset (Kopf oder ausgelagerte Payload), chunkLen bis zu dessen Ende
+    const uint8_t *chunkAt(size_t offset, size_t &chunkLen) const
+    {
+        size_t head = length - bodyLength;
+        if (offset < head)
+        {
+            chunkLen = head - offset;
+            return data.get() + offset;
+        }
+        chunkLen = length - offset;
+        return bodyData + (offset - head);
+    }
+
+    void setPacketId(uint16_t packetId)
+    {
+        if (packetIdOffset > 0)
+        {
+            data[packetIdOffset] = packetId >> 8;
+            data[packetIdOffset + 1] = packetId & 0xFF;
+        }
+    }
+};
+
+typedef std::shared_ptr<MQTTSharedFrame> MQTTFramePtr;
+
+/// Leerer Frame; Objekt und Referenzzähler liegen in einem Block aus mqttPool()
+inline MQTTFramePtr mqttNewFrame()
+{
+    return std::allocate_shared<MQTTSharedFrame>(MQTTPoolAllocator<MQTTSharedFrame>());
+}
+
+/// Leerer Frame vom Heap (langlebige Frames, z.B. Retained Messages)
+inline MQTTFramePtr mqttNewHeapFrame()
+{
+    return std::make_shared<MQTTSharedFrame>();
+}
+
+#define MQTT_MAX_REMAINING_LENGTH 268435455 // 4 Längen-Bytes
+
+// Anzahl Bytes der Variable-Length-Kodierung einer Remaining Length
+inline size_t mqttRemainingLengthSize(size_t remainingLength)
+{
+    if (remainingLength <= 127)
+        return 1;
+    if (remainingLength <= 16383)
+        return 2;
+    if (remainingLength <= 2097151)
+        return 3;
+    return 4;
+}
+
+// Variable-Length-Kodierung schreiben, gibt die Position hinter den Längen-Bytes zurück
+inline uint8_t *mqttEncodeRemainingLength(uint8_t *ptr, size_t remainingLength)
+{
+    do
+    {
+        uint8_t byte = remainingLength % 128;
+        remainingLength /= 128;
+        if (remainingLength > 0)
+            byte |= 128;
+        *ptr++ = byte;
+    } while (remainingLength > 0);
+    return ptr;
+}
+
+// Variable-Length-Kodierung ab data[index] lesen, index zeigt danach hinter die Längen-Bytes.
+// false bei mehr als 4 Bytes oder wenn das Ende vorher erreicht ist.
+inline bool mqttDecodeRemainingLength(const uint8_t *data, size_t len, size_t &index, uint32_t &value)
+{
+    value = 0;
+    for (uint32_t shift = 0; shift < 28; shift += 7)
+    {
+        if (index >= len)
+            return false;
+        uint8_t byte = data[index++];
+        value |= (uint32_t)(byte & 127) << shift;
+        if (!(byte & 128))
+            return true;
+    }
+    return false;
+}
+
+/// Zusätzliche Teile eines weitergeleiteten PUBLISH
+struct MQTTPublishOptions
+{
+    bool v5 = false; ///< MQTT 5: Properties-Block hinter der Packet-ID (leer: ein Längen-Byte 0)
+    MQTTView source; ///< nur v5: User Property "source" = source (leer = keine)
+    MQTTView prefix; ///< wird direkt vor die Payload kodiert
+    MQTTLargeBufferPtr payloadOwner; ///< gesetzt: Payload nicht kopieren, der Frame verweist auf diesen Puffer
+    bool heap = false; ///< Frame und Kopf vom Heap statt aus mqttPool() (Retained: lebt beliebig lange)
+};
+
+// Länge der MQTT-5-Properties ohne das Längenfeld
+inline size_t mqttPublishPropertiesLength(const MQTTPublishOptions &options)
+{
+    return options.source.empty() ? 0 : 1 + 2 + 6 + 2 + options.source.len; // 0x26, "source", Wert
+}
+
+/**
+ * Kodiert ein komplettes PUBLISH-Paket (Fixed Header, Topic, Packet-ID-Platzhalter, Properties, Payload).
+ * Präfix und Payload werden direkt hintereinander in den Frame kopiert (kein zusammengesetzter
+ * Zwischenpuffer). Gibt nullptr zurück, wenn das Paket nicht kodierbar ist.
+ */
+inline MQTTFramePtr mqttBuildPublishFrame(MQTTView topic, MQTTView payload, uint8_t qos, bool retain, const MQTTPublishOptions &options)
+{
+    size_t packetIdLen = (qos > 0) ? 2 : 0;
+    size_t propertiesLen = mqttPublishPropertiesLength(options);
+    size_t propertiesBlock = options.v5 ? mqttRemainingLengthSize(propertiesLen) + propertiesLen : 0;
+    size_t remainingLength = 2 + topic.len + packetIdLen + propertiesBlock + options.prefix.len + payload.len;
+    if (topic.len > 0xFFFF || options.source.len > 0xFFFF || remainingLength > MQTT_MAX_REMAINING_LENGTH)
+    {
+        return nullptr;
+    }
+
+    MQTTFramePtr frame = options.heap ? mqttNewHeapFrame() : mqttNewFrame();
+    frame->length = 1 + mqttRemainingLengthSize(remainingLength) + remainingLength;
+    if (options.payloadOwner && !payload.empty())
+    {
+        frame->body = options.payloadOwner;
+        frame->bodyData = payload.bytes();
+        frame->bodyLength = payload.len;
+    }
+    frame->data = options.heap ? mqttHeapBuffer(frame->headLength()) : mqttPoolBuffer(frame->headLength());
+
+    uint8_t *ptr = frame->data.get();
+    *ptr++ = (3 << 4) | (qos << 1) | (retain ? 1 : 0); // MQTT_PUBLISH
+    ptr = mqttEncodeRemainingLength(ptr, remainingLength);
+    *ptr++ = topic.len >> 8;
+    *ptr++ = topic.len & 0xFF;
+    memcpy(ptr, topic.data, topic.len);
+    ptr += topic.len;
+    if (qos > 0)
+    {
+        frame->packetIdOffset = ptr - frame->data.get();
+        *ptr++ = 0;
+        *ptr++ = 0;
+    }
+    if (options.v5)
+    {
+        ptr = mqttEncodeRemainingLength(ptr, propertiesLen);
+        if (!options.source.empty())
+        {
+            *ptr++ = 0x26; // User Property
+            *ptr++ = 0;
+            *ptr++ = 6;
+            memcpy(ptr, "source", 6);
+            ptr += 6;
+            *ptr++ = options.source.len >> 8;
+            *ptr++ = options.source.len & 0xFF;
+            memcpy(ptr, options.source.data, options.source.len);
+            ptr += options.source.len;
+        }
+    }
+    if (!options.prefix.empty())
+    {
+        memcpy(ptr, options.prefix.data, options.prefix.len);
+        ptr += options.prefix.len;
+    }
+    if (!payload.empty() && !frame->body)
+    {
+        memcpy(ptr, payload.data, payload.len);
+    }
+    return frame;
+}
+
+inline MQTTFramePtr mqttBuildPublishFrame(const char *topic, size_t topicLen, const uint8_t *payload, size_t payloadLen,
+                                          uint8_t qos, bool retain)
+{
+    return mqttBuildPublishFrame(MQTTView(topic, topicLen), MQTTView(payload, payloadLen), qos, retain, MQTTPublishOptions());
+}
+
+#endif // MQTT_FRAME_H
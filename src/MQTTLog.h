@@ -0,0 +1,74 @@
+#ifndef MQTT_LOG_H
+#define MQTT_LOG_H
+
+#include "MQTTView.h"
+
+/**
+ * Debug-Level für Logging
+ *  DEBUG_NONE = 0,     ///< Keine Debug-Ausgaben
+ *  DEBUG_ERROR = 1,    ///< Nur Fehler werden angezeigt
+ *  DEBUG_WARNING = 2,  ///< Warnungen und Fehler werden angezeigt
+ *  DEBUG_INFO = 3,     ///< Warnungen, Fehler und Informationen werden angezeigt
+ *  DEBUG_DEBUG = 4     ///< Alle Details werden angezeigt (inklusive Debug-Informationen)
+ */
+enum DebugLevel
+{
+    DEBUG_NONE = 0,    ///< Keine Debug-Ausgaben
+    DEBUG_ERROR = 1,   ///< Nur Fehler werden angezeigt
+    DEBUG_WARNING = 2, ///< Warnungen und Fehler werden angezeigt
+    DEBUG_INFO = 3,    ///< Warnungen, Fehler und Informationen werden angezeigt
+    DEBUG_DEBUG = 4    ///< Alle Details werden angezeigt (inklusive Debug-Informationen)
+};
+
+/**
+ * Höchstes Log-Level, das überhaupt einkompiliert wird (Build-Flag, z.B. -DBROKER_LOG_COMPILE_LEVEL=2).
+ * Aufrufe oberhalb dieses Levels werden samt Argumenten (c_str(), String-Temporäre) vom
+ * Compiler entfernt. Zur Laufzeit filtert zusätzlich setDebugLevel() bzw. BROKER_DEBUG_LEVEL.
+ */
+#ifndef BROKER_LOG_COMPILE_LEVEL
+#define BROKER_LOG_COMPILE_LEVEL 4 // DEBUG_DEBUG: alles einkompilieren
+#endif
+
+constexpr bool mqttLogCompiled(DebugLevel level)
+{
+    return level > DEBUG_NONE && level <= BROKER_LOG_COMPILE_LEVEL;
+}
+
+/**
+ * Argument für die sofortige Ausgabe (writeLog(), printf-Varargs): MQTTView wird als
+ * nullterminierte Kopie übergeben (gekürzt auf die Länge einer Log-Zeile), alles andere unverändert.
+ */
+template <typename T>
+struct MQTTLogArg
+{
+    const T &value;
+    explicit MQTTLogArg(const T &value) : value(value) {}
+    const T &get() const { return value; }
+};
+
+template <>
+struct MQTTLogArg<MQTTView>
+{
+    char text[256];
+    explicit MQTTLogArg(const MQTTView &view)
+    {
+        size_t len = view.len < sizeof(text) - 1 ? view.len : sizeof(text) - 1;
+        if (len > 0)
+            memcpy(text, view.data, len);
+        text[len] = 0;
+    }
+    const char *get() const { return text; }
+};
+
+// Logger-Makros: Argumente werden nur ausgewertet, wenn das Level einkompiliert und aktiv ist.
+// Das Ziel braucht logEnabled(level) und logMessage(level, format, ...) (ESPAsyncMQTTBroker).
+#define MQTT_LOG_TO(broker, level, format, ...)                           \
+    do                                                                    \
+    {                                                                     \
+        if (mqttLogCompiled(level) && (broker)->logEnabled(level))        \
+            (broker)->logMessage(level, format, ##__VA_ARGS__);           \
+    } while (0)
+
+#define MQTT_LOG(level, format, ...) MQTT_LOG_TO(this, level, format, ##__VA_ARGS__)
+
+#endif // MQTT_LOG_H
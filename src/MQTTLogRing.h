@@ -0,0 +1,375 @@
+#ifndef MQTT_LOG_RING_H
+#define MQTT_LOG_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include "MQTTView.h"
+
+#ifndef MQTT_LOG_RING_SLOTS
+#define MQTT_LOG_RING_SLOTS 16 // Anzahl Einträge (Zweierpotenz)
+#endif
+#ifndef MQTT_LOG_RING_SLOT_SIZE
+// Bytes für die Argumente eines Eintrags: Platz für 256 Zeichen String-Argumente (so viel wie der
+// Ausgabepuffer von writeLog()/drainLog()) plus Typ-Bytes, Terminatoren und einige Zahlen (je 9 Bytes).
+// Was darüber hinausgeht, wird gekürzt; 16 Slots belegen damit ~4,7 KB RAM (Heap, nur bei
+// ESPAsyncMQTTBrokerConfig::deferredLogging).
+#define MQTT_LOG_RING_SLOT_SIZE 288
+#endif
+
+/**
+ * Lock-freier Log-Puffer (mehrere Schreiber, ein Leser) für verzögerte Log-Ausgabe.
+ *
+ * push() speichert nur den Format-Zeiger und die rohen Argumente; Strings werden in den
+ * Eintrag kopiert, weil c_str()-Zeiger beim Ausgeben nicht mehr gültig sein müssen. Das
+ * Formatieren (snprintf) und die langsame Ausgabe übernimmt der Leser in loop(), die
+ * AsyncTCP-Callbacks blockieren so nie auf der seriellen Schnittstelle.
+ *
+ * Der Format-String muss ein Literal sein (bzw. bis zum Ausgeben gültig bleiben).
+ * Ist der Puffer voll, wird der Eintrag verworfen und dropped() erhöht.
+ *
+ * Jeder Slot trägt eine Sequenznummer (beschränkte Queue nach D. Vyukov): Schreiber
+ * reservieren per compare_exchange eine Position und geben den Slot mit sequence = pos + 1
+ * frei, der Leser gibt ihn mit pos + Slots für die nächste Runde zurück.
+ */
+class MQTTLogRing
+{
+public:
+    MQTTLogRing()
+    {
+        static_assert((MQTT_LOG_RING_SLOTS & (MQTT_LOG_RING_SLOTS - 1)) == 0, "MQTT_LOG_RING_SLOTS muss eine Zweierpotenz sein");
+        for (uint32_t i = 0; i < MQTT_LOG_RING_SLOTS; i++)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// Eintrag ablegen. Gibt false zurück (und zählt dropped()), wenn der Puffer voll ist.
+    template <typename... Args>
+    bool push(uint8_t level, const char *format, const Args &...args)
+    {
+        uint32_t pos = tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true)
+        {
+            slot = &slots[pos & (MQTT_LOG_RING_SLOTS - 1)];
+            uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - pos);
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->level = level;
+        slot->format = format;
+        slot->used = 0;
+        slot->argCount = 0;
+        int expand[] = {0, (put(*slot, args), 0)...};
+        (void)expand;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Ältesten Eintrag formatieren und entnehmen (nur ein Leser).
+     * Gibt false zurück, wenn der Puffer leer ist.
+     */
+    bool pop(uint8_t &level, char *out, size_t outSize)
+    {
+        Slot &slot = slots[head & (MQTT_LOG_RING_SLOTS - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+        {
+            return false;
+        }
+        level = slot.level;
+        format(slot, out, outSize);
+        slot.sequence.store(head + MQTT_LOG_RING_SLOTS, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    /// Verworfene Einträge seit dem letzten Aufruf (setzt den Zähler zurück)
+    uint32_t takeDropped() { return droppedCount.exchange(0, std::memory_order_relaxed); }
+
+    uint32_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    enum ArgType : uint8_t
+    {
+        ArgSigned = 'i',
+        ArgUnsigned = 'u',
+        ArgDouble = 'f',
+        ArgString = 's',
+        ArgPointer = 'p'
+    };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        uint8_t level;
+        uint8_t argCount;
+        uint16_t used;
+        const char *format;
+        uint8_t data[MQTT_LOG_RING_SLOT_SIZE]; ///< Folge von [Typ][Wert], Strings als [s][Bytes][0]
+    };
+
+    // --- Argumente ablegen ---
+
+    static bool putRaw(Slot &slot, ArgType type, const void *value, size_t len)
+    {
+        if (slot.used + 1 + len > MQTT_LOG_RING_SLOT_SIZE)
+            return false;
+        slot.data[slot.used] = type;
+        memcpy(slot.data + slot.used + 1, value, len);
+        slot.used += 1 + len;
+        slot.argCount++;
+        return true;
+    }
+
+    static void put(Slot &slot, const char *s)
+    {
+        if (!s)
+            s = "(null)";
+        // String gekürzt kopieren, Platz für Typ-Byte und Terminator lassen
+        if (slot.used + 2 > MQTT_LOG_RING_SLOT_SIZE)
+            return;
+        size_t room = MQTT_LOG_RING_SLOT_SIZE - slot.used - 2;
+        size_t len = strnlen(s, room);
+        slot.data[slot.used] = ArgString;
+        memcpy(slot.data + slot.used + 1, s, len);
+        slot.data[slot.used + 1 + len] = 0;
+        slot.used += len + 2;
+        slot.argCount++;
+    }
+
+    static void put(Slot &slot, char *s) { put(slot, (const char *)s); }
+
+    // Sicht ohne Terminator: höchstens len Bytes kopieren (bis zum ersten Nullbyte)
+    static void put(Slot &slot, const MQTTView &s)
+    {
+        if (slot.used + 2 > MQTT_LOG_RING_SLOT_SIZE)
+            return;
+        size_t room = MQTT_LOG_RING_SLOT_SIZE - slot.used - 2;
+        size_t len = s.data ? strnlen(s.data, s.len < room ? s.len : room) : 0;
+        slot.data[slot.used] = ArgString;
+        if (len > 0)
+            memcpy(slot.data + slot.used + 1, s.data, len);
+        slot.data[slot.used + 1 + len] = 0;
+        slot.used += len + 2;
+        slot.argCount++;
+    }
+
+    static void put(Slot &slot, double value) { putRaw(slot, ArgDouble, &value, sizeof(value)); }
+
+    static void put(Slot &slot, float value) { put(slot, (double)value); }
+
+    template <typename T>
+    static void put(Slot &slot, const T *value)
+    {
+        const void *p = value;
+        putRaw(slot, ArgPointer, &p, sizeof(p));
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type put(Slot &slot, const T &value)
+    {
+        if (std::is_enum<T>::value || std::is_signed<T>::value)
+        {
+            long long v = (long long)value;
+            putRaw(slot, ArgSigned, &v, sizeof(v));
+        }
+        else
+        {
+            unsigned long long v = (unsigned long long)value;
+            putRaw(slot, ArgUnsigned, &v, sizeof(v));
+        }
+    }
+
+    // --- Formatieren ---
+
+    struct Reader
+    {
+        const uint8_t *ptr;
+        uint8_t remaining;
+    };
+
+    static void append(char *out, size_t outSize, size_t &pos, const char *s, size_t len)
+    {
+        if (pos + 1 >= outSize)
+            return;
+        size_t n = (len < outSize - 1 - pos) ? len : outSize - 1 - pos;
+        memcpy(out + pos, s, n);
+        pos += n;
+    }
+
+    // Eine Konvertierung mit dem passenden C-Typ formatieren
+    static void formatArg(char *out, size_t outSize, size_t &pos, const char *spec, size_t specLen, char conv, Reader &args)
+    {
+        if (args.remaining == 0)
+        {
+            append(out, outSize, pos, spec, specLen); // fehlendes Argument: Spezifizierer unverändert ausgeben
+            return;
+        }
+
+        // Flags/Breite/Genauigkeit übernehmen, Längenmodifikatoren durch den gespeicherten Typ ersetzen
+        char fmt[24];
+        size_t f = 0;
+        for (size_t i = 0; i < specLen - 1 && f < sizeof(fmt) - 4; i++)
+        {
+            if (!strchr("hljztL", spec[i]))
+                fmt[f++] = spec[i];
+        }
+
+        uint8_t type = *args.ptr++;
+        args.remaining--;
+        long long sv = 0;
+        unsigned long long uv = 0;
+        double dv = 0;
+        const char *sp = nullptr;
+        const void *pv = nullptr;
+        switch (type)
+        {
+        case ArgSigned:
+            memcpy(&sv, args.ptr, sizeof(sv));
+            args.ptr += sizeof(sv);
+            uv = (unsigned long long)sv;
+            dv = (double)sv;
+            break;
+        case ArgUnsigned:
+            memcpy(&uv, args.ptr, sizeof(uv));
+            args.ptr += sizeof(uv);
+            sv = (long long)uv;
+            dv = (double)uv;
+            break;
+        case ArgDouble:
+            memcpy(&dv, args.ptr, sizeof(dv));
+            args.ptr += sizeof(dv);
+            sv = (long long)dv;
+            uv = (unsigned long long)dv;
+            break;
+        case ArgString:
+            sp = (const char *)args.ptr;
+            args.ptr += strlen(sp) + 1;
+            break;
+        default:
+            memcpy(&pv, args.ptr, sizeof(pv));
+            args.ptr += sizeof(pv);
+            uv = (unsigned long long)(uintptr_t)pv;
+            break;
+        }
+
+        char buf[64];
+        int n;
+        if (conv == 's')
+        {
+            fmt[f++] = 's';
+            fmt[f] = 0;
+            if (!sp)
+            {
+                n = snprintf(buf, sizeof(buf), "%lld", sv);
+                append(out, outSize, pos, buf, n > 0 ? (size_t)n : 0);
+                return;
+            }
+            // Strings direkt in den Ausgabepuffer (können länger als buf sein)
+            n = snprintf(out + pos, outSize - pos, fmt, sp);
+            if (n > 0)
+                pos += ((size_t)n < outSize - pos) ? (size_t)n : outSize - pos - 1;
+            return;
+        }
+        if (sp)
+        {
+            append(out, outSize, pos, sp, strlen(sp));
+            return;
+        }
+        if (strchr("di", conv))
+        {
+            fmt[f++] = 'l';
+            fmt[f++] = 'l';
+            fmt[f++] = conv;
+            fmt[f] = 0;
+            n = snprintf(buf, sizeof(buf), fmt, sv);
+        }
+        else if (strchr("uxXo", conv))
+        {
+            fmt[f++] = 'l';
+            fmt[f++] = 'l';
+            fmt[f++] = conv;
+            fmt[f] = 0;
+            n = snprintf(buf, sizeof(buf), fmt, uv);
+        }
+        else if (strchr("fFeEgGaA", conv))
+        {
+            fmt[f++] = conv;
+            fmt[f] = 0;
+            n = snprintf(buf, sizeof(buf), fmt, dv);
+        }
+        else if (conv == 'c')
+        {
+            fmt[f++] = 'c';
+            fmt[f] = 0;
+            n = snprintf(buf, sizeof(buf), fmt, (int)sv);
+        }
+        else
+        {
+            n = snprintf(buf, sizeof(buf), "%p", pv);
+        }
+        append(out, outSize, pos, buf, n > 0 ? (size_t)n : 0);
+    }
+
+    static void format(const Slot &slot, char *out, size_t outSize)
+    {
+        if (outSize == 0)
+            return;
+        Reader args = {slot.data, slot.argCount};
+        size_t pos = 0;
+        const char *p = slot.format;
+        while (*p && pos + 1 < outSize)
+        {
+            const char *percent = strchr(p, '%');
+            if (!percent)
+            {
+                append(out, outSize, pos, p, strlen(p));
+                break;
+            }
+            append(out, outSize, pos, p, percent - p);
+            if (percent[1] == '%')
+            {
+                append(out, outSize, pos, "%", 1);
+                p = percent + 2;
+                continue;
+            }
+            // Spezifizierer bis zum Konvertierungszeichen
+            const char *end = percent + 1;
+            while (*end && strchr("-+ #0123456789.hljztL", *end))
+                end++;
+            if (!*end || *end == '*')
+            {
+                append(out, outSize, pos, percent, strlen(percent)); // '*' wird nicht unterstützt
+                break;
+            }
+            formatArg(out, outSize, pos, percent, end - percent + 1, *end, args);
+            p = end + 1;
+        }
+        out[pos] = 0;
+    }
+
+    Slot slots[MQTT_LOG_RING_SLOTS];
+    std::atomic<uint32_t> tail{0}; ///< nächste Schreibposition (alle Schreiber)
+    uint32_t head = 0;             ///< nächste Leseposition (nur der Leser)
+    std::atomic<uint32_t> droppedCount{0};
+};
+
+#endif // MQTT_LOG_RING_H
@@ -0,0 +1,159 @@
+#ifndef MQTT_METRICS_H
+#define MQTT_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Zähler und Messwerte des Brokers.
+ *
+ * Zähler (counter) laufen nur hoch und überlaufen bei 2^32 (Differenzen bleiben gültig),
+ * Messwerte (gauge) geben den aktuellen Stand an. Alle Werte sind 32-Bit-Atomics mit
+ * relaxed-Zugriff: auf dem ESP32 lock-frei, Lesen aus einer anderen Task ist erlaubt.
+ */
+enum class MQTTMetric : uint8_t
+{
+    BytesReceived,    ///< counter: Bytes aller empfangenen Pakete
+    BytesSent,        ///< counter: Bytes aller angenommenen ausgehenden Pakete
+    PublishRouted,    ///< counter: publish()-Aufrufe (Client-PUBLISH, LWT, eigene Nachrichten)
+    PublishDelivered, ///< counter: Zustellungen an Abonnenten (Summe der Fan-outs)
+    PublishDropped,   ///< counter: verworfene Nachrichten (Warteschlange voll, In-Flight-Fenster voll)
+    QoSRetries,       ///< counter: wiederholte PUBLISH/PUBREL
+    QoSDiscarded,     ///< counter: nach MQTT_MAX_RETRIES verworfene QoS-1/2-Nachrichten
+    FanoutMax,        ///< gauge: größter Fan-out einer Nachricht
+    RetainedCount,    ///< gauge: gespeicherte Retained Messages
+    RetainedBytes,    ///< gauge: Bytes der gespeicherten Retained-Frames
+    ClientsConnected, ///< gauge: verbundene Clients (nach CONNACK)
+    SessionsStored,   ///< gauge: gespeicherte persistente Sessions getrennter Clients
+    Count
+};
+
+/// Topic unter $SYS/broker/ für eine Metrik
+inline const char *mqttMetricTopic(MQTTMetric metric)
+{
+    static const char *const topics[] = {
+        "bytes/received",
+        "bytes/sent",
+        "publish/messages/routed",
+        "publish/messages/sent",
+        "publish/messages/dropped",
+        "publish/messages/retried",
+        "publish/messages/discarded",
+        "publish/fanout/max",
+        "retained messages/count",
+        "retained messages/bytes",
+        "clients/connected",
+        "clients/disconnected", // wie Mosquitto: getrennte Clients mit gespeicherter Session
+    };
+    static_assert(sizeof(topics) / sizeof(topics[0]) == (size_t)MQTTMetric::Count, "Topic fehlt");
+    return topics[(size_t)metric];
+}
+
+/// Name eines MQTT-Pakettyps (1..15) für $SYS/broker/packets/...
+inline const char *mqttPacketTypeName(uint8_t type)
+{
+    static const char *const names[] = {"reserved", "connect", "connack", "publish", "puback", "pubrec", "pubrel", "pubcomp",
+                                        "subscribe", "suback", "unsubscribe", "unsuback", "pingreq", "pingresp", "disconnect", "auth"};
+    return names[type & 0x0F];
+}
+
+/// Kopie aller Werte zu einem Zeitpunkt
+struct MQTTMetricsSnapshot
+{
+    uint32_t values[(size_t)MQTTMetric::Count];
+    uint32_t packetsIn[16];  ///< empfangene Pakete je Typ
+    uint32_t packetsOut[16]; ///< gesendete Pakete je Typ
+
+    uint32_t operator[](MQTTMetric metric) const { return values[(size_t)metric]; }
+
+    uint32_t totalPacketsIn() const
+    {
+        uint32_t sum = 0;
+        for (uint32_t n : packetsIn)
+            sum += n;
+        return sum;
+    }
+
+    uint32_t totalPacketsOut() const
+    {
+        uint32_t sum = 0;
+        for (uint32_t n : packetsOut)
+            sum += n;
+        return sum;
+    }
+};
+
+class MQTTMetrics
+{
+public:
+    MQTTMetrics() { reset(); }
+
+    void add(MQTTMetric metric, uint32_t n = 1) { values[(size_t)metric].fetch_add(n, std::memory_order_relaxed); }
+    void sub(MQTTMetric metric, uint32_t n = 1) { values[(size_t)metric].fetch_sub(n, std::memory_order_relaxed); }
+    void set(MQTTMetric metric, uint32_t value) { values[(size_t)metric].store(value, std::memory_order_relaxed); }
+
+    void max(MQTTMetric metric, uint32_t value)
+    {
+        std::atomic<uint32_t> &v = values[(size_t)metric];
+        uint32_t current = v.load(std::memory_order_relaxed);
+        while (value > current && !v.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void packetIn(uint8_t header, uint32_t bytes)
+    {
+        packetsIn[header >> 4].fetch_add(1, std::memory_order_relaxed);
+        add(MQTTMetric::BytesReceived, bytes);
+    }
+
+    void packetOut(uint8_t header, uint32_t bytes)
+    {
+        packetsOut[header >> 4].fetch_add(1, std::memory_order_relaxed);
+        add(MQTTMetric::BytesSent, bytes);
+    }
+
+    uint32_t get(MQTTMetric metric) const { return values[(size_t)metric].load(std::memory_order_relaxed); }
+
+    MQTTMetricsSnapshot snapshot() const
+    {
+        MQTTMetricsSnapshot s;
+        for (size_t i = 0; i < (size_t)MQTTMetric::Count; i++)
+            s.values[i] = values[i].load(std::memory_order_relaxed);
+        for (size_t i = 0; i < 16; i++)
+        {
+            s.packetsIn[i] = packetsIn[i].load(std::memory_order_relaxed);
+            s.packetsOut[i] = packetsOut[i].load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    /// Zähler zurücksetzen; Messwerte (gauges) bleiben erhalten
+    void resetCounters()
+    {
+        static const MQTTMetric counters[] = {MQTTMetric::BytesReceived, MQTTMetric::BytesSent, MQTTMetric::PublishRouted,
+                                              MQTTMetric::PublishDelivered, MQTTMetric::PublishDropped, MQTTMetric::QoSRetries,
+                                              MQTTMetric::QoSDiscarded, MQTTMetric::FanoutMax};
+        for (MQTTMetric m : counters)
+            set(m, 0);
+        for (size_t i = 0; i < 16; i++)
+        {
+            packetsIn[i].store(0, std::memory_order_relaxed);
+            packetsOut[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    void reset()
+    {
+        for (auto &v : values)
+            v.store(0, std::memory_order_relaxed);
+        resetCounters();
+    }
+
+    std::atomic<uint32_t> values[(size_t)MQTTMetric::Count];
+    std::atomic<uint32_t> packetsIn[16];
+    std::atomic<uint32_t> packetsOut[16];
+};
+
+#endif // MQTT_METRICS_H
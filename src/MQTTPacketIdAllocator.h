@@ -0,0 +1,91 @@
+#ifndef MQTT_PACKET_ID_ALLOCATOR_H
+#define MQTT_PACKET_ID_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Packet-ID-Vergabe pro Client mit In-Flight-Bitmap.
+ *
+ * Vergeben werden die IDs 1..window; ein gesetztes Bit bedeutet "in Flight". Die Suche
+ * beginnt reihum hinter der zuletzt vergebenen ID und springt wortweise über belegte
+ * Bereiche, ist also amortisiert O(1). Eine noch unbestätigte ID kann so nie erneut
+ * vergeben werden, und das Fenster begrenzt die gleichzeitig offenen QoS-1/2-Nachrichten.
+ */
+class MQTTPacketIdAllocator
+{
+public:
+    explicit MQTTPacketIdAllocator(uint16_t window = 16) { setWindow(window); }
+
+    /// Fenstergröße setzen (1..65535); gibt alle IDs frei.
+    void setWindow(uint16_t window)
+    {
+        size = window > 0 ? window : 1;
+        bits.assign((size + 31) / 32, 0);
+        cursor = 0;
+        used = 0;
+    }
+
+    /// Freie ID belegen. Gibt 0 zurück, wenn das Fenster voll ist.
+    uint16_t acquire()
+    {
+        if (used >= size)
+            return 0;
+
+        uint16_t slot = cursor;
+        for (uint32_t scanned = 0; scanned < (uint32_t)size + 64;)
+        {
+            uint32_t word = bits[slot / 32];
+            uint32_t bit = slot % 32;
+            uint32_t freeBits = ~word >> bit; // freie Slots ab 'slot' in diesem Wort
+            if (freeBits)
+            {
+                uint16_t candidate = slot + __builtin_ctz(freeBits);
+                if (candidate < size)
+                {
+                    bits[candidate / 32] |= 1UL << (candidate % 32);
+                    used++;
+                    cursor = (candidate + 1 < size) ? candidate + 1 : 0;
+                    return candidate + 1;
+                }
+            }
+            // Rest des Wortes übersprungen, ggf. am Fensterende umbrechen
+            uint32_t step = 32 - bit;
+            scanned += step;
+            slot = (slot + step < size) ? slot + step : 0;
+        }
+        return 0;
+    }
+
+    /// ID freigeben (PUBACK, PUBCOMP oder verworfene Nachricht).
+    void release(uint16_t id)
+    {
+        if (id == 0 || id > size)
+            return;
+        uint16_t slot = id - 1;
+        uint32_t mask = 1UL << (slot % 32);
+        if (bits[slot / 32] & mask)
+        {
+            bits[slot / 32] &= ~mask;
+            used--;
+        }
+    }
+
+    bool inUse(uint16_t id) const
+    {
+        if (id == 0 || id > size)
+            return false;
+        return (bits[(id - 1) / 32] >> ((id - 1) % 32)) & 1;
+    }
+
+    uint16_t inFlight() const { return used; }
+    uint16_t window() const { return size; }
+
+private:
+    std::vector<uint32_t> bits;
+    uint16_t size = 0;
+    uint16_t cursor = 0;
+    uint16_t used = 0;
+};
+
+#endif // MQTT_PACKET_ID_ALLOCATOR_H
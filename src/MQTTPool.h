@@ -0,0 +1,379 @@
+#ifndef MQTT_POOL_H
+#define MQTT_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#endif
+
+#ifndef MQTT_POOL_SLAB_SIZE
+#define MQTT_POOL_SLAB_SIZE 2048 // Zielgröße eines Slabs in Bytes (mindestens 2 Blöcke je Slab), kleinste Arena
+#endif
+#ifndef MQTT_POOL_MAX_BYTES
+#define MQTT_POOL_MAX_BYTES 0 // Standard für ESPAsyncMQTTBrokerConfig::poolMaxBytes (0 = aus, opt-in)
+#endif
+
+/// Blockgrößen der Größenklassen (Vielfache von 16, aufsteigend); größere Anforderungen gehen an den Heap
+static const uint16_t MQTT_POOL_BLOCK_SIZES[] = {32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1280, 1536};
+static const size_t MQTT_POOL_CLASSES = sizeof(MQTT_POOL_BLOCK_SIZES) / sizeof(MQTT_POOL_BLOCK_SIZES[0]);
+
+/// Zustand einer Größenklasse
+struct MQTTPoolClassStats
+{
+    uint16_t blockSize;
+    uint16_t slabs;      ///< aus der Arena geschnittene Slabs (werden nicht zurückgegeben)
+    uint32_t blocksUsed; ///< belegte Blöcke
+    uint32_t blocksFree; ///< freie Blöcke in den Slabs
+    uint32_t hits;       ///< counter: aus der Freiliste bedient
+    uint32_t grows;      ///< counter: neuer Slab angelegt
+    uint32_t misses;     ///< counter: an den Heap weitergereicht (Arena aufgeteilt oder nicht allokierbar)
+};
+
+/// Kopie der Pool-Statistik (ESPAsyncMQTTBroker::getPoolStats())
+struct MQTTPoolStats
+{
+    MQTTPoolClassStats classes[MQTT_POOL_CLASSES];
+    uint32_t oversize;       ///< counter: Anforderungen über der größten Blockgröße (immer Heap)
+    size_t arenaBytes;       ///< vom Pool belegter Heap (Arena, bei der ersten Anforderung angelegt)
+    size_t slabBytes;        ///< davon in Slabs aufgeteilt
+    size_t maxBytes;         ///< Obergrenze für die Arena (0 = Pool aus)
+    size_t usedBytes;        ///< Bytes der belegten Blöcke
+    size_t requestedBytes;   ///< davon angefordert; usedBytes - requestedBytes = Verschnitt der Größenklassen
+    size_t heapFree;         ///< freier Heap (ESP32, intern + PSRAM; Host: 0)
+    size_t heapLargestBlock; ///< größter freier Block (ESP32; Host: 0)
+
+    uint32_t hits() const { return sum(&MQTTPoolClassStats::hits); }
+    uint32_t grows() const { return sum(&MQTTPoolClassStats::grows); }
+    uint32_t misses() const { return sum(&MQTTPoolClassStats::misses); }
+
+    /// Anteil der aus der Freiliste bedienten Anforderungen in Prozent (alle Anforderungen, auch übergroße)
+    uint8_t hitRate() const
+    {
+        uint64_t total = (uint64_t)hits() + grows() + misses() + oversize;
+        return total ? (uint8_t)(hits() * 100ULL / total) : 0;
+    }
+
+    /// Anteil freier, aber in Slabs gebundener Bytes am Pool in Prozent
+    uint8_t slabFragmentation() const { return slabBytes ? (uint8_t)((slabBytes - usedBytes) * 100ULL / slabBytes) : 0; }
+
+    /// 100 - größter freier Block / freier Heap in Prozent (0 = ein zusammenhängender Bereich)
+    uint8_t heapFragmentation() const { return heapFree ? (uint8_t)(100 - heapLargestBlock * 100ULL / heapFree) : 0; }
+
+private:
+    uint32_t sum(uint32_t MQTTPoolClassStats::*field) const
+    {
+        uint32_t total = 0;
+        for (const MQTTPoolClassStats &c : classes)
+            total += c.*field;
+        return total;
+    }
+};
+
+/**
+ * Slab-Pool mit Größenklassen für die kurzlebigen, häufigen Allokationen des Brokers:
+ * Frame-Puffer und Frames (PUBLISH, Steuerpakete, Wiederholungen, Reassemblierung), die
+ * Einträge der QoS-Zustände und Sendewarteschlangen sowie MQTTClient.
+ *
+ * Bei der ersten Anforderung legt der Pool eine zusammenhängende Arena von maxBytes an (passt sie
+ * nicht am Stück, halb so groß usw.). Jede Klasse schneidet sich daraus Slabs von etwa
+ * MQTT_POOL_SLAB_SIZE Bytes und verwaltet deren Blöcke in einer Freiliste. Slabs werden nie
+ * zurückgegeben: nach der Anlaufphase bedient der Pool die Last aus den vorhandenen Blöcken, der
+ * Heap sieht keine wechselnden kleinen Blöcke mehr und zerstückelt nicht. Ist die Arena aufgeteilt
+ * oder die Anforderung größer als die größte Klasse, geht sie an den Heap (operator new) und zählt
+ * als miss bzw. oversize.
+ *
+ * Freigegeben wird immer mit der angeforderten Größe (Allokator, sized delete, MQTTPoolDeleter);
+ * ob ein Block aus dem Pool stammt, entscheidet ein Adressvergleich mit der Arena (O(1)), alles
+ * andere geht an den Heap zurück.
+ *
+ * Auf dem ESP32 schützt ein Spinlock (portMUX) Freilisten und Zähler, die Arena liegt wahlweise im
+ * PSRAM (configure()). Eine Instanz je Prozess: mqttPool().
+ */
+class MQTTSlabPool
+{
+public:
+    MQTTSlabPool()
+    {
+        for (size_t i = 0; i < MQTT_POOL_CLASSES; i++)
+        {
+            classes[i].blockSize = MQTT_POOL_BLOCK_SIZES[i];
+            size_t perSlab = MQTT_POOL_SLAB_SIZE / MQTT_POOL_BLOCK_SIZES[i];
+            classes[i].blocksPerSlab = (uint16_t)(perSlab < 2 ? 2 : perSlab);
+        }
+    }
+
+    /**
+     * Größe der Arena (0 = Pool aus) und Ablage im PSRAM. Wirkt voll, solange noch kein Slab
+     * geschnitten ist; danach kann die Grenze nur noch sinken, bestehende Slabs bleiben.
+     */
+    void configure(size_t maxBytes, bool psram)
+    {
+        uint8_t *unused = nullptr;
+        lock();
+        this->maxBytes = maxBytes;
+        this->psram = psram;
+        if (slabBytes == 0)
+        {
+            // Noch ungenutzte Arena verwerfen, die nächste Anforderung legt sie passend neu an
+            unused = arena;
+            arena = nullptr;
+            arenaBytes = 0;
+            arenaTried = false;
+        }
+        unlock();
+        freeArena(unused);
+    }
+
+    void *allocate(size_t size)
+    {
+        int index = classFor(size);
+        if (index < 0)
+        {
+            lock();
+            oversize++;
+            unlock();
+            return ::operator new(size);
+        }
+
+        SizeClass &c = classes[index];
+        lock();
+        if (c.freeList)
+        {
+            FreeBlock *block = c.freeList;
+            c.freeList = block->next;
+            c.free--;
+            c.used++;
+            c.hits++;
+            requestedBytes += size;
+            unlock();
+            return block;
+        }
+        // Arena einmalig außerhalb des Spinlocks anlegen (der Heap darf dort nicht aufgerufen werden)
+        size_t reserve = (!arenaTried && maxBytes > 0) ? maxBytes : 0;
+        arenaTried = true;
+        unlock();
+        if (reserve)
+        {
+            size_t bytes = 0;
+            uint8_t *p = allocArena(reserve, bytes);
+            lock();
+            arena = p;
+            arenaBytes = bytes;
+            unlock();
+        }
+
+        lock();
+        size_t bytes = slabBytesFor(c);
+        size_t limit = arenaBytes < maxBytes ? arenaBytes : maxBytes;
+        if (!arena || slabBytes + bytes > limit)
+        {
+            c.misses++;
+            unlock();
+            return ::operator new(size);
+        }
+        // Neuen Slab aus der Arena schneiden: erster Block an den Aufrufer, die übrigen in die Freiliste
+        uint8_t *first = arena + slabBytes;
+        slabBytes += bytes;
+        for (uint16_t i = c.blocksPerSlab - 1; i > 0; i--)
+        {
+            FreeBlock *block = (FreeBlock *)(first + (size_t)i * c.blockSize);
+            block->next = c.freeList;
+            c.freeList = block;
+        }
+        c.slabCount++;
+        c.free += c.blocksPerSlab - 1;
+        c.used++;
+        c.grows++;
+        requestedBytes += size;
+        unlock();
+        return first;
+    }
+
+    void deallocate(void *p, size_t size)
+    {
+        if (!p)
+            return;
+        int index = classFor(size);
+        if (index >= 0)
+        {
+            SizeClass &c = classes[index];
+            lock();
+            if (owns(p))
+            {
+                FreeBlock *block = (FreeBlock *)p;
+                block->next = c.freeList;
+                c.freeList = block;
+                c.free++;
+                c.used--;
+                requestedBytes -= size;
+                unlock();
+                return;
+            }
+            unlock();
+        }
+        ::operator delete(p);
+    }
+
+    MQTTPoolStats stats()
+    {
+        MQTTPoolStats s;
+        lock();
+        s.usedBytes = 0;
+        for (size_t i = 0; i < MQTT_POOL_CLASSES; i++)
+        {
+            const SizeClass &c = classes[i];
+            s.classes[i] = MQTTPoolClassStats{c.blockSize, c.slabCount, c.used, c.free, c.hits, c.grows, c.misses};
+            s.usedBytes += (size_t)c.used * c.blockSize;
+        }
+        s.oversize = oversize;
+        s.arenaBytes = arenaBytes;
+        s.slabBytes = slabBytes;
+        s.maxBytes = maxBytes;
+        s.requestedBytes = requestedBytes;
+        unlock();
+#if defined(ARDUINO_ARCH_ESP32)
+        s.heapFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        s.heapLargestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#else
+        s.heapFree = 0;
+        s.heapLargestBlock = 0;
+#endif
+        return s;
+    }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    struct SizeClass
+    {
+        uint16_t blockSize = 0;
+        uint16_t blocksPerSlab = 0;
+        uint16_t slabCount = 0;
+        FreeBlock *freeList = nullptr;
+        uint32_t used = 0, free = 0;
+        uint32_t hits = 0, grows = 0, misses = 0;
+    };
+
+    static int classFor(size_t size)
+    {
+        for (size_t i = 0; i < MQTT_POOL_CLASSES; i++)
+        {
+            if (size <= MQTT_POOL_BLOCK_SIZES[i])
+                return (int)i;
+        }
+        return -1;
+    }
+
+    // Blockgrößen sind Vielfache von 16: Slabs und Blöcke behalten die Ausrichtung der Arena
+    static size_t slabBytesFor(const SizeClass &c) { return (size_t)c.blocksPerSlab * c.blockSize; }
+
+    bool owns(const void *p) const
+    {
+        return (const uint8_t *)p >= arena && (const uint8_t *)p < arena + slabBytes;
+    }
+
+    uint8_t *allocArena(size_t wanted, size_t &bytes) const
+    {
+        for (bytes = wanted; bytes >= MQTT_POOL_SLAB_SIZE; bytes /= 2)
+        {
+#if defined(ARDUINO_ARCH_ESP32)
+            void *p = psram ? heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : nullptr;
+            if (!p)
+                p = heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+            void *p = ::operator new(bytes, std::nothrow); // Host: zählt in HostHeap mit
+#endif
+            if (p)
+                return (uint8_t *)p;
+        }
+        bytes = 0;
+        return nullptr;
+    }
+
+    static void freeArena(uint8_t *p)
+    {
+        if (!p)
+            return;
+#if defined(ARDUINO_ARCH_ESP32)
+        heap_caps_free(p);
+#else
+        ::operator delete(p);
+#endif
+    }
+
+#if defined(ARDUINO_ARCH_ESP32)
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    void lock() { portENTER_CRITICAL(&mux); }
+    void unlock() { portEXIT_CRITICAL(&mux); }
+#else
+    // Host-Build: ein Thread (HostLoop)
+    void lock() {}
+    void unlock() {}
+#endif
+
+    SizeClass classes[MQTT_POOL_CLASSES];
+    uint8_t *arena = nullptr;
+    size_t arenaBytes = 0;   // angelegte Arena (kann kleiner als maxBytes sein)
+    bool arenaTried = false; // Arena angelegt oder vergeblich versucht
+    size_t maxBytes = MQTT_POOL_MAX_BYTES;
+    bool psram = false;
+    size_t slabBytes = 0;    // in Slabs aufgeteilter Anfang der Arena
+    size_t requestedBytes = 0;
+    uint32_t oversize = 0;
+};
+
+/// Pool des Prozesses. Wird nie abgebaut, damit globale Objekte ihre Blöcke auch nach main() noch zurückgeben können.
+inline MQTTSlabPool &mqttPool()
+{
+    static MQTTSlabPool *pool = new MQTTSlabPool();
+    return *pool;
+}
+
+/// STL-Allokator auf mqttPool() (std::map, std::deque, std::allocate_shared)
+template <typename T>
+struct MQTTPoolAllocator
+{
+    typedef T value_type;
+
+    MQTTPoolAllocator() {}
+    template <typename U>
+    MQTTPoolAllocator(const MQTTPoolAllocator<U> &) {}
+
+    T *allocate(size_t n) { return (T *)mqttPool().allocate(n * sizeof(T)); }
+    void deallocate(T *p, size_t n) { mqttPool().deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const MQTTPoolAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const MQTTPoolAllocator<U> &) const { return false; }
+};
+
+/// Gibt einen Byte-Puffer mit seiner angeforderten Größe an den Pool zurück
+struct MQTTPoolDeleter
+{
+    size_t size = 0;
+    void operator()(uint8_t *p) const { mqttPool().deallocate(p, size); }
+};
+
+typedef std::unique_ptr<uint8_t[], MQTTPoolDeleter> MQTTPoolBuffer;
+
+inline MQTTPoolBuffer mqttPoolBuffer(size_t size)
+{
+    return MQTTPoolBuffer((uint8_t *)mqttPool().allocate(size), MQTTPoolDeleter{size});
+}
+
+/// Puffer direkt vom Heap für langlebige Daten; deallocate() erkennt ihn als nicht aus der Arena
+inline MQTTPoolBuffer mqttHeapBuffer(size_t size)
+{
+    return MQTTPoolBuffer((uint8_t *)::operator new(size), MQTTPoolDeleter{size});
+}
+
+#endif // MQTT_POOL_H
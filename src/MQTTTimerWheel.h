@@ -0,0 +1,120 @@
+#ifndef MQTT_TIMER_WHEEL_H
+#define MQTT_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Gehashtes Timer-Rad für Fristen in Millisekunden (Keep-Alive, QoS-Wiederholungen).
+ *
+ * Jede Frist landet im Slot (deadline / tickMs) % slotCount. advance() besucht nur die
+ * seit dem letzten Aufruf vergangenen Slots; Einträge mit einer Frist jenseits einer
+ * Radumdrehung bleiben liegen, bis ihre Runde erreicht ist. Die Uhr wird immer von außen
+ * übergeben (millis() im Broker, virtuelle Zeit auf dem Host).
+ *
+ * Einträge werden nicht gelöscht: der Aufrufer prüft beim Ablauf, ob die Frist noch gilt,
+ * und plant bei Bedarf neu (lazy cancellation).
+ */
+template <typename T>
+class MQTTTimerWheel
+{
+public:
+    explicit MQTTTimerWheel(uint32_t tickMs = 100, size_t slotCount = 128)
+        : tickMs(tickMs), slots(slotCount) {}
+
+    void schedule(uint32_t deadline, const T &value)
+    {
+        // Fristen in der Vergangenheit laufen beim nächsten advance() ab
+        if (started && (int32_t)(deadline - lastTime) <= 0)
+        {
+            deadline = lastTime;
+        }
+        slots[(deadline / tickMs) % slots.size()].push_back(Entry{deadline, value});
+        count++;
+    }
+
+    /**
+     * Uhr auf 'now' vorstellen und fn(value) für jeden abgelaufenen Eintrag aufrufen.
+     * fn darf schedule() aufrufen.
+     */
+    template <typename Fn>
+    void advance(uint32_t now, Fn fn)
+    {
+        uint32_t toTick = now / tickMs;
+        uint32_t fromTick = lastTime / tickMs;
+        uint32_t ticks = toTick - fromTick;
+        if (!started || ticks >= slots.size())
+        {
+            // Erster Aufruf oder mehr als eine Umdrehung vergangen: jeden Slot genau einmal besuchen
+            started = true;
+            ticks = slots.size() - 1;
+            fromTick = toTick - ticks;
+        }
+        lastTime = now;
+        lastScanned = 0;
+        if (count == 0)
+        {
+            return;
+        }
+
+        // Wiederverwendeten Puffer ausleihen, damit fn() gefahrlos neu planen (oder advance() aufrufen) kann
+        std::vector<Entry> due;
+        due.swap(expired);
+        for (uint32_t i = 0; i <= ticks; i++)
+        {
+            std::vector<Entry> &slot = slots[(fromTick + i) % slots.size()];
+            lastScanned += slot.size();
+            for (size_t j = 0; j < slot.size();)
+            {
+                if ((int32_t)(slot[j].deadline - now) <= 0)
+                {
+                    due.push_back(std::move(slot[j]));
+                    slot[j] = std::move(slot.back());
+                    slot.pop_back();
+                    count--;
+                }
+                else
+                {
+                    j++;
+                }
+            }
+        }
+
+        for (const Entry &e : due)
+        {
+            fn(e.value);
+        }
+        due.clear();
+        expired.swap(due);
+    }
+
+    size_t size() const { return count; }
+    /// Vom letzten advance() geprüfte Einträge (abgelaufene und spätere Runden derselben Slots)
+    size_t scanned() const { return lastScanned; }
+
+    void clear()
+    {
+        for (auto &slot : slots)
+            slot.clear();
+        count = 0;
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t deadline;
+        T value;
+    };
+
+    uint32_t tickMs;
+    std::vector<std::vector<Entry>> slots;
+    std::vector<Entry> expired; // wiederverwendeter Puffer für advance()
+    size_t count = 0;
+    size_t lastScanned = 0;
+    uint32_t lastTime = 0;
+    bool started = false;
+};
+
+#endif // MQTT_TIMER_WHEEL_H
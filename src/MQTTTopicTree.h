@@ -0,0 +1,337 @@
+#ifndef MQTT_TOPIC_TREE_H
+#define MQTT_TOPIC_TREE_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Topic-Baum (Trie) über die Ebenen eines Topic-Filters.
+ *
+ * Jede Ebene ist ein Knoten, '+' und '#' haben eigene Kind-Slots. Werte (z.B. Abonnenten)
+ * hängen an dem Knoten, an dem ihr Filter endet. Damit kostet das Routing eines Topics
+ * nur die Ebenen des Topics plus die tatsächlich vorhandenen Wildcard-Zweige, statt
+ * jeden Filter einzeln mit dem Topic zu vergleichen.
+ *
+ * Umgekehrt kann der Baum konkrete Topics halten (Retained Messages): forEachMatchingTopic()
+ * besucht dann zu einem Filter nur den passenden Teilbaum.
+ *
+ * Unabhängig von Arduino-Typen, damit der Baum auch auf dem Host gemessen werden kann.
+ */
+template <typename T>
+class MQTTTopicTree
+{
+public:
+    /// Wert unter dem Filter eintragen. Gibt false zurück, wenn er dort schon existiert.
+    bool insert(const char *filter, size_t len, T value)
+    {
+        Node *node = &root;
+        forEachLevel(filter, len, [&](const char *level, size_t levelLen)
+                     { node = node->child(level, levelLen, true); });
+        if (std::find(node->values.begin(), node->values.end(), value) != node->values.end())
+        {
+            return false;
+        }
+        node->values.push_back(std::move(value));
+        count++;
+        return true;
+    }
+
+    /// Wert unter dem Filter entfernen; leer gewordene Knoten werden abgebaut.
+    bool remove(const char *filter, size_t len, const T &value)
+    {
+        std::vector<Node *> path;
+        Node *node = findPath(filter, len, path);
+        if (!node)
+        {
+            return false;
+        }
+        auto it = std::find(node->values.begin(), node->values.end(), value);
+        if (it == node->values.end())
+        {
+            return false;
+        }
+        node->values.erase(it);
+        count--;
+        prune(node, path);
+        return true;
+    }
+
+    /// Alle Werte unter genau diesem Filter/Topic entfernen. Gibt die Anzahl zurück.
+    size_t erase(const char *filter, size_t len)
+    {
+        std::vector<Node *> path;
+        Node *node = findPath(filter, len, path);
+        if (!node)
+        {
+            return 0;
+        }
+        size_t removed = node->values.size();
+        node->values.clear();
+        count -= removed;
+        prune(node, path);
+        return removed;
+    }
+
+    /// Erster Wert unter genau diesem Filter/Topic (ohne Wildcard-Auswertung) oder nullptr.
+    T *find(const char *filter, size_t len)
+    {
+        std::vector<Node *> path;
+        Node *node = findPath(filter, len, path);
+        if (!node || node->values.empty())
+        {
+            return nullptr;
+        }
+        return &node->values.front();
+    }
+
+    /**
+     * Ruft fn(value) für jeden Wert auf, dessen Filter auf das Topic passt.
+     * Ein Wert kann mehrfach geliefert werden, wenn mehrere seiner Filter passen.
+     */
+    template <typename Fn>
+    void forEachMatch(const char *topic, size_t len, Fn fn) const
+    {
+        if (len > 0 && topic[0] == '$')
+        {
+            // '$'-Topics ($SYS/...) passen nicht auf '+' oder '#' in der ersten Ebene
+            const char *end = topic + len;
+            const char *slash = (const char *)memchr(topic, '/', len);
+            const Node *child = root.find(topic, (size_t)((slash ? slash : end) - topic));
+            if (child)
+                matchNode(*child, slash ? slash + 1 : nullptr, end, fn);
+            return;
+        }
+        matchNode(root, topic, topic + len, fn);
+    }
+
+    /**
+     * Umkehrung von forEachMatch() für einen Baum aus konkreten Topics: ruft fn(value) für
+     * jeden Wert auf, dessen Topic auf den Filter passt. Ein exakter Filter ist ein einzelner
+     * Pfad, '+' besucht alle Kinder einer Ebene, '#' den ganzen Teilbaum (inkl. Elternebene).
+     */
+    template <typename Fn>
+    void forEachMatchingTopic(const char *filter, size_t len, Fn fn) const
+    {
+        matchTopics(root, filter, filter + len, fn, true);
+    }
+
+    size_t size() const { return count; }
+
+    void clear()
+    {
+        root = Node();
+        count = 0;
+    }
+
+private:
+    struct Node
+    {
+        std::vector<std::pair<std::string, std::unique_ptr<Node>>> children; ///< nach Name sortiert
+        std::unique_ptr<Node> plus;                                          ///< '+'-Zweig
+        std::unique_ptr<Node> hash;                                          ///< '#'-Zweig
+        std::vector<T> values;
+
+        bool isEmpty() const { return values.empty() && children.empty() && !plus && !hash; }
+
+        static bool less(const std::pair<std::string, std::unique_ptr<Node>> &entry, const std::pair<const char *, size_t> &key)
+        {
+            size_t n = std::min(entry.first.size(), key.second);
+            int c = memcmp(entry.first.data(), key.first, n);
+            return c < 0 || (c == 0 && entry.first.size() < key.second);
+        }
+
+        Node *child(const char *level, size_t levelLen, bool create)
+        {
+            std::unique_ptr<Node> *slot = nullptr;
+            if (levelLen == 1 && level[0] == '+')
+            {
+                slot = &plus;
+            }
+            else if (levelLen == 1 && level[0] == '#')
+            {
+                slot = &hash;
+            }
+            if (slot)
+            {
+                if (!*slot && create)
+                    slot->reset(new Node());
+                return slot->get();
+            }
+            Node *found = find(level, levelLen);
+            if (found || !create)
+            {
+                return found;
+            }
+            auto key = std::make_pair(level, levelLen);
+            auto it = std::lower_bound(children.begin(), children.end(), key, less);
+            it = children.emplace(it, std::string(level, levelLen), std::unique_ptr<Node>(new Node()));
+            return it->second.get();
+        }
+
+        Node *find(const char *level, size_t levelLen) const
+        {
+            auto key = std::make_pair(level, levelLen);
+            auto it = std::lower_bound(children.begin(), children.end(), key, less);
+            if (it != children.end() && it->first.size() == levelLen && memcmp(it->first.data(), level, levelLen) == 0)
+            {
+                return it->second.get();
+            }
+            return nullptr;
+        }
+
+        void release(Node *node)
+        {
+            if (plus.get() == node)
+            {
+                plus.reset();
+                return;
+            }
+            if (hash.get() == node)
+            {
+                hash.reset();
+                return;
+            }
+            for (auto it = children.begin(); it != children.end(); ++it)
+            {
+                if (it->second.get() == node)
+                {
+                    children.erase(it);
+                    return;
+                }
+            }
+        }
+    };
+
+    // Zerlegt einen Filter/Topic in seine Ebenen ("a//b" -> "a", "", "b")
+    template <typename Fn>
+    static void forEachLevel(const char *s, size_t len, Fn fn)
+    {
+        const char *end = s + len;
+        while (true)
+        {
+            const char *slash = (const char *)memchr(s, '/', end - s);
+            const char *levelEnd = slash ? slash : end;
+            fn(s, (size_t)(levelEnd - s));
+            if (!slash)
+                break;
+            s = slash + 1;
+        }
+    }
+
+    // Knoten zu einem Filter suchen; path erhält die Vorgänger (für prune())
+    Node *findPath(const char *filter, size_t len, std::vector<Node *> &path)
+    {
+        path.reserve(8);
+        Node *node = &root;
+        forEachLevel(filter, len, [&](const char *level, size_t levelLen)
+                     {
+            if (!node)
+                return;
+            path.push_back(node);
+            node = node->child(level, levelLen, false); });
+        return node;
+    }
+
+    // Von unten nach oben leere Knoten aus dem Elternknoten lösen
+    static void prune(Node *node, std::vector<Node *> &path)
+    {
+        while (!path.empty() && node->isEmpty())
+        {
+            Node *parent = path.back();
+            path.pop_back();
+            parent->release(node);
+            node = parent;
+        }
+    }
+
+    // Alle Werte eines Teilbaums
+    template <typename Fn>
+    static void visitSubtree(const Node &node, Fn &fn)
+    {
+        for (const T &v : node.values)
+            fn(v);
+        for (const auto &entry : node.children)
+            visitSubtree(*entry.second, fn);
+    }
+
+    // level == nullptr bedeutet: alle Ebenen des Filters sind verbraucht
+    // topLevel: '+'/'#' in der ersten Ebene überspringen '$'-Topics
+    template <typename Fn>
+    static void matchTopics(const Node &node, const char *level, const char *end, Fn &fn, bool topLevel = false)
+    {
+        if (!level)
+        {
+            for (const T &v : node.values)
+                fn(v);
+            return;
+        }
+        const char *slash = (const char *)memchr(level, '/', end - level);
+        const char *levelEnd = slash ? slash : end;
+        const char *next = slash ? slash + 1 : nullptr;
+        size_t levelLen = (size_t)(levelEnd - level);
+        if (levelLen == 1 && level[0] == '#')
+        {
+            if (!topLevel)
+            {
+                visitSubtree(node, fn);
+                return;
+            }
+            for (const T &v : node.values)
+                fn(v);
+            for (const auto &entry : node.children)
+                if (entry.first.empty() || entry.first[0] != '$')
+                    visitSubtree(*entry.second, fn);
+        }
+        else if (levelLen == 1 && level[0] == '+')
+        {
+            for (const auto &entry : node.children)
+                if (!topLevel || entry.first.empty() || entry.first[0] != '$')
+                    matchTopics(*entry.second, next, end, fn);
+        }
+        else
+        {
+            const Node *child = node.find(level, levelLen);
+            if (child)
+                matchTopics(*child, next, end, fn);
+        }
+    }
+
+    // level == nullptr bedeutet: alle Ebenen des Topics sind verbraucht
+    template <typename Fn>
+    static void matchNode(const Node &node, const char *level, const char *end, Fn &fn)
+    {
+        // '#' passt auf den Rest des Topics und auch auf die Elternebene selbst ("a/#" passt auf "a")
+        if (node.hash)
+        {
+            for (const T &v : node.hash->values)
+                fn(v);
+        }
+        if (!level)
+        {
+            for (const T &v : node.values)
+                fn(v);
+            return;
+        }
+        const char *slash = (const char *)memchr(level, '/', end - level);
+        const char *levelEnd = slash ? slash : end;
+        const char *next = slash ? slash + 1 : nullptr;
+        if (node.plus)
+        {
+            matchNode(*node.plus, next, end, fn);
+        }
+        const Node *child = node.find(level, (size_t)(levelEnd - level));
+        if (child)
+        {
+            matchNode(*child, next, end, fn);
+        }
+    }
+
+    Node root;
+    size_t count = 0;
+};
+
+#endif // MQTT_TOPIC_TREE_H
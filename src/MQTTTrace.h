@@ -0,0 +1,157 @@
+#ifndef MQTT_TRACE_H
+#define MQTT_TRACE_H
+
+/**
+ * Optionale Laufzeitmessung des Hot-Paths (Build-Flag -DMQTT_TRACE).
+ *
+ * MQTT_TRACE_SCOPE(name, stage) nimmt beim Anlegen einen Zyklenzähler-Stempel und trägt
+ * beim Verlassen des Blocks (oder bei MQTT_TRACE_STOP(name)) die Dauer in das Histogramm
+ * der Stufe ein. Ohne MQTT_TRACE sind beide Makros leer, es entsteht kein Code.
+ *
+ * Zeitbasis: ESP32-Zyklenzähler, auf dem Host rdtsc (x86) bzw. clock_gettime (Nanosekunden).
+ * Die Histogramme haben feste log2-Buckets und werden ohne Sperren aus dem Netzwerk-Task
+ * beschrieben; Lesen aus loop() liefert daher nur näherungsweise konsistente Werte.
+ */
+
+#ifdef MQTT_TRACE
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Esp.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+enum class MQTTTraceStage : uint8_t
+{
+    Packet,   ///< handleData(): onData bis zum letzten write() aller Folgepakete
+    Parse,    ///< processPacket(): Fixed Header bis zur Übergabe an den Handler
+    Validate, ///< Topic-/Filter-Prüfung (PUBLISH, SUBSCRIBE)
+    Route,    ///< Abonnenten im Topic-Baum bestimmen
+    Encode,   ///< PUBLISH-Frame kodieren
+    Write,    ///< writeFrame(): direktes Schreiben oder Einreihen
+    Retained, ///< sendRetainedMessages()
+    Count
+};
+
+inline const char *mqttTraceStageName(MQTTTraceStage stage)
+{
+    static const char *const names[] = {"packet", "parse", "validate", "route", "encode", "write", "retained"};
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)MQTTTraceStage::Count, "Name fehlt");
+    return names[(size_t)stage];
+}
+
+// ESP.getCycleCount() ist ein 32-Bit-Zähler (läuft bei 240 MHz alle ~18 s über): Stempel und
+// Differenz bleiben dort 32 Bit breit, damit ein Überlauf während einer Messung richtig gerechnet wird
+#if defined(ARDUINO_ARCH_ESP32)
+typedef uint32_t MQTTTraceStamp;
+#else
+typedef uint64_t MQTTTraceStamp;
+#endif
+
+inline MQTTTraceStamp mqttTraceNow()
+{
+#if defined(ARDUINO_ARCH_ESP32)
+    return ESP.getCycleCount();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/// Histogramm mit log2-Buckets: Bucket i zählt Dauern in [2^i, 2^(i+1)) Ticks
+struct MQTTTraceHistogram
+{
+    static const int Buckets = 40;
+
+    uint32_t buckets[Buckets];
+    uint32_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    void record(uint64_t ticks)
+    {
+        int bucket = ticks ? 63 - __builtin_clzll(ticks) : 0;
+        if (bucket >= Buckets)
+            bucket = Buckets - 1;
+        buckets[bucket]++;
+        count++;
+        sum += ticks;
+        if (ticks > max)
+            max = ticks;
+    }
+
+    uint64_t mean() const { return count ? sum / count : 0; }
+
+    /// Obergrenze des Buckets, in dem das Perzentil p (0..100) liegt
+    uint64_t percentile(uint32_t p) const
+    {
+        if (count == 0)
+            return 0;
+        uint64_t rank = ((uint64_t)count * p + 99) / 100;
+        uint64_t seen = 0;
+        for (int i = 0; i < Buckets; i++)
+        {
+            seen += buckets[i];
+            if (seen >= rank && buckets[i])
+            {
+                uint64_t bound = (2ULL << i) - 1;
+                return bound < max ? bound : max;
+            }
+        }
+        return max;
+    }
+};
+
+/// Histogramm einer Stufe (global, damit es auch außerhalb des Brokers ausgewertet werden kann)
+inline MQTTTraceHistogram &mqttTraceHistogram(MQTTTraceStage stage)
+{
+    static MQTTTraceHistogram histograms[(size_t)MQTTTraceStage::Count];
+    return histograms[(size_t)stage];
+}
+
+inline void mqttTraceReset()
+{
+    for (size_t i = 0; i < (size_t)MQTTTraceStage::Count; i++)
+        memset(&mqttTraceHistogram((MQTTTraceStage)i), 0, sizeof(MQTTTraceHistogram));
+}
+
+class MQTTTraceSpan
+{
+public:
+    explicit MQTTTraceSpan(MQTTTraceStage stage) : stage(stage), start(mqttTraceNow()) {}
+    ~MQTTTraceSpan() { stop(); }
+
+    void stop()
+    {
+        if (running)
+        {
+            running = false;
+            mqttTraceHistogram(stage).record((MQTTTraceStamp)(mqttTraceNow() - start));
+        }
+    }
+
+private:
+    MQTTTraceStage stage;
+    MQTTTraceStamp start;
+    bool running = true;
+};
+
+#define MQTT_TRACE_SCOPE(name, stage) MQTTTraceSpan name(MQTTTraceStage::stage)
+#define MQTT_TRACE_STOP(name) name.stop()
+
+#else
+
+#define MQTT_TRACE_SCOPE(name, stage)
+#define MQTT_TRACE_STOP(name)
+
+#endif // MQTT_TRACE
+
+#endif // MQTT_TRACE_H
@@ -0,0 +1,37 @@
+#ifndef MQTT_VIEW_H
+#define MQTT_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Nicht besitzende Sicht auf Bytes (Zeiger + Länge), z. B. Topic und Payload eines PUBLISH
+ * direkt im Empfangspuffer.
+ *
+ * handlePublish() reicht Topic und Payload als Sicht bis in die Validierung, das Routing über
+ * den Topic-Baum und das Kodieren des Frames durch. Kopiert wird nur, was den Puffer von
+ * onData() überleben muss: der kodierte Frame (Retained Messages, QoS-Wiederholungen) und der
+ * QoS-2-Zwischenspeicher bis zum PUBREL.
+ *
+ * Nicht nullterminiert: als Log-Argument direkt übergeben (%s), MQTTLogRing kopiert die Bytes.
+ */
+struct MQTTView
+{
+    const char *data = nullptr;
+    size_t len = 0;
+
+    MQTTView() {}
+    MQTTView(const char *data, size_t len) : data(data), len(len) {}
+    MQTTView(const uint8_t *data, size_t len) : data((const char *)data), len(len) {}
+    /// C-String (nullptr = leer)
+    explicit MQTTView(const char *str) : data(str), len(str ? strlen(str) : 0) {}
+
+    const uint8_t *bytes() const { return (const uint8_t *)data; }
+    bool empty() const { return len == 0; }
+    bool contains(char c) const { return len > 0 && memchr(data, c, len) != nullptr; }
+    /// Die ersten n Bytes (höchstens len)
+    MQTTView first(size_t n) const { return MQTTView(data, n < len ? n : len); }
+};
+
+#endif // MQTT_VIEW_H